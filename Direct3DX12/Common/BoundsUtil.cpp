@@ -0,0 +1,171 @@
+#include "BoundsUtil.h"
+#include <cfloat>
+
+using namespace DirectX;
+
+namespace
+{
+	inline XMVECTOR LoadPosition(const XMFLOAT3* positions, size_t stride, size_t i)
+	{
+		return XMLoadFloat3((const XMFLOAT3*)((const BYTE*)positions + i * stride));
+	}
+}
+
+BoundingBox BoundsUtil::ComputeBox(const XMFLOAT3* positions, size_t count, size_t stride)
+{
+	BoundingBox box;
+	if (count == 0)
+	{
+		box.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		box.Extents = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		return box;
+	}
+
+	XMVECTOR first = LoadPosition(positions, stride, 0);
+	XMVECTOR vMin[4] = { first, first, first, first };
+	XMVECTOR vMax[4] = { first, first, first, first };
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		for (int k = 0; k < 4; ++k)
+		{
+			XMVECTOR p = LoadPosition(positions, stride, i + k);
+			vMin[k] = XMVectorMin(vMin[k], p);
+			vMax[k] = XMVectorMax(vMax[k], p);
+		}
+	}
+
+	for (; i < count; ++i)
+	{
+		XMVECTOR p = LoadPosition(positions, stride, i);
+		vMin[0] = XMVectorMin(vMin[0], p);
+		vMax[0] = XMVectorMax(vMax[0], p);
+	}
+
+	XMVECTOR lo = XMVectorMin(XMVectorMin(vMin[0], vMin[1]), XMVectorMin(vMin[2], vMin[3]));
+	XMVECTOR hi = XMVectorMax(XMVectorMax(vMax[0], vMax[1]), XMVectorMax(vMax[2], vMax[3]));
+
+	XMStoreFloat3(&box.Center, 0.5f * (lo + hi));
+	XMStoreFloat3(&box.Extents, 0.5f * (hi - lo));
+	return box;
+}
+
+BoundingSphere BoundsUtil::ComputeSphere(const XMFLOAT3* positions, size_t count, size_t stride)
+{
+	BoundingSphere sphere;
+	if (count == 0)
+	{
+		sphere.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		sphere.Radius = 0.0f;
+		return sphere;
+	}
+
+	// Extreme points along each axis.
+	size_t minIndex[3] = { 0, 0, 0 };
+	size_t maxIndex[3] = { 0, 0, 0 };
+	for (size_t i = 1; i < count; ++i)
+	{
+		const float* p = (const float*)((const BYTE*)positions + i * stride);
+		for (int a = 0; a < 3; ++a)
+		{
+			const float* pMin = (const float*)((const BYTE*)positions + minIndex[a] * stride);
+			const float* pMax = (const float*)((const BYTE*)positions + maxIndex[a] * stride);
+			if (p[a] < pMin[a]) minIndex[a] = i;
+			if (p[a] > pMax[a]) maxIndex[a] = i;
+		}
+	}
+
+	// Start from the most distant pair.
+	XMVECTOR a = LoadPosition(positions, stride, minIndex[0]);
+	XMVECTOR b = LoadPosition(positions, stride, maxIndex[0]);
+	float bestDistSq = XMVectorGetX(XMVector3LengthSq(b - a));
+	for (int axis = 1; axis < 3; ++axis)
+	{
+		XMVECTOR p0 = LoadPosition(positions, stride, minIndex[axis]);
+		XMVECTOR p1 = LoadPosition(positions, stride, maxIndex[axis]);
+		float distSq = XMVectorGetX(XMVector3LengthSq(p1 - p0));
+		if (distSq > bestDistSq)
+		{
+			a = p0;
+			b = p1;
+			bestDistSq = distSq;
+		}
+	}
+
+	XMVECTOR center = 0.5f * (a + b);
+	float radius = 0.5f * sqrtf(bestDistSq);
+
+	// Grow the sphere to include every point outside it.
+	for (size_t i = 0; i < count; ++i)
+	{
+		XMVECTOR p = LoadPosition(positions, stride, i);
+		float distSq = XMVectorGetX(XMVector3LengthSq(p - center));
+		if (distSq > radius * radius)
+		{
+			float dist = sqrtf(distSq);
+			float newRadius = 0.5f * (radius + dist);
+			center += (p - center) * ((newRadius - radius) / dist);
+			radius = newRadius;
+		}
+	}
+
+	// The sphere around the box center is sometimes tighter, e.g. for boxes.
+	BoundingBox box = ComputeBox(positions, count, stride);
+	XMVECTOR boxCenter = XMLoadFloat3(&box.Center);
+	XMVECTOR maxDistSq = XMVectorZero();
+	for (size_t i = 0; i < count; ++i)
+		maxDistSq = XMVectorMax(maxDistSq, XMVector3LengthSq(LoadPosition(positions, stride, i) - boxCenter));
+
+	float boxRadius = sqrtf(XMVectorGetX(maxDistSq));
+	if (boxRadius < radius)
+	{
+		center = boxCenter;
+		radius = boxRadius;
+	}
+
+	XMStoreFloat3(&sphere.Center, center);
+	sphere.Radius = radius;
+	return sphere;
+}
+
+BoundingBox BoundsUtil::TransformBox(const BoundingBox& box, FXMMATRIX M)
+{
+	XMVECTOR center = XMLoadFloat3(&box.Center);
+	XMVECTOR extents = XMLoadFloat3(&box.Extents);
+
+	// New extents are |M| * extents, row by row of the upper 3x3.
+	XMVECTOR newExtents = XMVectorAbs(M.r[0]) * XMVectorSplatX(extents);
+	newExtents = XMVectorMultiplyAdd(XMVectorAbs(M.r[1]), XMVectorSplatY(extents), newExtents);
+	newExtents = XMVectorMultiplyAdd(XMVectorAbs(M.r[2]), XMVectorSplatZ(extents), newExtents);
+
+	BoundingBox result;
+	XMStoreFloat3(&result.Center, XMVector3TransformCoord(center, M));
+	XMStoreFloat3(&result.Extents, newExtents);
+	return result;
+}
+
+BoundingBox BoundsUtil::MergeBoxes(const BoundingBox* boxes, size_t count)
+{
+	BoundingBox result;
+	if (count == 0)
+	{
+		result.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		result.Extents = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		return result;
+	}
+
+	XMVECTOR lo = XMVectorReplicate(+FLT_MAX);
+	XMVECTOR hi = XMVectorReplicate(-FLT_MAX);
+	for (size_t i = 0; i < count; ++i)
+	{
+		XMVECTOR c = XMLoadFloat3(&boxes[i].Center);
+		XMVECTOR e = XMLoadFloat3(&boxes[i].Extents);
+		lo = XMVectorMin(lo, c - e);
+		hi = XMVectorMax(hi, c + e);
+	}
+
+	XMStoreFloat3(&result.Center, 0.5f * (lo + hi));
+	XMStoreFloat3(&result.Extents, 0.5f * (hi - lo));
+	return result;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <Windows.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+// Bounding volume helpers.
+//
+// Point lists are given as a pointer to the first position and a byte stride,
+// so vertex arrays of any layout can be passed without copying.
+class BoundsUtil
+{
+public:
+	// Tight axis aligned box.  Four independent min/max chains keep the SIMD
+	// units busy instead of waiting on one dependency chain.
+	static DirectX::BoundingBox ComputeBox(const DirectX::XMFLOAT3* positions, size_t count, size_t stride);
+
+	// Ritter's bounding sphere, or the sphere around the box center if that one
+	// happens to be smaller.
+	static DirectX::BoundingSphere ComputeSphere(const DirectX::XMFLOAT3* positions, size_t count, size_t stride);
+
+	// Axis aligned box of a box transformed by M (Arvo's method).
+	static DirectX::BoundingBox TransformBox(const DirectX::BoundingBox& box, DirectX::FXMMATRIX M);
+
+	// Union of count boxes.
+	static DirectX::BoundingBox MergeBoxes(const DirectX::BoundingBox* boxes, size_t count);
+};
@@ -0,0 +1,161 @@
+#include "CommandRecorder.h"
+
+void CommandRecorder::Begin(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* initialPso)
+{
+	mCmdList = cmdList;
+	mStats = Stats();
+	Invalidate();
+	mPso = initialPso;
+}
+
+void CommandRecorder::Invalidate()
+{
+	mPso = nullptr;
+	mRootSignature = nullptr;
+	InvalidateRootArgs();
+
+	mVertexBufferValid = false;
+	mIndexBufferValid = false;
+	mTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+}
+
+ID3D12GraphicsCommandList* CommandRecorder::CommandList()const
+{
+	return mCmdList;
+}
+
+const CommandRecorder::Stats& CommandRecorder::GetStats()const
+{
+	return mStats;
+}
+
+void CommandRecorder::SetPipelineState(ID3D12PipelineState* pso)
+{
+	if (pso == mPso)
+	{
+		++mStats.Elided;
+		return;
+	}
+
+	mPso = pso;
+	mCmdList->SetPipelineState(pso);
+	++mStats.Issued;
+}
+
+void CommandRecorder::SetGraphicsRootSignature(ID3D12RootSignature* rootSignature)
+{
+	if (rootSignature == mRootSignature)
+	{
+		++mStats.Elided;
+		return;
+	}
+
+	mRootSignature = rootSignature;
+	InvalidateRootArgs();
+	mCmdList->SetGraphicsRootSignature(rootSignature);
+	++mStats.Issued;
+}
+
+void CommandRecorder::SetGraphicsRootConstantBufferView(UINT slot, D3D12_GPU_VIRTUAL_ADDRESS address)
+{
+	if (UpdateRootArg(slot, RootArgType::Cbv, address, 0))
+		mCmdList->SetGraphicsRootConstantBufferView(slot, address);
+}
+
+void CommandRecorder::SetGraphicsRootShaderResourceView(UINT slot, D3D12_GPU_VIRTUAL_ADDRESS address)
+{
+	if (UpdateRootArg(slot, RootArgType::Srv, address, 0))
+		mCmdList->SetGraphicsRootShaderResourceView(slot, address);
+}
+
+void CommandRecorder::SetGraphicsRootDescriptorTable(UINT slot, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor)
+{
+	if (UpdateRootArg(slot, RootArgType::Table, baseDescriptor.ptr, 0))
+		mCmdList->SetGraphicsRootDescriptorTable(slot, baseDescriptor);
+}
+
+void CommandRecorder::SetGraphicsRoot32BitConstant(UINT slot, UINT value, UINT destOffset)
+{
+	// Only a repeat of the last constant written to the slot is dropped, so
+	// slots holding several constants stay correct.
+	if (UpdateRootArg(slot, RootArgType::Constant, value, destOffset))
+		mCmdList->SetGraphicsRoot32BitConstant(slot, value, destOffset);
+}
+
+void CommandRecorder::IASetVertexBuffer(const D3D12_VERTEX_BUFFER_VIEW& view)
+{
+	if (mVertexBufferValid &&
+		view.BufferLocation == mVertexBuffer.BufferLocation &&
+		view.SizeInBytes == mVertexBuffer.SizeInBytes &&
+		view.StrideInBytes == mVertexBuffer.StrideInBytes)
+	{
+		++mStats.Elided;
+		return;
+	}
+
+	mVertexBufferValid = true;
+	mVertexBuffer = view;
+	mCmdList->IASetVertexBuffers(0, 1, &view);
+	++mStats.Issued;
+}
+
+void CommandRecorder::IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW& view)
+{
+	if (mIndexBufferValid &&
+		view.BufferLocation == mIndexBuffer.BufferLocation &&
+		view.SizeInBytes == mIndexBuffer.SizeInBytes &&
+		view.Format == mIndexBuffer.Format)
+	{
+		++mStats.Elided;
+		return;
+	}
+
+	mIndexBufferValid = true;
+	mIndexBuffer = view;
+	mCmdList->IASetIndexBuffer(&view);
+	++mStats.Issued;
+}
+
+void CommandRecorder::IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology)
+{
+	if (topology == mTopology)
+	{
+		++mStats.Elided;
+		return;
+	}
+
+	mTopology = topology;
+	mCmdList->IASetPrimitiveTopology(topology);
+	++mStats.Issued;
+}
+
+void CommandRecorder::DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount,
+	UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation)
+{
+	mCmdList->DrawIndexedInstanced(indexCountPerInstance, instanceCount,
+		startIndexLocation, baseVertexLocation, startInstanceLocation);
+}
+
+bool CommandRecorder::UpdateRootArg(UINT slot, RootArgType type, UINT64 value, UINT offset)
+{
+	assert(slot < MaxRootParameters);
+
+	RootArg& arg = mRootArgs[slot];
+	if (arg.Type == type && arg.Value == value && arg.Offset == offset)
+	{
+		++mStats.Elided;
+		return false;
+	}
+
+	arg.Type = type;
+	arg.Value = value;
+	arg.Offset = offset;
+	++mStats.Issued;
+	return true;
+}
+
+void CommandRecorder::InvalidateRootArgs()
+{
+	for (auto& arg : mRootArgs)
+		arg = RootArg();
+}
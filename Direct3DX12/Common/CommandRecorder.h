@@ -0,0 +1,91 @@
+#pragma once
+
+#include "d3dUtil.h"
+
+// Thin wrapper over a graphics command list that remembers the state it has
+// bound and drops calls that would bind the same state again.
+//
+// Covers the pipeline state, the graphics root signature, root CBVs, SRVs,
+// descriptor tables and single 32-bit constants, the first vertex buffer
+// slot, the index buffer and the primitive topology.  Changing the root
+// signature forgets the root arguments, as D3D12 does.  Code that records
+// state on the command list directly must call Invalidate afterwards.
+class CommandRecorder
+{
+public:
+	static const UINT MaxRootParameters = 16;
+
+	struct Stats
+	{
+		UINT Issued = 0;
+		UINT Elided = 0;
+	};
+
+public:
+	CommandRecorder() = default;
+	CommandRecorder(const CommandRecorder& rhs) = delete;
+	CommandRecorder& operator=(const CommandRecorder& rhs) = delete;
+	~CommandRecorder() = default;
+
+	// Call after the command list is reset.  Clears the cached state and the
+	// stats; initialPso is the pipeline state the list was reset with.
+	void Begin(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* initialPso = nullptr);
+
+	// Forgets all cached state, so the next call of each kind is issued.
+	void Invalidate();
+
+	ID3D12GraphicsCommandList* CommandList()const;
+	const Stats& GetStats()const;
+
+	void SetPipelineState(ID3D12PipelineState* pso);
+	void SetGraphicsRootSignature(ID3D12RootSignature* rootSignature);
+
+	void SetGraphicsRootConstantBufferView(UINT slot, D3D12_GPU_VIRTUAL_ADDRESS address);
+	void SetGraphicsRootShaderResourceView(UINT slot, D3D12_GPU_VIRTUAL_ADDRESS address);
+	void SetGraphicsRootDescriptorTable(UINT slot, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor);
+	void SetGraphicsRoot32BitConstant(UINT slot, UINT value, UINT destOffset);
+
+	void IASetVertexBuffer(const D3D12_VERTEX_BUFFER_VIEW& view);
+	void IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW& view);
+	void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology);
+
+	void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount,
+		UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation);
+
+private:
+	enum class RootArgType
+	{
+		None,
+		Cbv,
+		Srv,
+		Table,
+		Constant,
+	};
+
+	struct RootArg
+	{
+		RootArgType Type = RootArgType::None;
+		UINT64 Value = 0;
+		UINT Offset = 0;
+	};
+
+	// Returns true and counts an issued call if slot does not already hold the argument.
+	bool UpdateRootArg(UINT slot, RootArgType type, UINT64 value, UINT offset);
+
+	void InvalidateRootArgs();
+
+private:
+	ID3D12GraphicsCommandList* mCmdList = nullptr;
+
+	ID3D12PipelineState* mPso = nullptr;
+	ID3D12RootSignature* mRootSignature = nullptr;
+	RootArg mRootArgs[MaxRootParameters];
+
+	bool mVertexBufferValid = false;
+	D3D12_VERTEX_BUFFER_VIEW mVertexBuffer = {};
+	bool mIndexBufferValid = false;
+	D3D12_INDEX_BUFFER_VIEW mIndexBuffer = {};
+	D3D12_PRIMITIVE_TOPOLOGY mTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+
+	Stats mStats;
+};
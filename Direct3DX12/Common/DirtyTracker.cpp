@@ -0,0 +1,109 @@
+#include "DirtyTracker.h"
+
+void DirtyTracker::Resize(UINT itemCount, UINT frameCount)
+{
+	mItemCount = itemCount;
+
+	mLists.clear();
+	mLists.resize(frameCount + 1);
+	for (auto& list : mLists)
+	{
+		list.Items.reserve(itemCount);
+		list.Listed.assign(itemCount, 0);
+	}
+
+	MarkAllDirty();
+}
+
+UINT DirtyTracker::Size()const
+{
+	return mItemCount;
+}
+
+void DirtyTracker::Grow(UINT itemCount)
+{
+	assert(itemCount >= mItemCount);
+
+	UINT oldCount = mItemCount;
+	mItemCount = itemCount;
+	for (auto& list : mLists)
+	{
+		list.Listed.resize(itemCount, 0);
+		for (UINT i = oldCount; i < itemCount; ++i)
+			Push(list, i);
+	}
+}
+
+void DirtyTracker::MarkDirty(UINT index)
+{
+	assert(index < mItemCount);
+
+	for (auto& list : mLists)
+		Push(list, index);
+}
+
+void DirtyTracker::MarkAllDirty()
+{
+	for (auto& list : mLists)
+		ListAll(list, mItemCount);
+}
+
+void DirtyTracker::MarkAllPending(UINT frame)
+{
+	assert(frame + 1 < mLists.size());
+
+	ListAll(mLists[frame], mItemCount);
+}
+
+const std::vector<UINT>& DirtyTracker::Pending(UINT frame)const
+{
+	assert(frame + 1 < mLists.size());
+	return mLists[frame].Items;
+}
+
+void DirtyTracker::ClearPending(UINT frame)
+{
+	assert(frame + 1 < mLists.size());
+	Clear(mLists[frame]);
+}
+
+void DirtyTracker::SortPending(UINT frame)
+{
+	assert(frame + 1 < mLists.size());
+	std::sort(mLists[frame].Items.begin(), mLists[frame].Items.end());
+}
+
+const std::vector<UINT>& DirtyTracker::Changed()const
+{
+	return mLists.back().Items;
+}
+
+void DirtyTracker::ClearChanged()
+{
+	Clear(mLists.back());
+}
+
+void DirtyTracker::Push(DirtyList& list, UINT index)
+{
+	if (list.Listed[index])
+		return;
+
+	list.Listed[index] = 1;
+	list.Items.push_back(index);
+}
+
+void DirtyTracker::ListAll(DirtyList& list, UINT itemCount)
+{
+	list.Items.resize(itemCount);
+	for (UINT i = 0; i < itemCount; ++i)
+		list.Items[i] = i;
+	std::fill(list.Listed.begin(), list.Listed.end(), (std::uint8_t)1);
+}
+
+void DirtyTracker::Clear(DirtyList& list)
+{
+	// Only the listed flags are reset, so clearing is as cheap as the list is short.
+	for (UINT index : list.Items)
+		list.Listed[index] = 0;
+	list.Items.clear();
+}
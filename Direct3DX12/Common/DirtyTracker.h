@@ -0,0 +1,71 @@
+#pragma once
+
+#include <Windows.h>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+// Records which items changed so per-frame updates only touch those.
+//
+// Items are addressed by a dense index.  Every frame resource owns a list of
+// the items changed since it was last updated, plus a flag per item so an
+// item is listed at most once.  A change is pushed onto all of them, and a
+// frame resource drains its own list when it becomes current, so an update
+// costs time proportional to the number of changed items only.
+//
+// A separate list collects changes since the last ClearChanged, for work that
+// happens once per change rather than once per frame resource, such as
+// recomputing bounds.
+class DirtyTracker
+{
+public:
+	DirtyTracker() = default;
+	DirtyTracker(const DirtyTracker& rhs) = delete;
+	DirtyTracker& operator=(const DirtyTracker& rhs) = delete;
+	~DirtyTracker() = default;
+
+	// Every item starts out dirty in every list.
+	void Resize(UINT itemCount, UINT frameCount);
+	UINT Size()const;
+
+	// Adds items [Size(), itemCount), dirty in every list.  Items already
+	// listed stay listed.
+	void Grow(UINT itemCount);
+
+	void MarkDirty(UINT index);
+	void MarkAllDirty();
+
+	// Lists every item for frame resource frame only, e.g. after its buffer
+	// was replaced by an empty one.
+	void MarkAllPending(UINT frame);
+
+	// Items changed since frame resource frame was last cleared, each listed once.
+	const std::vector<UINT>& Pending(UINT frame)const;
+	void ClearPending(UINT frame);
+
+	// Sorts the pending list by index so writes to a buffer indexed the same
+	// way land in address order.
+	void SortPending(UINT frame);
+
+	// Items changed since the last ClearChanged, each listed once.
+	const std::vector<UINT>& Changed()const;
+	void ClearChanged();
+
+private:
+	struct DirtyList
+	{
+		std::vector<UINT> Items;
+		std::vector<std::uint8_t> Listed;
+	};
+
+	static void Push(DirtyList& list, UINT index);
+	static void ListAll(DirtyList& list, UINT itemCount);
+	static void Clear(DirtyList& list);
+
+private:
+	UINT mItemCount = 0;
+
+	// One list per frame resource followed by the changed list.
+	std::vector<DirtyList> mLists;
+};
@@ -0,0 +1,124 @@
+#include "FrustumCuller.h"
+
+using namespace DirectX;
+
+void FrustumCuller::Resize(UINT count)
+{
+	mCount = count;
+
+	// One spare batch past the end lets CullRange load four boxes from any slot.
+	UINT padded = ((count + 3) & ~3) + 4;
+	mCenterX.resize(padded, 0.0f);
+	mCenterY.resize(padded, 0.0f);
+	mCenterZ.resize(padded, 0.0f);
+	mExtentX.resize(padded, 0.0f);
+	mExtentY.resize(padded, 0.0f);
+	mExtentZ.resize(padded, 0.0f);
+}
+
+UINT FrustumCuller::Size()const
+{
+	return mCount;
+}
+
+void FrustumCuller::SetBox(UINT index, const BoundingBox& box)
+{
+	assert(index < mCount);
+
+	mCenterX[index] = box.Center.x;
+	mCenterY[index] = box.Center.y;
+	mCenterZ[index] = box.Center.z;
+	mExtentX[index] = box.Extents.x;
+	mExtentY[index] = box.Extents.y;
+	mExtentZ[index] = box.Extents.z;
+}
+
+void FrustumCuller::ExtractPlanes(FXMMATRIX viewProj, XMFLOAT4 planes[6])
+{
+	// With row vectors clip = p * M, so clip.x is p dotted with column 0 of M.
+	XMMATRIX T = XMMatrixTranspose(viewProj);
+
+	XMStoreFloat4(&planes[0], T.r[3] + T.r[0]); // left:   -w <= x
+	XMStoreFloat4(&planes[1], T.r[3] - T.r[0]); // right:   x <= w
+	XMStoreFloat4(&planes[2], T.r[3] + T.r[1]); // bottom: -w <= y
+	XMStoreFloat4(&planes[3], T.r[3] - T.r[1]); // top:     y <= w
+	XMStoreFloat4(&planes[4], T.r[2]);          // near:    0 <= z
+	XMStoreFloat4(&planes[5], T.r[3] - T.r[2]); // far:     z <= w
+}
+
+void FrustumCuller::SplatPlanes(const XMFLOAT4 planes[6], PlaneSet& set)
+{
+	for (int p = 0; p < 6; ++p)
+	{
+		XMVECTOR plane = XMLoadFloat4(&planes[p]);
+		set.Nx[p] = XMVectorSplatX(plane);
+		set.Ny[p] = XMVectorSplatY(plane);
+		set.Nz[p] = XMVectorSplatZ(plane);
+		set.D[p] = XMVectorSplatW(plane);
+		set.Ax[p] = XMVectorAbs(set.Nx[p]);
+		set.Ay[p] = XMVectorAbs(set.Ny[p]);
+		set.Az[p] = XMVectorAbs(set.Nz[p]);
+	}
+}
+
+XMVECTOR FrustumCuller::OutsideMask(const PlaneSet& set, UINT first)const
+{
+	XMVECTOR cx = XMLoadFloat4((const XMFLOAT4*)&mCenterX[first]);
+	XMVECTOR cy = XMLoadFloat4((const XMFLOAT4*)&mCenterY[first]);
+	XMVECTOR cz = XMLoadFloat4((const XMFLOAT4*)&mCenterZ[first]);
+	XMVECTOR ex = XMLoadFloat4((const XMFLOAT4*)&mExtentX[first]);
+	XMVECTOR ey = XMLoadFloat4((const XMFLOAT4*)&mExtentY[first]);
+	XMVECTOR ez = XMLoadFloat4((const XMFLOAT4*)&mExtentZ[first]);
+
+	// A box is outside if it lies entirely behind any one plane: the signed
+	// distance of its center plus its projected radius is negative.
+	XMVECTOR outside = XMVectorFalseInt();
+	for (int p = 0; p < 6; ++p)
+	{
+		XMVECTOR dist = XMVectorMultiplyAdd(cx, set.Nx[p], XMVectorMultiplyAdd(cy, set.Ny[p], XMVectorMultiplyAdd(cz, set.Nz[p], set.D[p])));
+		XMVECTOR radius = XMVectorMultiplyAdd(ex, set.Ax[p], XMVectorMultiplyAdd(ey, set.Ay[p], ez * set.Az[p]));
+		outside = XMVectorOrInt(outside, XMVectorLess(dist + radius, XMVectorZero()));
+	}
+
+	return outside;
+}
+
+UINT FrustumCuller::CullRange(const PlaneSet& set, UINT first, UINT count)const
+{
+	assert(count <= 4 && first + count <= mCount);
+
+	std::uint32_t mask[4];
+	XMStoreInt4(mask, OutsideMask(set, first));
+
+	UINT visible = 0;
+	for (UINT k = 0; k < count; ++k)
+	{
+		if (mask[k] == 0)
+			visible |= 1u << k;
+	}
+
+	return visible;
+}
+
+UINT FrustumCuller::Cull(const XMFLOAT4 planes[6], std::uint8_t* visible)const
+{
+	// Splat every plane once, outside the loop.
+	PlaneSet set;
+	SplatPlanes(planes, set);
+
+	UINT visibleCount = 0;
+	for (UINT i = 0; i < mCount; i += 4)
+	{
+		std::uint32_t mask[4];
+		XMStoreInt4(mask, OutsideMask(set, i));
+
+		UINT n = mCount - i < 4 ? mCount - i : 4;
+		for (UINT k = 0; k < n; ++k)
+		{
+			visible[i + k] = mask[k] == 0 ? 1 : 0;
+			visibleCount += visible[i + k];
+		}
+	}
+
+	return visibleCount;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Windows.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+// Batched box vs. frustum culling.
+//
+// Boxes are kept as structure of arrays (center x/y/z, extents x/y/z), padded
+// to a multiple of four, so each plane test handles four boxes with one set of
+// SIMD instructions.  Slots are addressed by a caller chosen index and only
+// need to be rewritten when the box moves.  SceneBvh keeps one slot per leaf
+// entry and tests each leaf (at most four objects) with CullRange().
+class FrustumCuller
+{
+public:
+	// Planes splatted across lanes once, so they can be reused for many batches.
+	struct PlaneSet
+	{
+		DirectX::XMVECTOR Nx[6];
+		DirectX::XMVECTOR Ny[6];
+		DirectX::XMVECTOR Nz[6];
+		DirectX::XMVECTOR D[6];
+		DirectX::XMVECTOR Ax[6];
+		DirectX::XMVECTOR Ay[6];
+		DirectX::XMVECTOR Az[6];
+	};
+
+	FrustumCuller() = default;
+	FrustumCuller(const FrustumCuller& rhs) = delete;
+	FrustumCuller& operator=(const FrustumCuller& rhs) = delete;
+	~FrustumCuller() = default;
+
+	void Resize(UINT count);
+	UINT Size()const;
+
+	void SetBox(UINT index, const DirectX::BoundingBox& box);
+
+	// Six planes (left, right, bottom, top, near, far) of the clip volume of a
+	// view * projection matrix, pointing inward.  Works in whatever space the
+	// matrix maps from, so pass View * Proj for world space boxes.
+	static void ExtractPlanes(DirectX::FXMMATRIX viewProj, DirectX::XMFLOAT4 planes[6]);
+
+	static void SplatPlanes(const DirectX::XMFLOAT4 planes[6], PlaneSet& set);
+
+	// Sets visible[i] to 1 if box i may intersect the volume and 0 otherwise.
+	// Returns the number of visible boxes.
+	UINT Cull(const DirectX::XMFLOAT4 planes[6], std::uint8_t* visible)const;
+
+	// Tests the count <= 4 boxes starting at slot first, which need not be a
+	// multiple of four.  Bit k of the result is set if box first + k may be visible.
+	UINT CullRange(const PlaneSet& set, UINT first, UINT count)const;
+
+private:
+	// Returns a mask that is set in the lanes of boxes outside the volume.
+	DirectX::XMVECTOR OutsideMask(const PlaneSet& set, UINT first)const;
+
+	UINT mCount = 0;
+
+	std::vector<float> mCenterX;
+	std::vector<float> mCenterY;
+	std::vector<float> mCenterZ;
+	std::vector<float> mExtentX;
+	std::vector<float> mExtentY;
+	std::vector<float> mExtentZ;
+};
@@ -5,6 +5,7 @@
 #include "GeometryGenerator.h"
 #include <algorithm>
 #include <fstream>
+#include <ppl.h>
 
 using namespace DirectX;
 
@@ -576,8 +577,8 @@ GeometryGenerator::MeshData GeometryGenerator::GeometryGenerator::CreateSkull()
 	{
 		fin >> meshData.Vertices[i].Position.x >> meshData.Vertices[i].Position.y >> meshData.Vertices[i].Position.z;
 		fin >> meshData.Vertices[i].Normal.x >> meshData.Vertices[i].Normal.y >> meshData.Vertices[i].Normal.z;
-		//meshData.Vertices[i].TexC.x = 0;
-		//meshData.Vertices[i].TexC.y = 0; 
+		meshData.Vertices[i].TexC.x = 0;
+		meshData.Vertices[i].TexC.y = 0; 
 	}
 
 	fin >> ignore;
@@ -592,10 +593,136 @@ GeometryGenerator::MeshData GeometryGenerator::GeometryGenerator::CreateSkull()
 
 	fin.close();
 
+	// 파일에는 탄젠트도 UV도 없습니다. 법선에 수직인 기저라도 채워서
+	// 셰이더가 항상 유효한 탄젠트를 받도록 합니다.
+	GenerateTangents(meshData);
+
 	return meshData;
 
 }
 
+bool GeometryGenerator::GenerateTangents(MeshData& meshData)
+{
+	const uint32 numVertices = (uint32)meshData.Vertices.size();
+	const uint32 numTris = (uint32)meshData.Indices32.size() / 3;
+
+	if (numVertices == 0)
+		return false;
+
+	// 스레드마다 자신만의 누적 버퍼를 가지므로 삼각형을 처리할 때 잠금이 필요 없습니다.
+	struct Accumulator
+	{
+		std::vector<XMFLOAT3> Tangent;
+		std::vector<XMFLOAT3> Bitangent;
+		uint32 ValidTris = 0;
+	};
+	concurrency::combinable<Accumulator> accumulators;
+
+	const uint32 trisPerTask = 4096;
+	const uint32 numTasks = (numTris + trisPerTask - 1) / trisPerTask;
+
+	concurrency::parallel_for(0u, numTasks, [&](uint32 task)
+	{
+		Accumulator& acc = accumulators.local();
+		if (acc.Tangent.empty())
+		{
+			acc.Tangent.assign(numVertices, XMFLOAT3(0.0f, 0.0f, 0.0f));
+			acc.Bitangent.assign(numVertices, XMFLOAT3(0.0f, 0.0f, 0.0f));
+		}
+
+		const uint32 first = task * trisPerTask;
+		const uint32 last = std::min<uint32>(first + trisPerTask, numTris);
+
+		for (uint32 t = first; t < last; ++t)
+		{
+			uint32 index[3];
+			XMVECTOR p[3];
+			XMFLOAT2 uv[3];
+			for (int c = 0; c < 3; ++c)
+			{
+				index[c] = meshData.Indices32[t * 3 + c];
+				p[c] = XMLoadFloat3(&meshData.Vertices[index[c]].Position);
+				uv[c] = meshData.Vertices[index[c]].TexC;
+			}
+
+			XMVECTOR e1 = p[1] - p[0];
+			XMVECTOR e2 = p[2] - p[0];
+
+			float du1 = uv[1].x - uv[0].x;
+			float dv1 = uv[1].y - uv[0].y;
+			float du2 = uv[2].x - uv[0].x;
+			float dv2 = uv[2].y - uv[0].y;
+
+			// 텍스처 좌표가 퇴화된 삼각형은 탄젠트를 정의할 수 없습니다.
+			float det = du1 * dv2 - du2 * dv1;
+			if (fabsf(det) < 1e-12f)
+				continue;
+
+			++acc.ValidTris;
+			float r = 1.0f / det;
+			XMVECTOR faceT = (e1 * dv2 - e2 * dv1) * r;
+			XMVECTOR faceB = (e2 * du1 - e1 * du2) * r;
+
+			for (int c = 0; c < 3; ++c)
+			{
+				// 각 꼭짓점의 기여도는 그 꼭짓점의 내각에 비례합니다.
+				XMVECTOR a = XMVector3Normalize(p[(c + 1) % 3] - p[c]);
+				XMVECTOR b = XMVector3Normalize(p[(c + 2) % 3] - p[c]);
+				XMVECTOR angle = XMVector3AngleBetweenNormals(a, b);
+
+				// 면 탄젠트를 버텍스 법선의 평면에 투영합니다.
+				XMVECTOR n = XMLoadFloat3(&meshData.Vertices[index[c]].Normal);
+				XMVECTOR ct = XMVector3Normalize(faceT - n * XMVector3Dot(n, faceT));
+				XMVECTOR cb = XMVector3Normalize(faceB - n * XMVector3Dot(n, faceB));
+
+				XMFLOAT3& accT = acc.Tangent[index[c]];
+				XMFLOAT3& accB = acc.Bitangent[index[c]];
+				XMStoreFloat3(&accT, XMLoadFloat3(&accT) + ct * angle);
+				XMStoreFloat3(&accB, XMLoadFloat3(&accB) + cb * angle);
+			}
+		}
+	});
+
+	std::vector<const Accumulator*> locals;
+	uint32 validTris = 0;
+	accumulators.combine_each([&](const Accumulator& acc)
+	{
+		if (!acc.Tangent.empty())
+			locals.push_back(&acc);
+		validTris += acc.ValidTris;
+	});
+
+	// 스레드별 결과를 합친 뒤 법선에 대해 직교화하고 방향성을 구합니다.
+	// UV가 전혀 없는 메쉬는 모든 꼭짓점이 아래의 임의 기저를 사용합니다.
+	concurrency::parallel_for(0u, numVertices, [&](uint32 i)
+	{
+		XMVECTOR t = XMVectorZero();
+		XMVECTOR b = XMVectorZero();
+		for (const Accumulator* acc : locals)
+		{
+			t += XMLoadFloat3(&acc->Tangent[i]);
+			b += XMLoadFloat3(&acc->Bitangent[i]);
+		}
+
+		Vertex& v = meshData.Vertices[i];
+		XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&v.Normal));
+
+		t -= n * XMVector3Dot(n, t);
+		if (XMVectorGetX(XMVector3LengthSq(t)) < 1e-12f)
+		{
+			// 주변에 쓸 수 있는 UV가 없으면 법선에 수직인 아무 방향이나 사용합니다.
+			XMVECTOR axis = fabsf(v.Normal.x) < 0.9f ? XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+			t = axis - n * XMVector3Dot(n, axis);
+		}
+		t = XMVector3Normalize(t);
+
+		XMStoreFloat3(&v.TangentU, t);
+		v.TangentW = XMVectorGetX(XMVector3Dot(XMVector3Cross(n, t), b)) < 0.0f ? -1.0f : 1.0f;
+	});
+
+	return validTris != 0;
+}
+
 void GeometryGenerator::Subdivide(MeshData& meshData)
 {
 	// 입력된 지오메트리를 저장합니다.
@@ -46,6 +46,10 @@ public:
         DirectX::XMFLOAT3 Position;
         DirectX::XMFLOAT3 Normal;
         DirectX::XMFLOAT3 TangentU;
+
+        // 탄젠트 프레임의 방향성입니다. UV가 뒤집힌 곳에서는 -1이 됩니다.
+        float TangentW = 1.0f;
+
         DirectX::XMFLOAT2 TexC;
     };
 
@@ -107,6 +111,16 @@ public:
 
     MeshData CreateSkull(); 
 
+    ///<summary>
+    /// Computes TangentU and TangentW for every vertex from positions, normals and
+    /// texture coordinates.  Each corner contributes its face tangent projected onto
+    /// the vertex normal and weighted by the corner angle, as MikkTSpace does.
+    /// Triangles are processed in parallel with per-thread accumulation buffers.
+    /// Meshes without usable UVs get an arbitrary basis perpendicular to each
+    /// normal; the function then returns false.
+    ///</summary>
+    bool GenerateTangents(MeshData& meshData);
+
 private:
     void Subdivide(MeshData& meshData);
     Vertex MidPoint(const Vertex& v0, const Vertex& v1);
@@ -0,0 +1,162 @@
+﻿#pragma once
+
+#include "d3dUtil.h"
+#include <algorithm>
+#include <deque>
+
+// 원소 수가 실행 중에 바뀌는 업로드 버퍼이다.
+// 모자라면 용량을 두 배씩 늘리고, 한동안 계속 적게 쓰면 줄입니다. 새 버퍼는 비어 있으므로
+// 버퍼가 바뀌면 호출하는 쪽이 쓰는 원소들을 모두 다시 써야 한다. 업로드 힙은 쓰기 결합 메모리라서
+// 기존 버퍼에서 읽어 복사하면 매우 느리다.
+// 교체된 버퍼는 마지막으로 사용한 펜스 지점을 GPU가 지날 때까지 보관했다가 해제한다.
+template<typename T>
+class GrowableUploadBuffer
+{
+public:
+    // 용량이 이 비율 아래로 쓰이는 프레임이 ShrinkFrameCount번 이어지면 줄인다.
+    static const UINT ShrinkUsageDivisor = 4;
+    static const UINT ShrinkFrameCount = 120;
+
+    GrowableUploadBuffer(ID3D12Device* device, UINT elementCount, bool isConstantBuffer)
+        : mDevice(device)
+    {
+        mElementByteSize = sizeof(T);
+
+        // 상수 버퍼 엘리먼트들은 256 바이트의 배수가 되어야 한다. (UploadBuffer 참고)
+        if (isConstantBuffer)
+            mElementByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(T));
+
+        mMinCapacity = std::max<UINT>(elementCount, 1);
+        mCapacity = mMinCapacity;
+        CreateBuffer(mCapacity, mUploadBuffer, mMappedData);
+    }
+
+    GrowableUploadBuffer(const GrowableUploadBuffer& rhs) = delete;
+    GrowableUploadBuffer& operator=(const GrowableUploadBuffer& rhs) = delete;
+
+    ~GrowableUploadBuffer()
+    {
+        if (mUploadBuffer != nullptr)
+            mUploadBuffer->Unmap(0, nullptr);
+
+        for (auto& retired : mRetired)
+            retired.Buffer->Unmap(0, nullptr);
+
+        mMappedData = nullptr;
+    }
+
+    // 버퍼가 바뀔 수 있으므로 GPU 주소는 매 프레임 Resource()에서 다시 얻어야 한다.
+    ID3D12Resource* Resource() const
+    {
+        return mUploadBuffer.Get();
+    }
+
+    void CopyData(int elementIndex, const T& data)
+    {
+        assert((UINT)elementIndex < mCapacity);
+        memcpy(&mMappedData[elementIndex * mElementByteSize], &data, sizeof(T));
+    }
+
+    BYTE* MappedData() const
+    {
+        return mMappedData;
+    }
+
+    UINT ElementByteSize() const
+    {
+        return mElementByteSize;
+    }
+
+    UINT Capacity() const
+    {
+        return mCapacity;
+    }
+
+    // 이번 프레임에 elementCount개의 원소를 쓸 수 있게 한다. 버퍼를 쓰기 전에 매 프레임 호출한다.
+    // lastUsedFence는 현재 버퍼를 마지막으로 읽는 커맨드들의 펜스 값이다.
+    // 버퍼가 바뀌면 true를 돌려준다. 이때 인덱스 [0, elementCount)의 원소를 모두 다시 써야 한다.
+    bool Resize(UINT elementCount, UINT64 lastUsedFence)
+    {
+        if (elementCount > mCapacity)
+        {
+            // 기하급수적으로 늘려서 재할당 비용을 원소 하나당 상수 시간으로 분할 상환한다.
+            mLowUsageFrames = 0;
+            Reallocate(std::max<UINT>(elementCount, 2 * mCapacity), lastUsedFence);
+            return true;
+        }
+
+        if (mCapacity > mMinCapacity && elementCount < mCapacity / ShrinkUsageDivisor)
+        {
+            if (++mLowUsageFrames >= ShrinkFrameCount)
+            {
+                // 줄인 뒤에도 두 배의 여유를 둬서 늘리고 줄이기를 반복하지 않게 한다.
+                mLowUsageFrames = 0;
+                Reallocate(std::max<UINT>(2 * elementCount, mMinCapacity), lastUsedFence);
+                return true;
+            }
+        }
+        else
+        {
+            mLowUsageFrames = 0;
+        }
+
+        return false;
+    }
+
+    // GPU가 completedFence까지 처리했으면 그 전에 교체된 버퍼들을 해제한다.
+    void ReleaseRetired(UINT64 completedFence)
+    {
+        while (!mRetired.empty() && mRetired.front().Fence <= completedFence)
+        {
+            mRetired.front().Buffer->Unmap(0, nullptr);
+            mRetired.pop_front();
+        }
+    }
+
+private:
+    struct RetiredBuffer
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+        UINT64 Fence;
+    };
+
+    void CreateBuffer(UINT capacity, Microsoft::WRL::ComPtr<ID3D12Resource>& buffer, BYTE*& mappedData)
+    {
+        ThrowIfFailed(mDevice->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+            D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer((UINT64)mElementByteSize * capacity),
+            D3D12_RESOURCE_STATE_GENERIC_READ,
+            nullptr,
+            IID_PPV_ARGS(&buffer)));
+
+        ThrowIfFailed(buffer->Map(0, nullptr, reinterpret_cast<void**>(&mappedData)));
+    }
+
+    void Reallocate(UINT capacity, UINT64 lastUsedFence)
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> buffer;
+        BYTE* mappedData = nullptr;
+        CreateBuffer(capacity, buffer, mappedData);
+
+        mRetired.push_back({ mUploadBuffer, lastUsedFence });
+
+        mUploadBuffer = buffer;
+        mMappedData = mappedData;
+        mCapacity = capacity;
+    }
+
+private:
+    ID3D12Device* mDevice = nullptr;
+
+    Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
+    BYTE* mMappedData = nullptr;
+
+    // 교체됐지만 GPU가 아직 읽고 있을 수 있는 버퍼들. 오래된 것부터 담는다.
+    std::deque<RetiredBuffer> mRetired;
+
+    UINT mElementByteSize = 0;
+    UINT mCapacity = 0;
+    UINT mMinCapacity = 0;
+    UINT mLowUsageFrames = 0;
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <Windows.h>
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Reference to an entry of a HandleRegistry<T>.  The generation tells a
+// handle to a removed entry apart from one to whatever reused its slot.
+template<typename T>
+struct Handle
+{
+	static const UINT InvalidIndex = ~0u;
+
+	UINT Index = InvalidIndex;
+	UINT Generation = 0;
+
+	bool IsValid()const { return Index != InvalidIndex; }
+
+	bool operator==(const Handle& rhs)const { return Index == rhs.Index && Generation == rhs.Generation; }
+	bool operator!=(const Handle& rhs)const { return !(*this == rhs); }
+};
+
+// Named resources kept in dense arrays and addressed by generational handles.
+//
+// Names are only for build time: Add, Find and operator[] hash the name, and
+// the handles they return are meant to be stored.  Get goes straight to the
+// slot, so code that runs every frame does no string hashing or map probing.
+// Removing an entry bumps its slot's generation and puts the slot on a free
+// list, and Get asserts that a handle is still alive.
+template<typename T>
+class HandleRegistry
+{
+public:
+	HandleRegistry() = default;
+	HandleRegistry(const HandleRegistry& rhs) = delete;
+	HandleRegistry& operator=(const HandleRegistry& rhs) = delete;
+	~HandleRegistry() = default;
+
+	// Stores value under name, replacing an existing entry with the same name
+	// in place so that its handle stays valid.
+	Handle<T> Add(const std::string& name, T value)
+	{
+		auto it = mIndices.find(name);
+		if (it != mIndices.end())
+		{
+			mItems[it->second] = std::move(value);
+			return MakeHandle(it->second);
+		}
+
+		UINT index;
+		if (!mFreeList.empty())
+		{
+			index = mFreeList.back();
+			mFreeList.pop_back();
+			mItems[index] = std::move(value);
+			mNames[index] = name;
+			mAlive[index] = 1;
+		}
+		else
+		{
+			index = (UINT)mItems.size();
+			mItems.push_back(std::move(value));
+			mNames.push_back(name);
+			mGenerations.push_back(0);
+			mAlive.push_back(1);
+		}
+
+		mIndices[name] = index;
+		++mCount;
+		return MakeHandle(index);
+	}
+
+	// Returns an invalid handle if there is no entry with this name.
+	Handle<T> Find(const std::string& name)const
+	{
+		auto it = mIndices.find(name);
+		return it != mIndices.end() ? MakeHandle(it->second) : Handle<T>();
+	}
+
+	// Like std::unordered_map: inserts a default value if the name is new.
+	// For build-time code only.
+	T& operator[](const std::string& name)
+	{
+		Handle<T> handle = Find(name);
+		if (!handle.IsValid())
+			handle = Add(name, T());
+		return mItems[handle.Index];
+	}
+
+	void Remove(Handle<T> handle)
+	{
+		assert(IsAlive(handle));
+
+		mIndices.erase(mNames[handle.Index]);
+		mItems[handle.Index] = T();
+		mNames[handle.Index].clear();
+		mAlive[handle.Index] = 0;
+		++mGenerations[handle.Index];
+		mFreeList.push_back(handle.Index);
+		--mCount;
+	}
+
+	bool IsAlive(Handle<T> handle)const
+	{
+		return handle.Index < mItems.size() && mAlive[handle.Index] &&
+			mGenerations[handle.Index] == handle.Generation;
+	}
+
+	T& Get(Handle<T> handle)
+	{
+		assert(IsAlive(handle));
+		return mItems[handle.Index];
+	}
+
+	const T& Get(Handle<T> handle)const
+	{
+		assert(IsAlive(handle));
+		return mItems[handle.Index];
+	}
+
+	// Number of live entries.
+	UINT Size()const
+	{
+		return mCount;
+	}
+
+	// Calls fn(value) for every live entry in slot order.
+	template<typename Fn>
+	void ForEach(Fn fn)
+	{
+		for (size_t i = 0; i < mItems.size(); ++i)
+		{
+			if (mAlive[i])
+				fn(mItems[i]);
+		}
+	}
+
+private:
+	Handle<T> MakeHandle(UINT index)const
+	{
+		Handle<T> handle;
+		handle.Index = index;
+		handle.Generation = mGenerations[index];
+		return handle;
+	}
+
+private:
+	std::vector<T> mItems;
+	std::vector<std::string> mNames;
+	std::vector<UINT> mGenerations;
+	std::vector<std::uint8_t> mAlive;
+	std::vector<UINT> mFreeList;
+	std::unordered_map<std::string, UINT> mIndices;
+	UINT mCount = 0;
+};
@@ -0,0 +1,61 @@
+#include "InstanceBatcher.h"
+#include <algorithm>
+
+void InstanceBatcher::Build(const std::uint64_t* keys, UINT count, bool keepOrder)
+{
+	mOrder.clear();
+	mBatches.clear();
+
+	if (keepOrder)
+	{
+		for (UINT i = 0; i < count; ++i)
+		{
+			if (i == 0 || keys[i] != keys[i - 1])
+				mBatches.push_back({ i, 0 });
+			mOrder.push_back(i);
+			++mBatches.back().Count;
+		}
+		return;
+	}
+
+	// A stable sort keeps each run in input order, so its first entry is the
+	// position of the batch's first item.
+	mSorted.resize(count);
+	for (UINT i = 0; i < count; ++i)
+		mSorted[i] = i;
+	std::stable_sort(mSorted.begin(), mSorted.end(),
+		[keys](UINT a, UINT b) { return keys[a] < keys[b]; });
+
+	mRuns.clear();
+	for (UINT i = 0; i < count; ++i)
+	{
+		if (i == 0 || keys[mSorted[i]] != keys[mSorted[i - 1]])
+			mRuns.push_back({ i, 0 });
+		++mRuns.back().Count;
+	}
+
+	std::sort(mRuns.begin(), mRuns.end(),
+		[this](const Batch& a, const Batch& b) { return mSorted[a.First] < mSorted[b.First]; });
+
+	for (const Batch& run : mRuns)
+	{
+		mBatches.push_back({ (UINT)mOrder.size(), run.Count });
+		mOrder.insert(mOrder.end(), mSorted.begin() + run.First, mSorted.begin() + run.First + run.Count);
+	}
+}
+
+UINT InstanceBatcher::BatchCount()const
+{
+	return (UINT)mBatches.size();
+}
+
+const InstanceBatcher::Batch& InstanceBatcher::GetBatch(UINT index)const
+{
+	assert(index < mBatches.size());
+	return mBatches[index];
+}
+
+const std::vector<UINT>& InstanceBatcher::Order()const
+{
+	return mOrder;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Windows.h>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+// Groups the items of a draw list that can share one instanced draw.
+//
+// Each item carries a 64-bit batch key, equal for items that use the same
+// geometry, submesh and material.  Build reorders the item positions so that
+// every batch is a contiguous run of Order(), which is the layout the
+// per-instance data is written in.
+//
+// With keepOrder, only neighbouring items with equal keys are merged, so the
+// draw order is unchanged; blended layers need that.  Otherwise all items
+// with equal keys are merged and batches are drawn in the order of their
+// first item, which keeps a front-to-back list roughly front to back.
+class InstanceBatcher
+{
+public:
+	struct Batch
+	{
+		// Run of Order() holding the batch's items.
+		UINT First = 0;
+		UINT Count = 0;
+	};
+
+public:
+	InstanceBatcher() = default;
+	InstanceBatcher(const InstanceBatcher& rhs) = delete;
+	InstanceBatcher& operator=(const InstanceBatcher& rhs) = delete;
+	~InstanceBatcher() = default;
+
+	void Build(const std::uint64_t* keys, UINT count, bool keepOrder);
+
+	UINT BatchCount()const;
+	const Batch& GetBatch(UINT index)const;
+
+	// Item positions in the input, grouped by batch.
+	const std::vector<UINT>& Order()const;
+
+private:
+	std::vector<UINT> mOrder;
+	std::vector<Batch> mBatches;
+
+	// Scratch for the unordered build, kept to avoid reallocating every list.
+	std::vector<UINT> mSorted;
+	std::vector<Batch> mRuns;
+};
@@ -78,6 +78,59 @@ public:
 		return DirectX::XMMatrixTranspose(DirectX::XMMatrixInverse(&det, A));
 	}
 
+	// Inverse of a rotation followed by a translation, such as a view matrix.
+	// The rotation must be orthonormal: its inverse is its transpose, and the
+	// translation becomes -t * R^T.
+	static DirectX::XMMATRIX InverseRigid(DirectX::CXMMATRIX M)
+	{
+		DirectX::XMMATRIX R = M;
+		R.r[3] = DirectX::g_XMIdentityR3;
+		R = DirectX::XMMatrixTranspose(R);
+
+		DirectX::XMVECTOR t = DirectX::XMVector3TransformNormal(DirectX::XMVectorNegate(M.r[3]), R);
+		R.r[3] = DirectX::XMVectorSetW(t, 1.0f);
+		return R;
+	}
+
+	// Inverse of a left-handed perspective projection built by
+	// XMMatrixPerspectiveFovLH or XMMatrixPerspectiveOffCenterLH.  Only the
+	// scale, off-center and depth terms are nonzero, so the inverse is written
+	// out directly.
+	static DirectX::XMMATRIX InversePerspective(DirectX::CXMMATRIX P)
+	{
+		DirectX::XMFLOAT4X4 p;
+		DirectX::XMStoreFloat4x4(&p, P);
+
+		float invX = 1.0f / p._11;
+		float invY = 1.0f / p._22;
+		float invB = 1.0f / p._43;
+
+		return DirectX::XMMATRIX(
+			invX, 0.0f, 0.0f, 0.0f,
+			0.0f, invY, 0.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, invB,
+			-p._31 * invX, -p._32 * invY, 1.0f, -p._33 * invB);
+	}
+
+	// Inverse of a left-handed orthographic projection built by
+	// XMMatrixOrthographicLH or XMMatrixOrthographicOffCenterLH: a scale
+	// followed by a translation on each axis.
+	static DirectX::XMMATRIX InverseOrthographic(DirectX::CXMMATRIX P)
+	{
+		DirectX::XMFLOAT4X4 p;
+		DirectX::XMStoreFloat4x4(&p, P);
+
+		float invX = 1.0f / p._11;
+		float invY = 1.0f / p._22;
+		float invZ = 1.0f / p._33;
+
+		return DirectX::XMMATRIX(
+			invX, 0.0f, 0.0f, 0.0f,
+			0.0f, invY, 0.0f, 0.0f,
+			0.0f, 0.0f, invZ, 0.0f,
+			-p._41 * invX, -p._42 * invY, -p._43 * invZ, 1.0f);
+	}
+
 	static DirectX::XMFLOAT4X4 Identity4x4()
 	{
 		static DirectX::XMFLOAT4X4 I(
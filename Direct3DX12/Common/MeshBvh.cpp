@@ -0,0 +1,404 @@
+#include "MeshBvh.h"
+#include <algorithm>
+#include <cfloat>
+
+using namespace DirectX;
+
+void MeshBvh::Build(const GeometryGenerator::MeshData& meshData)
+{
+	if (meshData.Vertices.empty())
+	{
+		Build(nullptr, sizeof(GeometryGenerator::Vertex), 0, nullptr, 0);
+		return;
+	}
+
+	Build(&meshData.Vertices[0].Position, sizeof(GeometryGenerator::Vertex), meshData.Vertices.size(),
+		meshData.Indices32.data(), meshData.Indices32.size());
+}
+
+void MeshBvh::Build(const XMFLOAT3* positions, size_t stride, size_t vertexCount,
+	const std::uint32_t* indices, size_t indexCount)
+{
+	mNodes.clear();
+	mPackets.clear();
+	mStats = Stats();
+
+	mTriangleCount = (UINT)(indexCount / 3);
+	if (mTriangleCount == 0)
+		return;
+
+	mTriMin.resize(mTriangleCount);
+	mTriMax.resize(mTriangleCount);
+	mTriCentroid.resize(mTriangleCount);
+	mTriOrder.resize(mTriangleCount);
+	mTriVertices.resize(3 * (size_t)mTriangleCount);
+
+	for (UINT t = 0; t < mTriangleCount; ++t)
+	{
+		XMVECTOR v[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			std::uint32_t index = indices[3 * t + k];
+			assert(index < vertexCount);
+
+			mTriVertices[3 * t + k] = *(const XMFLOAT3*)((const BYTE*)positions + index * stride);
+			v[k] = XMLoadFloat3(&mTriVertices[3 * t + k]);
+		}
+
+		XMVECTOR lo = XMVectorMin(v[0], XMVectorMin(v[1], v[2]));
+		XMVECTOR hi = XMVectorMax(v[0], XMVectorMax(v[1], v[2]));
+		XMStoreFloat3(&mTriMin[t], lo);
+		XMStoreFloat3(&mTriMax[t], hi);
+		XMStoreFloat3(&mTriCentroid[t], 0.5f * (lo + hi));
+		mTriOrder[t] = t;
+	}
+
+	// Every leaf holds at least one triangle, so there are at most 2n - 1 nodes.
+	mNodes.reserve(2 * (size_t)mTriangleCount);
+	mPackets.reserve(mTriangleCount);
+
+	BuildNode(0, mTriangleCount, 1);
+
+	mStats.NodeCount = (UINT)mNodes.size();
+	mStats.LeafCount = (UINT)mPackets.size();
+
+	// The build scratch is not needed for queries.
+	mTriMin = std::vector<XMFLOAT3>();
+	mTriMax = std::vector<XMFLOAT3>();
+	mTriCentroid = std::vector<XMFLOAT3>();
+	mTriOrder = std::vector<UINT>();
+	mTriVertices = std::vector<XMFLOAT3>();
+}
+
+bool MeshBvh::Intersect(FXMVECTOR origin, FXMVECTOR dir, float maxT, Hit& hit)
+{
+	mStats.NodesVisited = 0;
+	mStats.PacketsTested = 0;
+	if (mNodes.empty())
+		return false;
+
+	XMVECTOR invDir = XMVectorReciprocal(dir);
+
+	const XMVECTOR ox = XMVectorSplatX(origin);
+	const XMVECTOR oy = XMVectorSplatY(origin);
+	const XMVECTOR oz = XMVectorSplatZ(origin);
+	const XMVECTOR dx = XMVectorSplatX(dir);
+	const XMVECTOR dy = XMVectorSplatY(dir);
+	const XMVECTOR dz = XMVectorSplatZ(dir);
+	const XMVECTOR detEpsilon = XMVectorReplicate(1e-20f);
+
+	float bestT = maxT;
+	bool found = false;
+
+	// Slab test; returns the entry distance or a negative value for a miss.
+	auto intersectBox = [origin, invDir, &bestT](const Node& node)
+	{
+		XMVECTOR t1 = (XMLoadFloat3(&node.Min) - origin) * invDir;
+		XMVECTOR t2 = (XMLoadFloat3(&node.Max) - origin) * invDir;
+		XMVECTOR tNear = XMVectorMin(t1, t2);
+		XMVECTOR tFar = XMVectorMax(t1, t2);
+
+		float tEnter = std::max<float>(std::max<float>(XMVectorGetX(tNear), XMVectorGetY(tNear)), std::max<float>(XMVectorGetZ(tNear), 0.0f));
+		float tExit = std::min<float>(std::min<float>(XMVectorGetX(tFar), XMVectorGetY(tFar)), std::min<float>(XMVectorGetZ(tFar), bestT));
+
+		return tEnter <= tExit ? tEnter : -1.0f;
+	};
+
+	if (intersectBox(mNodes[0]) < 0.0f)
+		return false;
+
+	mStack.clear();
+	mStack.push_back(std::make_pair(0.0f, 0u));
+	while (!mStack.empty())
+	{
+		std::pair<float, UINT> entry = mStack.back();
+		mStack.pop_back();
+
+		// A closer hit may have been found since the node was pushed.
+		if (entry.first > bestT)
+			continue;
+
+		++mStats.NodesVisited;
+		const Node& node = mNodes[entry.second];
+
+		if (node.Count > 0)
+		{
+			++mStats.PacketsTested;
+			const TrianglePacket& packet = mPackets[node.Offset];
+
+			XMVECTOR e1x = XMLoadFloat4A((const XMFLOAT4A*)packet.E1[0]);
+			XMVECTOR e1y = XMLoadFloat4A((const XMFLOAT4A*)packet.E1[1]);
+			XMVECTOR e1z = XMLoadFloat4A((const XMFLOAT4A*)packet.E1[2]);
+			XMVECTOR e2x = XMLoadFloat4A((const XMFLOAT4A*)packet.E2[0]);
+			XMVECTOR e2y = XMLoadFloat4A((const XMFLOAT4A*)packet.E2[1]);
+			XMVECTOR e2z = XMLoadFloat4A((const XMFLOAT4A*)packet.E2[2]);
+
+			// Moller-Trumbore for four triangles at once.
+			XMVECTOR px = dy * e2z - dz * e2y;
+			XMVECTOR py = dz * e2x - dx * e2z;
+			XMVECTOR pz = dx * e2y - dy * e2x;
+			XMVECTOR det = e1x * px + e1y * py + e1z * pz;
+			XMVECTOR invDet = XMVectorReciprocal(det);
+
+			XMVECTOR sx = ox - XMLoadFloat4A((const XMFLOAT4A*)packet.V0[0]);
+			XMVECTOR sy = oy - XMLoadFloat4A((const XMFLOAT4A*)packet.V0[1]);
+			XMVECTOR sz = oz - XMLoadFloat4A((const XMFLOAT4A*)packet.V0[2]);
+			XMVECTOR u = (sx * px + sy * py + sz * pz) * invDet;
+
+			XMVECTOR qx = sy * e1z - sz * e1y;
+			XMVECTOR qy = sz * e1x - sx * e1z;
+			XMVECTOR qz = sx * e1y - sy * e1x;
+			XMVECTOR v = (dx * qx + dy * qy + dz * qz) * invDet;
+			XMVECTOR t = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+
+			XMVECTOR valid = XMVectorGreater(XMVectorAbs(det), detEpsilon);
+			valid = XMVectorAndInt(valid, XMVectorGreaterOrEqual(u, XMVectorZero()));
+			valid = XMVectorAndInt(valid, XMVectorGreaterOrEqual(v, XMVectorZero()));
+			valid = XMVectorAndInt(valid, XMVectorLessOrEqual(u + v, XMVectorSplatOne()));
+			valid = XMVectorAndInt(valid, XMVectorGreaterOrEqual(t, XMVectorZero()));
+			valid = XMVectorAndInt(valid, XMVectorLessOrEqual(t, XMVectorReplicate(bestT)));
+
+			std::uint32_t mask[4];
+			XMStoreInt4(mask, valid);
+			if ((mask[0] | mask[1] | mask[2] | mask[3]) == 0)
+				continue;
+
+			XMFLOAT4 tLanes, uLanes, vLanes;
+			XMStoreFloat4(&tLanes, t);
+			XMStoreFloat4(&uLanes, u);
+			XMStoreFloat4(&vLanes, v);
+
+			for (int k = 0; k < 4; ++k)
+			{
+				if (mask[k] != 0 && (&tLanes.x)[k] <= bestT)
+				{
+					bestT = (&tLanes.x)[k];
+					hit.T = bestT;
+					hit.U = (&uLanes.x)[k];
+					hit.V = (&vLanes.x)[k];
+					hit.Triangle = packet.Triangle[k];
+					found = true;
+				}
+			}
+		}
+		else
+		{
+			// Visit the nearer child first so the far one is likely culled by bestT.
+			UINT a = entry.second + 1;
+			UINT b = node.Offset;
+			float ta = intersectBox(mNodes[a]);
+			float tb = intersectBox(mNodes[b]);
+
+			if (ta >= 0.0f && tb >= 0.0f)
+			{
+				if (ta > tb)
+				{
+					std::swap(a, b);
+					std::swap(ta, tb);
+				}
+
+				mStack.push_back(std::make_pair(tb, b));
+				mStack.push_back(std::make_pair(ta, a));
+			}
+			else if (ta >= 0.0f)
+			{
+				mStack.push_back(std::make_pair(ta, a));
+			}
+			else if (tb >= 0.0f)
+			{
+				mStack.push_back(std::make_pair(tb, b));
+			}
+		}
+	}
+
+	return found;
+}
+
+UINT MeshBvh::TriangleCount()const
+{
+	return mTriangleCount;
+}
+
+const MeshBvh::Stats& MeshBvh::GetStats()const
+{
+	return mStats;
+}
+
+UINT MeshBvh::BuildNode(UINT begin, UINT end, UINT depth)
+{
+	const UINT count = end - begin;
+	const UINT nodeIndex = (UINT)mNodes.size();
+	mNodes.emplace_back();
+
+	mStats.Depth = std::max<UINT>(mStats.Depth, depth);
+
+	XMVECTOR lo = XMVectorReplicate(+FLT_MAX);
+	XMVECTOR hi = XMVectorReplicate(-FLT_MAX);
+	XMVECTOR centroidLo = lo;
+	XMVECTOR centroidHi = hi;
+	for (UINT i = begin; i < end; ++i)
+	{
+		UINT tri = mTriOrder[i];
+		lo = XMVectorMin(lo, XMLoadFloat3(&mTriMin[tri]));
+		hi = XMVectorMax(hi, XMLoadFloat3(&mTriMax[tri]));
+		centroidLo = XMVectorMin(centroidLo, XMLoadFloat3(&mTriCentroid[tri]));
+		centroidHi = XMVectorMax(centroidHi, XMLoadFloat3(&mTriCentroid[tri]));
+	}
+
+	XMStoreFloat3(&mNodes[nodeIndex].Min, lo);
+	XMStoreFloat3(&mNodes[nodeIndex].Max, hi);
+
+	if (count <= MaxLeafSize)
+	{
+		mNodes[nodeIndex].Offset = (UINT)mPackets.size();
+		mNodes[nodeIndex].Count = count;
+		BuildPacket(begin, end);
+		return nodeIndex;
+	}
+
+	// Split along the axis with the largest centroid spread.
+	XMFLOAT3 cLo, cHi;
+	XMStoreFloat3(&cLo, centroidLo);
+	XMStoreFloat3(&cHi, centroidHi);
+
+	float spread[3] = { cHi.x - cLo.x, cHi.y - cLo.y, cHi.z - cLo.z };
+	int axis = 0;
+	if (spread[1] > spread[axis]) axis = 1;
+	if (spread[2] > spread[axis]) axis = 2;
+
+	const float axisLo = (&cLo.x)[axis];
+	const float axisSpread = spread[axis];
+
+	auto centroidOnAxis = [this, axis](UINT tri) { return (&mTriCentroid[tri].x)[axis]; };
+
+	UINT mid = begin + count / 2;
+	if (axisSpread > 0.0f)
+	{
+		const int NumBins = 16;
+
+		struct Bin
+		{
+			XMVECTOR Lo;
+			XMVECTOR Hi;
+			UINT Count;
+		};
+
+		Bin bins[NumBins];
+		for (int b = 0; b < NumBins; ++b)
+		{
+			bins[b].Lo = XMVectorReplicate(+FLT_MAX);
+			bins[b].Hi = XMVectorReplicate(-FLT_MAX);
+			bins[b].Count = 0;
+		}
+
+		const float binScale = NumBins / axisSpread;
+		auto binOf = [&](UINT tri)
+		{
+			int b = (int)((centroidOnAxis(tri) - axisLo) * binScale);
+			return std::min<int>(b, NumBins - 1);
+		};
+
+		for (UINT i = begin; i < end; ++i)
+		{
+			UINT tri = mTriOrder[i];
+			Bin& bin = bins[binOf(tri)];
+			bin.Lo = XMVectorMin(bin.Lo, XMLoadFloat3(&mTriMin[tri]));
+			bin.Hi = XMVectorMax(bin.Hi, XMLoadFloat3(&mTriMax[tri]));
+			++bin.Count;
+		}
+
+		// Sweep from the right to get the area and count right of every split.
+		float rightArea[NumBins];
+		UINT rightCount[NumBins];
+		XMVECTOR accLo = XMVectorReplicate(+FLT_MAX);
+		XMVECTOR accHi = XMVectorReplicate(-FLT_MAX);
+		UINT accCount = 0;
+		for (int b = NumBins - 1; b > 0; --b)
+		{
+			accLo = XMVectorMin(accLo, bins[b].Lo);
+			accHi = XMVectorMax(accHi, bins[b].Hi);
+			accCount += bins[b].Count;
+			rightArea[b] = accCount > 0 ? SurfaceArea(accLo, accHi) : 0.0f;
+			rightCount[b] = accCount;
+		}
+
+		// Then from the left, evaluating the cost of splitting after bin b.
+		float bestCost = FLT_MAX;
+		int bestSplit = -1;
+		accLo = XMVectorReplicate(+FLT_MAX);
+		accHi = XMVectorReplicate(-FLT_MAX);
+		accCount = 0;
+		for (int b = 0; b < NumBins - 1; ++b)
+		{
+			accLo = XMVectorMin(accLo, bins[b].Lo);
+			accHi = XMVectorMax(accHi, bins[b].Hi);
+			accCount += bins[b].Count;
+
+			if (accCount == 0 || rightCount[b + 1] == 0)
+				continue;
+
+			float cost = accCount * SurfaceArea(accLo, accHi) + rightCount[b + 1] * rightArea[b + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestSplit = b;
+			}
+		}
+
+		if (bestSplit >= 0)
+		{
+			auto it = std::partition(mTriOrder.begin() + begin, mTriOrder.begin() + end,
+				[&](UINT tri) { return binOf(tri) <= bestSplit; });
+			mid = (UINT)(it - mTriOrder.begin());
+		}
+	}
+
+	// All centroids coincide or binning failed to separate them: split by count.
+	if (mid == begin || mid == end || axisSpread <= 0.0f)
+	{
+		mid = begin + count / 2;
+		std::nth_element(mTriOrder.begin() + begin, mTriOrder.begin() + mid, mTriOrder.begin() + end,
+			[&](UINT a, UINT b) { return centroidOnAxis(a) < centroidOnAxis(b); });
+	}
+
+	// The first child is built right after this node, the second after the
+	// whole first subtree.
+	BuildNode(begin, mid, depth + 1);
+	UINT second = BuildNode(mid, end, depth + 1);
+
+	mNodes[nodeIndex].Offset = second;
+	mNodes[nodeIndex].Count = 0;
+	return nodeIndex;
+}
+
+void MeshBvh::BuildPacket(UINT begin, UINT end)
+{
+	mPackets.emplace_back();
+	TrianglePacket& packet = mPackets.back();
+
+	for (UINT k = 0; k < 4; ++k)
+	{
+		UINT tri = mTriOrder[std::min<UINT>(begin + k, end - 1)];
+		const XMFLOAT3& v0 = mTriVertices[3 * tri + 0];
+		const XMFLOAT3& v1 = mTriVertices[3 * tri + 1];
+		const XMFLOAT3& v2 = mTriVertices[3 * tri + 2];
+
+		packet.V0[0][k] = v0.x;
+		packet.V0[1][k] = v0.y;
+		packet.V0[2][k] = v0.z;
+		packet.E1[0][k] = v1.x - v0.x;
+		packet.E1[1][k] = v1.y - v0.y;
+		packet.E1[2][k] = v1.z - v0.z;
+		packet.E2[0][k] = v2.x - v0.x;
+		packet.E2[1][k] = v2.y - v0.y;
+		packet.E2[2][k] = v2.z - v0.z;
+		packet.Triangle[k] = tri;
+	}
+}
+
+float MeshBvh::SurfaceArea(FXMVECTOR lo, FXMVECTOR hi)
+{
+	XMFLOAT3 d;
+	XMStoreFloat3(&d, XMVectorMax(hi - lo, XMVectorZero()));
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <Windows.h>
+#include <DirectXMath.h>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "GeometryGenerator.h"
+
+// Bounding volume hierarchy over the triangles of a single mesh, for ray
+// picking in the mesh's local space.
+//
+// The tree is built once with a binned surface area heuristic and stored
+// depth first: an inner node's first child directly follows it and only the
+// second child's index is stored.  Each leaf owns one packet of up to four
+// triangles laid out as structure of arrays, so a leaf is tested against the
+// ray with one set of SIMD instructions.
+class MeshBvh
+{
+public:
+	struct Hit
+	{
+		// Ray parameter of the hit, in units of the ray direction.
+		float T = 0.0f;
+
+		// Barycentrics of the hit point: P = (1 - U - V) * V0 + U * V1 + V * V2.
+		float U = 0.0f;
+		float V = 0.0f;
+
+		// Triangle index, i.e. the first index of the triangle divided by 3.
+		UINT Triangle = 0;
+	};
+
+	struct Stats
+	{
+		UINT NodeCount = 0;
+		UINT LeafCount = 0;
+		UINT Depth = 0;
+		UINT NodesVisited = 0;
+		UINT PacketsTested = 0;
+	};
+
+public:
+	MeshBvh() = default;
+	MeshBvh(const MeshBvh& rhs) = delete;
+	MeshBvh& operator=(const MeshBvh& rhs) = delete;
+	~MeshBvh() = default;
+
+	void Build(const GeometryGenerator::MeshData& meshData);
+
+	// positions are read with the given byte stride; indices form a triangle list.
+	void Build(const DirectX::XMFLOAT3* positions, size_t stride, size_t vertexCount,
+		const std::uint32_t* indices, size_t indexCount);
+
+	// Finds the closest triangle hit by the ray with 0 <= t <= maxT.  Both faces
+	// of a triangle count.  dir need not be normalized.
+	bool Intersect(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float maxT, Hit& hit);
+
+	UINT TriangleCount()const;
+	const Stats& GetStats()const;
+
+private:
+	// 32 bytes, so two nodes share a cache line.
+	struct Node
+	{
+		DirectX::XMFLOAT3 Min;
+
+		// Second child for inner nodes, packet index for leaves.
+		UINT Offset = 0;
+
+		DirectX::XMFLOAT3 Max;
+
+		// Number of triangles for leaves, 0 for inner nodes.
+		UINT Count = 0;
+	};
+
+	// Up to four triangles stored as a vertex and two edges per lane.  Unused
+	// lanes repeat the last triangle.
+	struct alignas(16) TrianglePacket
+	{
+		float V0[3][4];
+		float E1[3][4];
+		float E2[3][4];
+		UINT Triangle[4];
+	};
+
+	static const UINT MaxLeafSize = 4;
+
+	UINT BuildNode(UINT begin, UINT end, UINT depth);
+	void BuildPacket(UINT begin, UINT end);
+
+	static float SurfaceArea(DirectX::FXMVECTOR lo, DirectX::FXMVECTOR hi);
+
+private:
+	std::vector<Node> mNodes;
+	std::vector<TrianglePacket> mPackets;
+
+	// Scratch for the build.
+	std::vector<DirectX::XMFLOAT3> mTriMin;
+	std::vector<DirectX::XMFLOAT3> mTriMax;
+	std::vector<DirectX::XMFLOAT3> mTriCentroid;
+	std::vector<UINT> mTriOrder;
+	std::vector<DirectX::XMFLOAT3> mTriVertices;
+
+	// Traversal stack of (entry distance, node index).
+	std::vector<std::pair<float, UINT>> mStack;
+
+	UINT mTriangleCount = 0;
+	Stats mStats;
+};
@@ -0,0 +1,376 @@
+#include "OcclusionCuller.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <ppl.h>
+
+using namespace DirectX;
+
+namespace
+{
+	// Vertices closer to the eye plane than this make a triangle unusable as an
+	// occluder and a box untestable.
+	const float MinClipW = 1e-4f;
+
+	// Boxes tested per parallel task.
+	const UINT BoxesPerTask = 16;
+}
+
+void OcclusionCuller::Resize(UINT width, UINT height)
+{
+	mTilesX = (width + TileWidth - 1) / TileWidth;
+	mTilesY = (height + TileHeight - 1) / TileHeight;
+	mWidth = mTilesX * TileWidth;
+	mHeight = mTilesY * TileHeight;
+
+	mDepth.assign((size_t)mWidth * mHeight, 1.0f);
+	mTileMaxDepth.assign((size_t)mTilesX * mTilesY, 1.0f);
+	mTileBins.resize((size_t)mTilesX * mTilesY);
+}
+
+UINT OcclusionCuller::Width()const
+{
+	return mWidth;
+}
+
+UINT OcclusionCuller::Height()const
+{
+	return mHeight;
+}
+
+void OcclusionCuller::BeginFrame(FXMMATRIX viewProj)
+{
+	XMStoreFloat4x4(&mViewProj, viewProj);
+
+	std::fill(mDepth.begin(), mDepth.end(), 1.0f);
+	std::fill(mTileMaxDepth.begin(), mTileMaxDepth.end(), 1.0f);
+
+	mTriangles.clear();
+	for (auto& bin : mTileBins)
+		bin.clear();
+
+	mStats = Stats();
+}
+
+void OcclusionCuller::AddOccluder(const XMFLOAT3* positions, size_t stride,
+	const std::uint16_t* indices, UINT indexCount, int baseVertex, FXMMATRIX world)
+{
+	AddTriangles(positions, stride, indices, indexCount, baseVertex, world);
+}
+
+void OcclusionCuller::AddOccluder(const XMFLOAT3* positions, size_t stride,
+	const std::uint32_t* indices, UINT indexCount, int baseVertex, FXMMATRIX world)
+{
+	AddTriangles(positions, stride, indices, indexCount, baseVertex, world);
+}
+
+template<typename Index>
+void OcclusionCuller::AddTriangles(const XMFLOAT3* positions, size_t stride,
+	const Index* indices, UINT indexCount, int baseVertex, FXMMATRIX world)
+{
+	if (indexCount < 3)
+		return;
+
+	// Transform only the vertex range the indices reference, once per vertex.
+	UINT minIndex = indices[0];
+	UINT maxIndex = indices[0];
+	for (UINT i = 1; i < indexCount; ++i)
+	{
+		minIndex = std::min<UINT>(minIndex, indices[i]);
+		maxIndex = std::max<UINT>(maxIndex, indices[i]);
+	}
+
+	XMMATRIX toClip = world * XMLoadFloat4x4(&mViewProj);
+
+	mClipVertices.resize(maxIndex - minIndex + 1);
+	for (UINT i = minIndex; i <= maxIndex; ++i)
+	{
+		const BYTE* p = (const BYTE*)positions + ((size_t)baseVertex + i) * stride;
+		XMStoreFloat4(&mClipVertices[i - minIndex], XMVector3Transform(XMLoadFloat3((const XMFLOAT3*)p), toClip));
+	}
+
+	const float halfWidth = 0.5f * mWidth;
+	const float halfHeight = 0.5f * mHeight;
+
+	for (UINT i = 0; i + 3 <= indexCount; i += 3)
+	{
+		++mStats.OccluderTriangles;
+
+		const XMFLOAT4* v[3] =
+		{
+			&mClipVertices[indices[i + 0] - minIndex],
+			&mClipVertices[indices[i + 1] - minIndex],
+			&mClipVertices[indices[i + 2] - minIndex]
+		};
+
+		// Parts in front of the near plane are never drawn, so they must not occlude.
+		if (v[0]->w < MinClipW || v[1]->w < MinClipW || v[2]->w < MinClipW ||
+			v[0]->z < 0.0f || v[1]->z < 0.0f || v[2]->z < 0.0f)
+			continue;
+
+		ScreenTriangle tri;
+		for (int k = 0; k < 3; ++k)
+		{
+			float invW = 1.0f / v[k]->w;
+			tri.X[k] = (1.0f + v[k]->x * invW) * halfWidth;
+			tri.Y[k] = (1.0f - v[k]->y * invW) * halfHeight;
+			tri.Z[k] = v[k]->z * invW;
+		}
+
+		mTriangles.push_back(tri);
+	}
+}
+
+void OcclusionCuller::Rasterize()
+{
+	// Bin every triangle into the tiles its screen rectangle overlaps.
+	for (UINT t = 0; t < (UINT)mTriangles.size(); ++t)
+	{
+		const ScreenTriangle& tri = mTriangles[t];
+
+		float minX = std::min<float>(tri.X[0], std::min<float>(tri.X[1], tri.X[2]));
+		float maxX = std::max<float>(tri.X[0], std::max<float>(tri.X[1], tri.X[2]));
+		float minY = std::min<float>(tri.Y[0], std::min<float>(tri.Y[1], tri.Y[2]));
+		float maxY = std::max<float>(tri.Y[0], std::max<float>(tri.Y[1], tri.Y[2]));
+
+		if (maxX <= 0.0f || maxY <= 0.0f || minX >= (float)mWidth || minY >= (float)mHeight)
+			continue;
+
+		int tx0 = std::max<int>(0, (int)minX / (int)TileWidth);
+		int ty0 = std::max<int>(0, (int)minY / (int)TileHeight);
+		int tx1 = std::min<int>((int)mTilesX - 1, (int)maxX / (int)TileWidth);
+		int ty1 = std::min<int>((int)mTilesY - 1, (int)maxY / (int)TileHeight);
+
+		for (int ty = ty0; ty <= ty1; ++ty)
+			for (int tx = tx0; tx <= tx1; ++tx)
+				mTileBins[ty * mTilesX + tx].push_back(t);
+
+		++mStats.RasterizedTriangles;
+	}
+
+	// Tiles own disjoint parts of the depth buffer, so they need no locking.
+	concurrency::parallel_for(0u, mTilesX * mTilesY, [this](UINT tile)
+	{
+		RasterizeTile(tile);
+	});
+}
+
+void OcclusionCuller::RasterizeTile(UINT tile)
+{
+	const int tileX0 = (int)((tile % mTilesX) * TileWidth);
+	const int tileY0 = (int)((tile / mTilesX) * TileHeight);
+	const int tileX1 = tileX0 + (int)TileWidth;
+	const int tileY1 = tileY0 + (int)TileHeight;
+
+	const XMVECTOR laneOffsets = XMVectorSet(0.5f, 1.5f, 2.5f, 3.5f);
+
+	for (UINT t : mTileBins[tile])
+	{
+		ScreenTriangle tri = mTriangles[t];
+
+		float area = (tri.X[1] - tri.X[0]) * (tri.Y[2] - tri.Y[0]) - (tri.X[2] - tri.X[0]) * (tri.Y[1] - tri.Y[0]);
+		if (fabsf(area) < 1e-8f)
+			continue;
+
+		// Occluders are two sided; bring every triangle to the same winding.
+		if (area < 0.0f)
+		{
+			std::swap(tri.X[1], tri.X[2]);
+			std::swap(tri.Y[1], tri.Y[2]);
+			std::swap(tri.Z[1], tri.Z[2]);
+			area = -area;
+		}
+
+		// Edge functions E(x, y) = A x + B y + C, positive inside.  A pixel is
+		// fully covered when E at its center is at least half its extent along
+		// the edge normal.
+		float edgeA[3], edgeB[3], edgeC[3];
+		for (int e = 0; e < 3; ++e)
+		{
+			int a = e;
+			int b = (e + 1) % 3;
+			edgeA[e] = tri.Y[a] - tri.Y[b];
+			edgeB[e] = tri.X[b] - tri.X[a];
+			edgeC[e] = -(edgeA[e] * tri.X[a] + edgeB[e] * tri.Y[a]) - 0.5f * (fabsf(edgeA[e]) + fabsf(edgeB[e]));
+		}
+
+		// Depth plane, biased to the farthest depth inside a pixel.
+		float dz1 = tri.Z[1] - tri.Z[0];
+		float dz2 = tri.Z[2] - tri.Z[0];
+		float zA = (dz1 * (tri.Y[2] - tri.Y[0]) - dz2 * (tri.Y[1] - tri.Y[0])) / area;
+		float zB = (dz2 * (tri.X[1] - tri.X[0]) - dz1 * (tri.X[2] - tri.X[0])) / area;
+		float zC = tri.Z[0] - zA * tri.X[0] - zB * tri.Y[0] + 0.5f * (fabsf(zA) + fabsf(zB));
+
+		float minX = std::min<float>(tri.X[0], std::min<float>(tri.X[1], tri.X[2]));
+		float maxX = std::max<float>(tri.X[0], std::max<float>(tri.X[1], tri.X[2]));
+		float minY = std::min<float>(tri.Y[0], std::min<float>(tri.Y[1], tri.Y[2]));
+		float maxY = std::max<float>(tri.Y[0], std::max<float>(tri.Y[1], tri.Y[2]));
+
+		// Start on a four pixel boundary; tiles are a multiple of four wide.
+		int x0 = std::max<int>(tileX0, (int)floorf(minX)) & ~3;
+		int x1 = std::min<int>(tileX1, (int)ceilf(maxX));
+		int y0 = std::max<int>(tileY0, (int)floorf(minY));
+		int y1 = std::min<int>(tileY1, (int)ceilf(maxY));
+
+		XMVECTOR a0 = XMVectorReplicate(edgeA[0]);
+		XMVECTOR a1 = XMVectorReplicate(edgeA[1]);
+		XMVECTOR a2 = XMVectorReplicate(edgeA[2]);
+		XMVECTOR za = XMVectorReplicate(zA);
+
+		for (int y = y0; y < y1; ++y)
+		{
+			float yc = y + 0.5f;
+			XMVECTOR row0 = XMVectorReplicate(edgeB[0] * yc + edgeC[0]);
+			XMVECTOR row1 = XMVectorReplicate(edgeB[1] * yc + edgeC[1]);
+			XMVECTOR row2 = XMVectorReplicate(edgeB[2] * yc + edgeC[2]);
+			XMVECTOR rowZ = XMVectorReplicate(zB * yc + zC);
+
+			float* depthRow = &mDepth[(size_t)y * mWidth];
+			for (int x = x0; x < x1; x += 4)
+			{
+				XMVECTOR xs = XMVectorAdd(XMVectorReplicate((float)x), laneOffsets);
+
+				XMVECTOR inside = XMVectorGreaterOrEqual(XMVectorMultiplyAdd(a0, xs, row0), XMVectorZero());
+				inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(XMVectorMultiplyAdd(a1, xs, row1), XMVectorZero()));
+				inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(XMVectorMultiplyAdd(a2, xs, row2), XMVectorZero()));
+				if (XMVector4EqualInt(inside, XMVectorFalseInt()))
+					continue;
+
+				XMVECTOR z = XMVectorMultiplyAdd(za, xs, rowZ);
+				XMVECTOR depth = XMLoadFloat4((const XMFLOAT4*)&depthRow[x]);
+				depth = XMVectorSelect(depth, XMVectorMin(depth, z), inside);
+				XMStoreFloat4((XMFLOAT4*)&depthRow[x], depth);
+			}
+		}
+	}
+
+	// Farthest depth in the tile, used to test boxes without reading pixels.
+	XMVECTOR maxDepth = XMVectorZero();
+	for (int y = tileY0; y < tileY1; ++y)
+	{
+		const float* depthRow = &mDepth[(size_t)y * mWidth];
+		for (int x = tileX0; x < tileX1; x += 4)
+			maxDepth = XMVectorMax(maxDepth, XMLoadFloat4((const XMFLOAT4*)&depthRow[x]));
+	}
+
+	XMFLOAT4 m;
+	XMStoreFloat4(&m, maxDepth);
+	mTileMaxDepth[tile] = std::max<float>(std::max<float>(m.x, m.y), std::max<float>(m.z, m.w));
+}
+
+bool OcclusionCuller::IsVisible(const BoundingBox& box)const
+{
+	if (mWidth == 0 || mHeight == 0)
+		return true;
+
+	XMFLOAT3 corners[BoundingBox::CORNER_COUNT];
+	box.GetCorners(corners);
+
+	XMMATRIX viewProj = XMLoadFloat4x4(&mViewProj);
+
+	float minX = +FLT_MAX, maxX = -FLT_MAX;
+	float minY = +FLT_MAX, maxY = -FLT_MAX;
+	float minZ = +FLT_MAX;
+	for (UINT i = 0; i < BoundingBox::CORNER_COUNT; ++i)
+	{
+		XMFLOAT4 c;
+		XMStoreFloat4(&c, XMVector3Transform(XMLoadFloat3(&corners[i]), viewProj));
+
+		// A box reaching behind the eye cannot be hidden reliably.
+		if (c.w < MinClipW)
+			return true;
+
+		float invW = 1.0f / c.w;
+		float sx = (1.0f + c.x * invW) * 0.5f * mWidth;
+		float sy = (1.0f - c.y * invW) * 0.5f * mHeight;
+
+		minX = std::min<float>(minX, sx);
+		maxX = std::max<float>(maxX, sx);
+		minY = std::min<float>(minY, sy);
+		maxY = std::max<float>(maxY, sy);
+		minZ = std::min<float>(minZ, c.z * invW);
+	}
+
+	if (minZ <= 0.0f)
+		return true;
+
+	int x0 = std::max<int>(0, (int)floorf(minX));
+	int x1 = std::min<int>((int)mWidth, (int)ceilf(maxX));
+	int y0 = std::max<int>(0, (int)floorf(minY));
+	int y1 = std::min<int>((int)mHeight, (int)ceilf(maxY));
+
+	// Off screen; leave that to the frustum test.
+	if (x0 >= x1 || y0 >= y1)
+		return true;
+
+	const XMVECTOR boxZ = XMVectorReplicate(minZ);
+	const XMVECTOR laneOffsets = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+	const XMVECTOR rectX0 = XMVectorReplicate((float)x0);
+	const XMVECTOR rectX1 = XMVectorReplicate((float)x1);
+
+	int tx0 = x0 / (int)TileWidth;
+	int tx1 = (x1 - 1) / (int)TileWidth;
+	int ty0 = y0 / (int)TileHeight;
+	int ty1 = (y1 - 1) / (int)TileHeight;
+	for (int ty = ty0; ty <= ty1; ++ty)
+	{
+		for (int tx = tx0; tx <= tx1; ++tx)
+		{
+			// Everything in the tile is nearer than the box.
+			if (minZ > mTileMaxDepth[ty * mTilesX + tx])
+				continue;
+
+			int px0 = std::max<int>(x0, tx * (int)TileWidth) & ~3;
+			int px1 = std::min<int>(x1, (tx + 1) * (int)TileWidth);
+			int py0 = std::max<int>(y0, ty * (int)TileHeight);
+			int py1 = std::min<int>(y1, (ty + 1) * (int)TileHeight);
+
+			for (int y = py0; y < py1; ++y)
+			{
+				const float* depthRow = &mDepth[(size_t)y * mWidth];
+				for (int x = px0; x < px1; x += 4)
+				{
+					XMVECTOR xs = XMVectorAdd(XMVectorReplicate((float)x), laneOffsets);
+					XMVECTOR inRect = XMVectorAndInt(XMVectorGreaterOrEqual(xs, rectX0), XMVectorLess(xs, rectX1));
+
+					XMVECTOR depth = XMLoadFloat4((const XMFLOAT4*)&depthRow[x]);
+					XMVECTOR behind = XMVectorAndInt(inRect, XMVectorGreaterOrEqual(depth, boxZ));
+					if (!XMVector4EqualInt(behind, XMVectorFalseInt()))
+						return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+UINT OcclusionCuller::TestBoxes(const BoundingBox* boxes, UINT count, std::uint8_t* visible)
+{
+	UINT taskCount = (count + BoxesPerTask - 1) / BoxesPerTask;
+	concurrency::parallel_for(0u, taskCount, [&](UINT task)
+	{
+		UINT first = task * BoxesPerTask;
+		UINT last = std::min<UINT>(first + BoxesPerTask, count);
+		for (UINT i = first; i < last; ++i)
+			visible[i] = IsVisible(boxes[i]) ? 1 : 0;
+	});
+
+	UINT visibleCount = 0;
+	for (UINT i = 0; i < count; ++i)
+		visibleCount += visible[i];
+
+	mStats.Tested += count;
+	mStats.Occluded += count - visibleCount;
+	return visibleCount;
+}
+
+const float* OcclusionCuller::GetDepth()const
+{
+	return mDepth.data();
+}
+
+const OcclusionCuller::Stats& OcclusionCuller::GetStats()const
+{
+	return mStats;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <Windows.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+// Software occlusion culling against a small CPU depth buffer.
+//
+// Each frame a few occluder meshes are transformed to screen space, binned
+// into tiles and rasterized tile by tile in parallel, four pixels at a time.
+// Only pixels an occluder covers completely are written, with the farthest
+// depth the triangle reaches inside the pixel, so the buffer never claims
+// more occlusion than the real occluders give.  Every tile keeps the
+// farthest depth it contains, which lets most boxes be accepted or rejected
+// without touching single pixels.
+//
+// Depth follows the D3D convention: 0 at the near plane, 1 at the far plane.
+// Nothing here touches the GPU, so the class can be driven from a test.
+class OcclusionCuller
+{
+public:
+	struct Stats
+	{
+		UINT OccluderTriangles = 0;
+		UINT RasterizedTriangles = 0;
+		UINT Tested = 0;
+		UINT Occluded = 0;
+	};
+
+	static const UINT TileWidth = 32;
+	static const UINT TileHeight = 16;
+
+public:
+	OcclusionCuller() = default;
+	OcclusionCuller(const OcclusionCuller& rhs) = delete;
+	OcclusionCuller& operator=(const OcclusionCuller& rhs) = delete;
+	~OcclusionCuller() = default;
+
+	// The size is rounded up to whole tiles.
+	void Resize(UINT width, UINT height);
+	UINT Width()const;
+	UINT Height()const;
+
+	// Clears the depth buffer and drops the previous frame's occluders.
+	void BeginFrame(DirectX::FXMMATRIX viewProj);
+
+	// Adds the triangles of an indexed triangle list.  positions are read with
+	// the given byte stride at index + baseVertex.  Triangles that cross the
+	// near plane are dropped rather than clipped.
+	void AddOccluder(const DirectX::XMFLOAT3* positions, size_t stride,
+		const std::uint16_t* indices, UINT indexCount, int baseVertex, DirectX::FXMMATRIX world);
+	void AddOccluder(const DirectX::XMFLOAT3* positions, size_t stride,
+		const std::uint32_t* indices, UINT indexCount, int baseVertex, DirectX::FXMMATRIX world);
+
+	// Rasterizes every occluder added since BeginFrame.
+	void Rasterize();
+
+	// True unless the whole box is hidden behind the rasterized occluders.
+	bool IsVisible(const DirectX::BoundingBox& box)const;
+
+	// Sets visible[i] to 0 for the boxes that are hidden and 1 otherwise, in
+	// parallel.  Returns the number of visible boxes.
+	UINT TestBoxes(const DirectX::BoundingBox* boxes, UINT count, std::uint8_t* visible);
+
+	// Width() * Height() depths, row major.
+	const float* GetDepth()const;
+
+	const Stats& GetStats()const;
+
+private:
+	struct ScreenTriangle
+	{
+		float X[3];
+		float Y[3];
+		float Z[3];
+	};
+
+	template<typename Index>
+	void AddTriangles(const DirectX::XMFLOAT3* positions, size_t stride,
+		const Index* indices, UINT indexCount, int baseVertex, DirectX::FXMMATRIX world);
+
+	void RasterizeTile(UINT tile);
+
+private:
+	UINT mWidth = 0;
+	UINT mHeight = 0;
+	UINT mTilesX = 0;
+	UINT mTilesY = 0;
+
+	DirectX::XMFLOAT4X4 mViewProj;
+
+	std::vector<float> mDepth;
+	std::vector<float> mTileMaxDepth;
+
+	std::vector<ScreenTriangle> mTriangles;
+	std::vector<std::vector<UINT>> mTileBins;
+
+	// Clip space positions of the occluder being added.
+	std::vector<DirectX::XMFLOAT4> mClipVertices;
+
+	Stats mStats;
+};
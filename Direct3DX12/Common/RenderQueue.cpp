@@ -0,0 +1,149 @@
+#include "RenderQueue.h"
+#include <algorithm>
+
+namespace
+{
+	const UINT DepthBits = 30;
+	const UINT MaterialBits = 12;
+	const UINT GeometryBits = 10;
+	const UINT PsoBits = 8;
+	const UINT StateBitCount = PsoBits + GeometryBits + MaterialBits;
+	const UINT LayerShift = 60;
+
+	const UINT64 DepthMask = (1ull << DepthBits) - 1;
+	const UINT64 StateMask = (1ull << StateBitCount) - 1;
+}
+
+void RenderQueue::SetBackToFront(UINT layer, bool backToFront)
+{
+	assert(layer < MaxLayers);
+	mBackToFront[layer] = backToFront;
+}
+
+void RenderQueue::Clear()
+{
+	mKeys.clear();
+	mItems.clear();
+	mStats = Stats();
+}
+
+void RenderQueue::Push(UINT layer, UINT pso, UINT geometry, UINT material, float depth, UINT item)
+{
+	mKeys.push_back(MakeKey(layer, pso, geometry, material, depth));
+	mItems.push_back(item);
+}
+
+void RenderQueue::Sort()
+{
+	const size_t count = mKeys.size();
+
+	mStats.Items = (UINT)count;
+	mStats.StateChangesUnsorted = CountStateChanges();
+
+	mTempKeys.resize(count);
+	mTempItems.resize(count);
+
+	// Bits that differ between any two keys; bytes with none of them set are
+	// already in order.
+	UINT64 differing = 0;
+	for (size_t i = 1; i < count; ++i)
+		differing |= mKeys[i] ^ mKeys[0];
+
+	for (UINT shift = 0; shift < 64; shift += 8)
+	{
+		if (((differing >> shift) & 0xff) == 0)
+			continue;
+
+		UINT offsets[256] = {};
+		for (size_t i = 0; i < count; ++i)
+			++offsets[(mKeys[i] >> shift) & 0xff];
+
+		UINT sum = 0;
+		for (UINT b = 0; b < 256; ++b)
+		{
+			UINT n = offsets[b];
+			offsets[b] = sum;
+			sum += n;
+		}
+
+		// Stable scatter, so earlier passes' order survives among equal bytes.
+		for (size_t i = 0; i < count; ++i)
+		{
+			UINT dst = offsets[(mKeys[i] >> shift) & 0xff]++;
+			mTempKeys[dst] = mKeys[i];
+			mTempItems[dst] = mItems[i];
+		}
+
+		mKeys.swap(mTempKeys);
+		mItems.swap(mTempItems);
+	}
+
+	mStats.StateChangesSorted = CountStateChanges();
+}
+
+UINT RenderQueue::Size()const
+{
+	return (UINT)mKeys.size();
+}
+
+UINT RenderQueue::Layer(UINT i)const
+{
+	return (UINT)(mKeys[i] >> LayerShift);
+}
+
+UINT RenderQueue::Item(UINT i)const
+{
+	return mItems[i];
+}
+
+const RenderQueue::Stats& RenderQueue::GetStats()const
+{
+	return mStats;
+}
+
+UINT64 RenderQueue::MakeKey(UINT layer, UINT pso, UINT geometry, UINT material, float depth)const
+{
+	assert(layer < MaxLayers && pso < MaxPsos && geometry < MaxGeometries && material < MaxMaterials);
+
+	depth = std::min<float>(std::max<float>(depth, 0.0f), 1.0f);
+	UINT64 quantizedDepth = (UINT64)((double)depth * (DepthSteps - 1));
+
+	UINT64 state = ((UINT64)pso << (GeometryBits + MaterialBits)) |
+		((UINT64)geometry << MaterialBits) |
+		(UINT64)material;
+
+	UINT64 key = (UINT64)layer << LayerShift;
+	if (mBackToFront[layer])
+		key |= ((DepthMask - quantizedDepth) << StateBitCount) | state;
+	else
+		key |= (state << DepthBits) | quantizedDepth;
+
+	return key;
+}
+
+UINT64 RenderQueue::StateBits(UINT64 key)const
+{
+	UINT layer = (UINT)(key >> LayerShift);
+	return mBackToFront[layer] ? (key & StateMask) : ((key >> DepthBits) & StateMask);
+}
+
+UINT RenderQueue::CountStateChanges()const
+{
+	UINT changes = 0;
+	for (size_t i = 1; i < mKeys.size(); ++i)
+	{
+		if ((mKeys[i - 1] >> LayerShift) != (mKeys[i] >> LayerShift))
+			continue;
+
+		UINT64 prev = StateBits(mKeys[i - 1]);
+		UINT64 curr = StateBits(mKeys[i]);
+
+		// Count each of pso, geometry and material that differs.
+		UINT64 diff = prev ^ curr;
+		changes += (diff >> (GeometryBits + MaterialBits)) != 0;
+		changes += ((diff >> MaterialBits) & ((1ull << GeometryBits) - 1)) != 0;
+		changes += (diff & ((1ull << MaterialBits) - 1)) != 0;
+	}
+
+	return changes;
+}
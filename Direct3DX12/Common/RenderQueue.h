@@ -0,0 +1,86 @@
+#pragma once
+
+#include <Windows.h>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+// Orders draws by a 64-bit key so that items sharing pipeline state,
+// geometry and material are submitted next to each other.
+//
+// A key packs, from the most significant bits down:
+//
+//   front to back: layer(4) | pso(8) | geometry(10) | material(12) | depth(30)
+//   back to front: layer(4) | ~depth(30) | pso(8) | geometry(10) | material(12)
+//
+// Layers are drawn in order.  Within a front-to-back layer state changes are
+// minimized first and nearer items come first among items with the same
+// state, which keeps early depth rejection working.  A back-to-front layer,
+// such as blended geometry, must be drawn farthest first, so depth outranks
+// state there.
+//
+// The keys are sorted with an LSD radix sort on bytes.  Passes over bytes
+// that are the same in every key are skipped, so in practice only a few of
+// the eight passes run.
+class RenderQueue
+{
+public:
+	static const UINT MaxLayers = 1 << 4;
+	static const UINT MaxPsos = 1 << 8;
+	static const UINT MaxGeometries = 1 << 10;
+	static const UINT MaxMaterials = 1 << 12;
+	static const UINT DepthSteps = 1 << 30;
+
+	struct Stats
+	{
+		UINT Items = 0;
+
+		// Pipeline state, geometry and material switches between consecutive
+		// items of a layer, in push order and in sorted order.
+		UINT StateChangesUnsorted = 0;
+		UINT StateChangesSorted = 0;
+	};
+
+public:
+	RenderQueue() = default;
+	RenderQueue(const RenderQueue& rhs) = delete;
+	RenderQueue& operator=(const RenderQueue& rhs) = delete;
+	~RenderQueue() = default;
+
+	void SetBackToFront(UINT layer, bool backToFront);
+
+	void Clear();
+
+	// depth is normalized to [0, 1], 0 being nearest; values outside are clamped.
+	void Push(UINT layer, UINT pso, UINT geometry, UINT material, float depth, UINT item);
+
+	void Sort();
+
+	// Items in sorted order after Sort, in push order before.
+	UINT Size()const;
+	UINT Layer(UINT i)const;
+	UINT Item(UINT i)const;
+
+	const Stats& GetStats()const;
+
+private:
+	UINT64 MakeKey(UINT layer, UINT pso, UINT geometry, UINT material, float depth)const;
+
+	// The pso, geometry and material fields of key, packed the same way
+	// regardless of layer order.
+	UINT64 StateBits(UINT64 key)const;
+
+	UINT CountStateChanges()const;
+
+private:
+	bool mBackToFront[MaxLayers] = {};
+
+	std::vector<UINT64> mKeys;
+	std::vector<UINT> mItems;
+
+	// Scratch buffers for the radix sort.
+	std::vector<UINT64> mTempKeys;
+	std::vector<UINT> mTempItems;
+
+	Stats mStats;
+};
@@ -0,0 +1,90 @@
+#include "RingAllocator.h"
+
+RingAllocator::RingAllocator(UINT64 capacity)
+{
+	Reset(capacity);
+}
+
+void RingAllocator::Reset(UINT64 capacity)
+{
+	mCapacity = capacity;
+	mHead = 0;
+	mTail = 0;
+	mUsedSize = 0;
+	mCurrFrameSize = 0;
+	mFrames.clear();
+}
+
+UINT64 RingAllocator::Allocate(UINT64 size, UINT64 alignment)
+{
+	assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+
+	if (size == 0 || mUsedSize == mCapacity)
+		return InvalidOffset;
+
+	UINT64 alignedHead = (mHead + alignment - 1) & ~(alignment - 1);
+
+	// Free space is [head, capacity) followed by [0, tail) when the head is at
+	// or past the tail, and [head, tail) otherwise.
+	UINT64 offset = InvalidOffset;
+	UINT64 charged = 0;
+	if (mHead >= mTail)
+	{
+		if (alignedHead + size <= mCapacity)
+		{
+			offset = alignedHead;
+			charged = alignedHead - mHead + size;
+		}
+		else if (size <= mTail)
+		{
+			// Offset 0 satisfies any alignment; the bytes left at the end are wasted.
+			offset = 0;
+			charged = mCapacity - mHead + size;
+		}
+	}
+	else if (alignedHead + size <= mTail)
+	{
+		offset = alignedHead;
+		charged = alignedHead - mHead + size;
+	}
+
+	if (offset == InvalidOffset)
+		return InvalidOffset;
+
+	mHead = offset + size;
+	mUsedSize += charged;
+	mCurrFrameSize += charged;
+
+	return offset;
+}
+
+void RingAllocator::FinishFrame(UINT64 fenceValue)
+{
+	assert(mFrames.empty() || mFrames.back().FenceValue <= fenceValue);
+
+	mFrames.push_back({ fenceValue, mHead, mCurrFrameSize });
+	mCurrFrameSize = 0;
+}
+
+void RingAllocator::ReleaseCompleted(UINT64 completedFenceValue)
+{
+	while (!mFrames.empty() && mFrames.front().FenceValue <= completedFenceValue)
+	{
+		const Frame& frame = mFrames.front();
+		assert(frame.Size <= mUsedSize);
+
+		mTail = frame.End;
+		mUsedSize -= frame.Size;
+		mFrames.pop_front();
+	}
+}
+
+UINT64 RingAllocator::Capacity()const
+{
+	return mCapacity;
+}
+
+UINT64 RingAllocator::UsedSize()const
+{
+	return mUsedSize;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Windows.h>
+#include <cassert>
+#include <deque>
+
+// Linear allocator over a fixed range of bytes that is reused as a ring.
+//
+// Allocations are carved off the head in order and are never freed one by
+// one.  Instead, FinishFrame tags everything allocated since the previous call
+// with a fence value, and ReleaseCompleted retires whole frames once the GPU
+// has passed their fence, moving the tail up to where the frame ended.  An
+// allocation that does not fit between the head and the end of the range
+// starts again at offset 0, and the skipped bytes are charged to the frame.
+//
+// The class only does offset arithmetic, so it does not depend on a device and
+// can be tested on its own.  It is not thread safe.
+class RingAllocator
+{
+public:
+	static const UINT64 InvalidOffset = ~0ull;
+
+public:
+	RingAllocator() = default;
+	explicit RingAllocator(UINT64 capacity);
+	RingAllocator(const RingAllocator& rhs) = delete;
+	RingAllocator& operator=(const RingAllocator& rhs) = delete;
+	~RingAllocator() = default;
+
+	// Forgets all allocations and frames.
+	void Reset(UINT64 capacity);
+
+	// Returns the offset of size bytes aligned to alignment, a power of two, or
+	// InvalidOffset if the free space cannot hold them.
+	UINT64 Allocate(UINT64 size, UINT64 alignment);
+
+	// Everything allocated since the previous call stays in use until
+	// ReleaseCompleted is given a fence value of at least fenceValue.
+	void FinishFrame(UINT64 fenceValue);
+	void ReleaseCompleted(UINT64 completedFenceValue);
+
+	UINT64 Capacity()const;
+	UINT64 UsedSize()const;
+
+private:
+	struct Frame
+	{
+		UINT64 FenceValue;
+		UINT64 End;
+		UINT64 Size;
+	};
+
+	UINT64 mCapacity = 0;
+	UINT64 mHead = 0;
+	UINT64 mTail = 0;
+	UINT64 mUsedSize = 0;
+	UINT64 mCurrFrameSize = 0;
+
+	// Finished frames, oldest first.
+	std::deque<Frame> mFrames;
+};
@@ -0,0 +1,544 @@
+#include "SceneBvh.h"
+#include <algorithm>
+#include <cfloat>
+
+using namespace DirectX;
+
+namespace
+{
+	// mLeafOf value of an object inserted since the last build.
+	const UINT PendingLeaf = (UINT)-2;
+
+	// 0 = outside, 1 = intersecting, 2 = fully inside.
+	int ClassifyBox(FXMVECTOR lo, FXMVECTOR hi, const XMFLOAT4 planes[6])
+	{
+		XMVECTOR c = 0.5f * (lo + hi);
+		XMVECTOR e = 0.5f * (hi - lo);
+
+		int result = 2;
+		for (int p = 0; p < 6; ++p)
+		{
+			XMVECTOR plane = XMLoadFloat4(&planes[p]);
+			float dist = XMVectorGetX(XMVector3Dot(plane, c)) + planes[p].w;
+			float radius = XMVectorGetX(XMVector3Dot(XMVectorAbs(plane), e));
+
+			if (dist + radius < 0.0f)
+				return 0;
+			if (dist - radius < 0.0f)
+				result = 1;
+		}
+
+		return result;
+	}
+}
+
+void SceneBvh::Build(const UINT* ids, const BoundingBox* boxes, UINT count)
+{
+	UINT idCount = 0;
+	for (UINT i = 0; i < count; ++i)
+		idCount = std::max<UINT>(idCount, ids[i] + 1);
+
+	mBoxes.assign(idCount, BoundingBox());
+	mLeafOf.assign(idCount, (UINT)-1);
+	mSlotOf.assign(idCount, (UINT)-1);
+	mCentroids.resize(idCount);
+
+	mLeafIds.assign(ids, ids + count);
+	for (UINT i = 0; i < count; ++i)
+		mBoxes[ids[i]] = boxes[i];
+
+	Rebuild();
+}
+
+void SceneBvh::Update(UINT id, const BoundingBox& box)
+{
+	assert(Contains(id));
+
+	mBoxes[id] = box;
+
+	// Inserted objects get their leaf on the pending rebuild.
+	if (mLeafOf[id] == PendingLeaf)
+		return;
+
+	mLeafBoxes.SetBox(mSlotOf[id], box);
+
+	// Flag the path to the root.  Stop at the first node that is already flagged,
+	// everything above it is flagged too.
+	UINT node = mLeafOf[id];
+	while (node != (UINT)-1 && !mDirty[node])
+	{
+		mDirty[node] = 1;
+		node = mParents[node];
+	}
+
+	mAnyDirty = true;
+}
+
+void SceneBvh::Insert(UINT id, const BoundingBox& box)
+{
+	assert(!Contains(id));
+
+	if (id >= mLeafOf.size())
+	{
+		mBoxes.resize(id + 1);
+		mLeafOf.resize(id + 1, (UINT)-1);
+		mSlotOf.resize(id + 1, (UINT)-1);
+		mCentroids.resize(id + 1);
+	}
+
+	mBoxes[id] = box;
+	mLeafOf[id] = PendingLeaf;
+	mLeafIds.push_back(id);
+	mRebuildPending = true;
+}
+
+bool SceneBvh::Refit()
+{
+	if (mRebuildPending)
+	{
+		Rebuild();
+		return true;
+	}
+
+	if (!mAnyDirty)
+		return false;
+
+	mAnyDirty = false;
+	++mStats.Refits;
+	++mRefitsSinceBuild;
+
+	// Children are always stored after their parent, so a backward walk
+	// updates every child before the parent that depends on it.
+	for (UINT i = (UINT)mNodes.size(); i-- > 0;)
+	{
+		if (mDirty[i])
+		{
+			ComputeNodeBox(i);
+			mDirty[i] = 0;
+		}
+	}
+
+	mStats.CurrentCost = ComputeCost();
+	if (mStats.CurrentCost > RebuildCostRatio * mStats.BuildCost || mRefitsSinceBuild >= RebuildInterval)
+	{
+		Rebuild();
+		return true;
+	}
+
+	return false;
+}
+
+bool SceneBvh::Contains(UINT id)const
+{
+	return id < mLeafOf.size() && mLeafOf[id] != (UINT)-1;
+}
+
+void SceneBvh::QueryFrustum(const XMFLOAT4 planes[6], std::vector<UINT>& ids)
+{
+	mStats.NodesVisited = 0;
+	if (mNodes.empty())
+		return;
+
+	FrustumCuller::PlaneSet planeSet;
+	FrustumCuller::SplatPlanes(planes, planeSet);
+
+	mStack.clear();
+	mStack.push_back(0);
+	while (!mStack.empty())
+	{
+		UINT nodeIndex = mStack.back();
+		mStack.pop_back();
+		++mStats.NodesVisited;
+
+		const Node& node = mNodes[nodeIndex];
+		int classification = ClassifyBox(XMLoadFloat3(&node.Min), XMLoadFloat3(&node.Max), planes);
+		if (classification == 0)
+			continue;
+
+		// Nothing below a fully contained node needs testing.
+		if (classification == 2)
+		{
+			AppendSubtree(nodeIndex, ids);
+			continue;
+		}
+
+		if (node.Count > 0)
+		{
+			// A leaf holds at most four objects: one pass of the 4-wide kernel.
+			UINT visible = mLeafBoxes.CullRange(planeSet, node.First, node.Count);
+			for (UINT i = 0; i < node.Count; ++i)
+			{
+				if (visible & (1u << i))
+					ids.push_back(mLeafIds[node.First + i]);
+			}
+		}
+		else
+		{
+			mStack.push_back(node.First);
+			mStack.push_back(node.First + 1);
+		}
+	}
+}
+
+void SceneBvh::QueryBox(const BoundingBox& box, std::vector<UINT>& ids)
+{
+	XMVECTOR c = XMLoadFloat3(&box.Center);
+	XMVECTOR e = XMLoadFloat3(&box.Extents);
+	XMVECTOR qlo = c - e;
+	XMVECTOR qhi = c + e;
+
+	QueryOverlap([qlo, qhi](FXMVECTOR lo, FXMVECTOR hi)
+	{
+		return XMVector3LessOrEqual(lo, qhi) && XMVector3GreaterOrEqual(hi, qlo);
+	}, ids);
+}
+
+void SceneBvh::QuerySphere(const BoundingSphere& sphere, std::vector<UINT>& ids)
+{
+	XMVECTOR center = XMLoadFloat3(&sphere.Center);
+	float radiusSq = sphere.Radius * sphere.Radius;
+
+	QueryOverlap([center, radiusSq](FXMVECTOR lo, FXMVECTOR hi)
+	{
+		// Distance from the sphere center to the closest point of the box.
+		XMVECTOR closest = XMVectorClamp(center, lo, hi);
+		return XMVectorGetX(XMVector3LengthSq(closest - center)) <= radiusSq;
+	}, ids);
+}
+
+void SceneBvh::QueryRay(FXMVECTOR origin, FXMVECTOR dir, float maxDist,
+	std::vector<std::pair<float, UINT>>& hits)
+{
+	mStats.NodesVisited = 0;
+	size_t firstHit = hits.size();
+	if (mNodes.empty())
+		return;
+
+	XMVECTOR invDir = XMVectorReciprocal(dir);
+
+	// Slab test; returns the entry distance or a negative value for a miss.
+	auto intersect = [origin, invDir, maxDist](FXMVECTOR lo, FXMVECTOR hi)
+	{
+		XMVECTOR t1 = (lo - origin) * invDir;
+		XMVECTOR t2 = (hi - origin) * invDir;
+		XMVECTOR tNear = XMVectorMin(t1, t2);
+		XMVECTOR tFar = XMVectorMax(t1, t2);
+
+		float tEnter = std::max<float>(std::max<float>(XMVectorGetX(tNear), XMVectorGetY(tNear)), std::max<float>(XMVectorGetZ(tNear), 0.0f));
+		float tExit = std::min<float>(std::min<float>(XMVectorGetX(tFar), XMVectorGetY(tFar)), std::min<float>(XMVectorGetZ(tFar), maxDist));
+
+		return tEnter <= tExit ? tEnter : -1.0f;
+	};
+
+	mStack.clear();
+	mStack.push_back(0);
+	while (!mStack.empty())
+	{
+		UINT nodeIndex = mStack.back();
+		mStack.pop_back();
+		++mStats.NodesVisited;
+
+		const Node& node = mNodes[nodeIndex];
+		if (intersect(XMLoadFloat3(&node.Min), XMLoadFloat3(&node.Max)) < 0.0f)
+			continue;
+
+		if (node.Count > 0)
+		{
+			for (UINT i = 0; i < node.Count; ++i)
+			{
+				UINT id = mLeafIds[node.First + i];
+				XMVECTOR c = XMLoadFloat3(&mBoxes[id].Center);
+				XMVECTOR e = XMLoadFloat3(&mBoxes[id].Extents);
+
+				float t = intersect(c - e, c + e);
+				if (t >= 0.0f)
+					hits.push_back(std::make_pair(t, id));
+			}
+		}
+		else
+		{
+			mStack.push_back(node.First);
+			mStack.push_back(node.First + 1);
+		}
+	}
+
+	std::sort(hits.begin() + firstHit, hits.end());
+}
+
+const SceneBvh::Stats& SceneBvh::GetStats()const
+{
+	return mStats;
+}
+
+void SceneBvh::Rebuild()
+{
+	const UINT count = (UINT)mLeafIds.size();
+
+	mNodes.clear();
+	mParents.clear();
+	mLeafBoxes.Resize(count);
+	mRefitsSinceBuild = 0;
+	++mStats.Rebuilds;
+
+	if (count == 0)
+	{
+		mDirty.clear();
+		mStats.NodeCount = 0;
+		mStats.BuildCost = 0.0f;
+		mStats.CurrentCost = 0.0f;
+		return;
+	}
+
+	for (UINT id : mLeafIds)
+		mCentroids[id] = mBoxes[id].Center;
+
+	// A binary tree with count leaves never has more than 2 * count - 1 nodes,
+	// so nodes are never reallocated during the build.
+	mNodes.reserve(2 * count);
+	mParents.reserve(2 * count);
+
+	mNodes.emplace_back();
+	mParents.push_back((UINT)-1);
+	BuildNode(0, 0, count);
+
+	mDirty.assign(mNodes.size(), 0);
+	mAnyDirty = false;
+	mRebuildPending = false;
+
+	mStats.NodeCount = (UINT)mNodes.size();
+	mStats.BuildCost = ComputeCost();
+	mStats.CurrentCost = mStats.BuildCost;
+}
+
+void SceneBvh::BuildNode(UINT nodeIndex, UINT begin, UINT end)
+{
+	const UINT count = end - begin;
+
+	XMVECTOR lo = XMVectorReplicate(+FLT_MAX);
+	XMVECTOR hi = XMVectorReplicate(-FLT_MAX);
+	XMVECTOR centroidLo = lo;
+	XMVECTOR centroidHi = hi;
+	for (UINT i = begin; i < end; ++i)
+	{
+		UINT id = mLeafIds[i];
+		XMVECTOR c = XMLoadFloat3(&mBoxes[id].Center);
+		XMVECTOR e = XMLoadFloat3(&mBoxes[id].Extents);
+		lo = XMVectorMin(lo, c - e);
+		hi = XMVectorMax(hi, c + e);
+		centroidLo = XMVectorMin(centroidLo, c);
+		centroidHi = XMVectorMax(centroidHi, c);
+	}
+
+	XMStoreFloat3(&mNodes[nodeIndex].Min, lo);
+	XMStoreFloat3(&mNodes[nodeIndex].Max, hi);
+
+	if (count <= MaxLeafSize)
+	{
+		mNodes[nodeIndex].First = begin;
+		mNodes[nodeIndex].Count = count;
+		for (UINT i = begin; i < end; ++i)
+		{
+			UINT id = mLeafIds[i];
+			mLeafOf[id] = nodeIndex;
+			mSlotOf[id] = i;
+			mLeafBoxes.SetBox(i, mBoxes[id]);
+		}
+		return;
+	}
+
+	// Split along the axis with the largest centroid spread.
+	XMFLOAT3 cLo, cHi;
+	XMStoreFloat3(&cLo, centroidLo);
+	XMStoreFloat3(&cHi, centroidHi);
+
+	float spread[3] = { cHi.x - cLo.x, cHi.y - cLo.y, cHi.z - cLo.z };
+	int axis = 0;
+	if (spread[1] > spread[axis]) axis = 1;
+	if (spread[2] > spread[axis]) axis = 2;
+
+	const float axisLo = (&cLo.x)[axis];
+	const float axisSpread = spread[axis];
+
+	auto centroidOnAxis = [this, axis](UINT id) { return (&mCentroids[id].x)[axis]; };
+
+	UINT mid = begin + count / 2;
+	if (axisSpread > 0.0f)
+	{
+		const int NumBins = 12;
+
+		struct Bin
+		{
+			XMVECTOR Lo;
+			XMVECTOR Hi;
+			UINT Count;
+		};
+
+		Bin bins[NumBins];
+		for (int b = 0; b < NumBins; ++b)
+		{
+			bins[b].Lo = XMVectorReplicate(+FLT_MAX);
+			bins[b].Hi = XMVectorReplicate(-FLT_MAX);
+			bins[b].Count = 0;
+		}
+
+		auto binOf = [&](UINT id)
+		{
+			int b = (int)((centroidOnAxis(id) - axisLo) * NumBins / axisSpread);
+			return std::min<int>(b, NumBins - 1);
+		};
+
+		for (UINT i = begin; i < end; ++i)
+		{
+			UINT id = mLeafIds[i];
+			XMVECTOR c = XMLoadFloat3(&mBoxes[id].Center);
+			XMVECTOR e = XMLoadFloat3(&mBoxes[id].Extents);
+
+			Bin& bin = bins[binOf(id)];
+			bin.Lo = XMVectorMin(bin.Lo, c - e);
+			bin.Hi = XMVectorMax(bin.Hi, c + e);
+			++bin.Count;
+		}
+
+		// Sweep from the right to get the area and count right of every split.
+		float rightArea[NumBins];
+		UINT rightCount[NumBins];
+		XMVECTOR accLo = XMVectorReplicate(+FLT_MAX);
+		XMVECTOR accHi = XMVectorReplicate(-FLT_MAX);
+		UINT accCount = 0;
+		for (int b = NumBins - 1; b > 0; --b)
+		{
+			accLo = XMVectorMin(accLo, bins[b].Lo);
+			accHi = XMVectorMax(accHi, bins[b].Hi);
+			accCount += bins[b].Count;
+			rightArea[b] = accCount > 0 ? SurfaceArea(accLo, accHi) : 0.0f;
+			rightCount[b] = accCount;
+		}
+
+		// Then from the left, evaluating the cost of splitting after bin b.
+		float bestCost = FLT_MAX;
+		int bestSplit = -1;
+		accLo = XMVectorReplicate(+FLT_MAX);
+		accHi = XMVectorReplicate(-FLT_MAX);
+		accCount = 0;
+		for (int b = 0; b < NumBins - 1; ++b)
+		{
+			accLo = XMVectorMin(accLo, bins[b].Lo);
+			accHi = XMVectorMax(accHi, bins[b].Hi);
+			accCount += bins[b].Count;
+
+			if (accCount == 0 || rightCount[b + 1] == 0)
+				continue;
+
+			float cost = accCount * SurfaceArea(accLo, accHi) + rightCount[b + 1] * rightArea[b + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestSplit = b;
+			}
+		}
+
+		if (bestSplit >= 0)
+		{
+			auto it = std::partition(mLeafIds.begin() + begin, mLeafIds.begin() + end,
+				[&](UINT id) { return binOf(id) <= bestSplit; });
+			mid = (UINT)(it - mLeafIds.begin());
+		}
+	}
+
+	// All centroids coincide or binning failed to separate them: split by count.
+	if (mid == begin || mid == end || axisSpread <= 0.0f)
+	{
+		mid = begin + count / 2;
+		std::nth_element(mLeafIds.begin() + begin, mLeafIds.begin() + mid, mLeafIds.begin() + end,
+			[&](UINT a, UINT b) { return centroidOnAxis(a) < centroidOnAxis(b); });
+	}
+
+	UINT left = (UINT)mNodes.size();
+	mNodes.emplace_back();
+	mNodes.emplace_back();
+	mParents.push_back(nodeIndex);
+	mParents.push_back(nodeIndex);
+
+	mNodes[nodeIndex].First = left;
+	mNodes[nodeIndex].Count = 0;
+
+	BuildNode(left, begin, mid);
+	BuildNode(left + 1, mid, end);
+}
+
+void SceneBvh::ComputeNodeBox(UINT nodeIndex)
+{
+	Node& node = mNodes[nodeIndex];
+
+	XMVECTOR lo, hi;
+	if (node.Count > 0)
+	{
+		lo = XMVectorReplicate(+FLT_MAX);
+		hi = XMVectorReplicate(-FLT_MAX);
+		for (UINT i = 0; i < node.Count; ++i)
+		{
+			const BoundingBox& box = mBoxes[mLeafIds[node.First + i]];
+			XMVECTOR c = XMLoadFloat3(&box.Center);
+			XMVECTOR e = XMLoadFloat3(&box.Extents);
+			lo = XMVectorMin(lo, c - e);
+			hi = XMVectorMax(hi, c + e);
+		}
+	}
+	else
+	{
+		const Node& a = mNodes[node.First];
+		const Node& b = mNodes[node.First + 1];
+		lo = XMVectorMin(XMLoadFloat3(&a.Min), XMLoadFloat3(&b.Min));
+		hi = XMVectorMax(XMLoadFloat3(&a.Max), XMLoadFloat3(&b.Max));
+	}
+
+	XMStoreFloat3(&node.Min, lo);
+	XMStoreFloat3(&node.Max, hi);
+}
+
+float SceneBvh::ComputeCost()const
+{
+	if (mNodes.empty())
+		return 0.0f;
+
+	// SAH cost relative to the root: one unit per inner node visit and per
+	// object test, weighted by the probability of reaching the node.
+	float cost = 0.0f;
+	for (const Node& node : mNodes)
+	{
+		float area = SurfaceArea(XMLoadFloat3(&node.Min), XMLoadFloat3(&node.Max));
+		cost += node.Count > 0 ? area * node.Count : area;
+	}
+
+	float rootArea = SurfaceArea(XMLoadFloat3(&mNodes[0].Min), XMLoadFloat3(&mNodes[0].Max));
+	return rootArea > 0.0f ? cost / rootArea : 0.0f;
+}
+
+float SceneBvh::SurfaceArea(FXMVECTOR lo, FXMVECTOR hi)
+{
+	XMFLOAT3 d;
+	XMStoreFloat3(&d, XMVectorMax(hi - lo, XMVectorZero()));
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+void SceneBvh::AppendSubtree(UINT nodeIndex, std::vector<UINT>& ids)
+{
+	// Uses its own stack so it can run in the middle of another traversal.
+	mSubtreeStack.clear();
+	mSubtreeStack.push_back(nodeIndex);
+	while (!mSubtreeStack.empty())
+	{
+		const Node& node = mNodes[mSubtreeStack.back()];
+		mSubtreeStack.pop_back();
+
+		if (node.Count > 0)
+		{
+			ids.insert(ids.end(), mLeafIds.begin() + node.First, mLeafIds.begin() + node.First + node.Count);
+		}
+		else
+		{
+			mSubtreeStack.push_back(node.First);
+			mSubtreeStack.push_back(node.First + 1);
+		}
+	}
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <Windows.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+#include "FrustumCuller.h"
+
+// Bounding volume hierarchy over the world boxes of scene objects.
+//
+// Objects are identified by a caller chosen id (e.g. an index into the render
+// item array).  The tree is built with a binned surface area heuristic.  When
+// objects move, Update() rewrites their leaf box and Refit() fixes the
+// ancestors bottom up; once refitting has degraded the tree too far, or after
+// RebuildInterval refits, the tree is rebuilt from scratch.
+class SceneBvh
+{
+public:
+	struct Stats
+	{
+		UINT NodeCount = 0;
+		UINT Refits = 0;
+		UINT Rebuilds = 0;
+		UINT NodesVisited = 0;
+		float BuildCost = 0.0f;
+		float CurrentCost = 0.0f;
+	};
+
+	// Maximum number of objects per leaf.
+	static const UINT MaxLeafSize = 4;
+
+	// Rebuild when the SAH cost grows by this factor over the built tree.
+	float RebuildCostRatio = 1.5f;
+
+	// Rebuild at least this often, counted in refits that changed something.
+	UINT RebuildInterval = 600;
+
+public:
+	SceneBvh() = default;
+	SceneBvh(const SceneBvh& rhs) = delete;
+	SceneBvh& operator=(const SceneBvh& rhs) = delete;
+	~SceneBvh() = default;
+
+	void Build(const UINT* ids, const DirectX::BoundingBox* boxes, UINT count);
+
+	// Changes the box of an object already in the tree.  Takes effect on Refit().
+	void Update(UINT id, const DirectX::BoundingBox& box);
+
+	// Adds an object that is not in the tree yet.  The tree is rebuilt on the
+	// next Refit(), so several inserts in one frame cost one build.
+	void Insert(UINT id, const DirectX::BoundingBox& box);
+
+	// Refits the nodes above updated objects.  Returns true if the tree was rebuilt.
+	bool Refit();
+
+	bool Contains(UINT id)const;
+
+	// The queries append the ids of the objects whose boxes pass the test.
+	// Planes point inward, see FrustumCuller::ExtractPlanes.
+	void QueryFrustum(const DirectX::XMFLOAT4 planes[6], std::vector<UINT>& ids);
+	void QueryBox(const DirectX::BoundingBox& box, std::vector<UINT>& ids);
+	void QuerySphere(const DirectX::BoundingSphere& sphere, std::vector<UINT>& ids);
+
+	// Objects whose boxes the ray hits, with the distance at which the ray
+	// enters the box, sorted nearest first.  dir need not be normalized; the
+	// distances are in units of dir.
+	void QueryRay(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float maxDist,
+		std::vector<std::pair<float, UINT>>& hits);
+
+	const Stats& GetStats()const;
+
+private:
+	struct Node
+	{
+		DirectX::XMFLOAT3 Min;
+
+		// First child (the second follows it) for inner nodes, first entry in
+		// mLeafIds for leaves.
+		UINT First = 0;
+
+		DirectX::XMFLOAT3 Max;
+
+		// Number of objects for leaves, 0 for inner nodes.
+		UINT Count = 0;
+	};
+
+	void BuildNode(UINT nodeIndex, UINT begin, UINT end);
+	void ComputeNodeBox(UINT nodeIndex);
+	void Rebuild();
+	float ComputeCost()const;
+
+	static float SurfaceArea(DirectX::FXMVECTOR lo, DirectX::FXMVECTOR hi);
+
+	template<typename Overlaps>
+	void QueryOverlap(Overlaps overlaps, std::vector<UINT>& ids);
+
+	void AppendSubtree(UINT nodeIndex, std::vector<UINT>& ids);
+
+private:
+	std::vector<Node> mNodes;
+	std::vector<UINT> mParents;
+	std::vector<std::uint8_t> mDirty;
+
+	// Object ids ordered so that each leaf references a contiguous range.
+	std::vector<UINT> mLeafIds;
+
+	// Indexed by object id.
+	std::vector<DirectX::BoundingBox> mBoxes;
+	std::vector<UINT> mLeafOf;
+	std::vector<UINT> mSlotOf;
+
+	// Object boxes in mLeafIds order, so every leaf is one batch for the
+	// frustum kernel.
+	FrustumCuller mLeafBoxes;
+
+	// Scratch for the build.
+	std::vector<DirectX::XMFLOAT3> mCentroids;
+
+	std::vector<UINT> mStack;
+	std::vector<UINT> mSubtreeStack;
+
+	bool mAnyDirty = false;
+	bool mRebuildPending = false;
+	UINT mRefitsSinceBuild = 0;
+	Stats mStats;
+};
+
+template<typename Overlaps>
+void SceneBvh::QueryOverlap(Overlaps overlaps, std::vector<UINT>& ids)
+{
+	mStats.NodesVisited = 0;
+	if (mNodes.empty())
+		return;
+
+	mStack.clear();
+	mStack.push_back(0);
+	while (!mStack.empty())
+	{
+		UINT nodeIndex = mStack.back();
+		mStack.pop_back();
+		++mStats.NodesVisited;
+
+		const Node& node = mNodes[nodeIndex];
+		if (!overlaps(DirectX::XMLoadFloat3(&node.Min), DirectX::XMLoadFloat3(&node.Max)))
+			continue;
+
+		if (node.Count > 0)
+		{
+			for (UINT i = 0; i < node.Count; ++i)
+			{
+				UINT id = mLeafIds[node.First + i];
+				const DirectX::BoundingBox& box = mBoxes[id];
+				DirectX::XMVECTOR c = DirectX::XMLoadFloat3(&box.Center);
+				DirectX::XMVECTOR e = DirectX::XMLoadFloat3(&box.Extents);
+				if (overlaps(DirectX::XMVectorSubtract(c, e), DirectX::XMVectorAdd(c, e)))
+					ids.push_back(id);
+			}
+		}
+		else
+		{
+			mStack.push_back(node.First);
+			mStack.push_back(node.First + 1);
+		}
+	}
+}
@@ -0,0 +1,135 @@
+#include "TransformStore.h"
+#include <emmintrin.h>
+
+using namespace DirectX;
+
+void TransformStore::Resize(UINT count)
+{
+	XMFLOAT4X4A identity;
+	XMStoreFloat4x4A(&identity, XMMatrixIdentity());
+
+	mWorld.resize(count, identity);
+	mTexTransform.resize(count, identity);
+	mMaterialIndex.resize(count, 0);
+}
+
+UINT TransformStore::LayoutByteSize(Layout layout)
+{
+	return layout == Layout::PackedObjectData ? PackedObjectDataByteSize : ObjectConstantsByteSize;
+}
+
+UINT TransformStore::Size()const
+{
+	return (UINT)mWorld.size();
+}
+
+void TransformStore::Set(UINT index, FXMMATRIX world, CXMMATRIX texTransform, UINT materialIndex)
+{
+	assert(index < Size());
+
+	XMStoreFloat4x4A(&mWorld[index], world);
+	XMStoreFloat4x4A(&mTexTransform[index], texTransform);
+	mMaterialIndex[index] = materialIndex;
+}
+
+void TransformStore::SetWorld(UINT index, FXMMATRIX world)
+{
+	assert(index < Size());
+
+	XMStoreFloat4x4A(&mWorld[index], world);
+}
+
+XMMATRIX TransformStore::GetWorld(UINT index)const
+{
+	assert(index < Size());
+
+	return XMLoadFloat4x4A(&mWorld[index]);
+}
+
+void TransformStore::StreamRange(UINT first, UINT count, BYTE* dest, UINT stride, Layout layout)const
+{
+	assert(first + count <= Size());
+	assert(((std::uintptr_t)dest & 15) == 0 && (stride & 15) == 0);
+	assert(stride >= LayoutByteSize(layout));
+
+	BYTE* dst = dest + (size_t)first * stride;
+	if (layout == Layout::PackedObjectData)
+	{
+		for (UINT i = first; i < first + count; ++i, dst += stride)
+			StreamPackedElement(i, dst);
+	}
+	else
+	{
+		for (UINT i = first; i < first + count; ++i, dst += stride)
+			StreamElement(i, dst);
+	}
+
+	// Make the write-combined stores visible before the command list is submitted.
+	_mm_sfence();
+}
+
+void TransformStore::StreamGather(const UINT* indices, UINT count, BYTE* dest, UINT stride, Layout layout)const
+{
+	assert(((std::uintptr_t)dest & 15) == 0 && (stride & 15) == 0);
+	assert(stride >= LayoutByteSize(layout));
+
+	for (UINT i = 0; i < count; ++i)
+	{
+		assert(indices[i] < Size());
+		if (layout == Layout::PackedObjectData)
+			StreamPackedElement(indices[i], dest + (size_t)indices[i] * stride);
+		else
+			StreamElement(indices[i], dest + (size_t)indices[i] * stride);
+	}
+
+	_mm_sfence();
+}
+
+void TransformStore::StreamElement(UINT index, BYTE* dst)const
+{
+	// The shaders read the matrices column major, so each one is transposed on the way out.
+	const float* world = &mWorld[index].m[0][0];
+	__m128 r0 = _mm_load_ps(world + 0);
+	__m128 r1 = _mm_load_ps(world + 4);
+	__m128 r2 = _mm_load_ps(world + 8);
+	__m128 r3 = _mm_load_ps(world + 12);
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	_mm_stream_ps((float*)(dst + 0), r0);
+	_mm_stream_ps((float*)(dst + 16), r1);
+	_mm_stream_ps((float*)(dst + 32), r2);
+	_mm_stream_ps((float*)(dst + 48), r3);
+
+	const float* tex = &mTexTransform[index].m[0][0];
+	r0 = _mm_load_ps(tex + 0);
+	r1 = _mm_load_ps(tex + 4);
+	r2 = _mm_load_ps(tex + 8);
+	r3 = _mm_load_ps(tex + 12);
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	_mm_stream_ps((float*)(dst + 64), r0);
+	_mm_stream_ps((float*)(dst + 80), r1);
+	_mm_stream_ps((float*)(dst + 96), r2);
+	_mm_stream_ps((float*)(dst + 112), r3);
+
+	_mm_stream_si128((__m128i*)(dst + 128), _mm_cvtsi32_si128((int)mMaterialIndex[index]));
+}
+
+void TransformStore::StreamPackedElement(UINT index, BYTE* dst)const
+{
+	// Only the first three rows of the transposed world matrix are kept; the
+	// fourth is (0, 0, 0, 1) for an affine transform.
+	const float* world = &mWorld[index].m[0][0];
+	__m128 r0 = _mm_load_ps(world + 0);
+	__m128 r1 = _mm_load_ps(world + 4);
+	__m128 r2 = _mm_load_ps(world + 8);
+	__m128 r3 = _mm_load_ps(world + 12);
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	_mm_stream_ps((float*)(dst + 0), r0);
+	_mm_stream_ps((float*)(dst + 16), r1);
+	_mm_stream_ps((float*)(dst + 32), r2);
+
+	// Scale from the diagonal, offset from the translation row.
+	const XMFLOAT4X4A& tex = mTexTransform[index];
+	_mm_stream_ps((float*)(dst + 48), _mm_setr_ps(tex._11, tex._22, tex._41, tex._42));
+
+	_mm_stream_si128((__m128i*)(dst + 64), _mm_cvtsi32_si128((int)mMaterialIndex[index]));
+}
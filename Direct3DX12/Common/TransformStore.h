@@ -0,0 +1,68 @@
+#pragma once
+
+#include <Windows.h>
+#include <DirectXMath.h>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+// Per-object transforms kept in contiguous arrays, one array per field, and
+// written to an object constant buffer in batches.
+//
+// Two destination layouts are supported.  ObjectConstants is cbPerObject: the
+// transposed world matrix, the transposed texture transform and the material
+// index padded to 16 bytes, 144 bytes in all.  PackedObjectData is the
+// structured buffer element: the first three rows of the transposed world
+// matrix (the world matrix must be affine), the texture transform's xy scale
+// and offset, and the padded material index, 80 bytes in all.
+//
+// Each element is transposed in registers and written with non-temporal
+// stores.  The upload heap is write-combined memory that the CPU never reads
+// back, so the stores bypass the cache instead of evicting the caller's data.
+class TransformStore
+{
+public:
+	enum class Layout
+	{
+		ObjectConstants,
+		PackedObjectData,
+	};
+
+	// Bytes written per element; the element stride may be larger.
+	static const UINT ObjectConstantsByteSize = 144;
+	static const UINT PackedObjectDataByteSize = 80;
+
+	static UINT LayoutByteSize(Layout layout);
+
+public:
+	TransformStore() = default;
+	TransformStore(const TransformStore& rhs) = delete;
+	TransformStore& operator=(const TransformStore& rhs) = delete;
+	~TransformStore() = default;
+
+	// New elements start as identity transforms with material 0.
+	void Resize(UINT count);
+	UINT Size()const;
+
+	void Set(UINT index, DirectX::FXMMATRIX world, DirectX::CXMMATRIX texTransform, UINT materialIndex);
+	void SetWorld(UINT index, DirectX::FXMMATRIX world);
+	DirectX::XMMATRIX GetWorld(UINT index)const;
+
+	// Writes elements [first, first + count) to dest + index * stride.  dest and
+	// stride must be multiples of 16 bytes.
+	void StreamRange(UINT first, UINT count, BYTE* dest, UINT stride,
+		Layout layout = Layout::ObjectConstants)const;
+
+	// Writes the listed elements to dest + index * stride, in list order.
+	void StreamGather(const UINT* indices, UINT count, BYTE* dest, UINT stride,
+		Layout layout = Layout::ObjectConstants)const;
+
+private:
+	void StreamElement(UINT index, BYTE* dst)const;
+	void StreamPackedElement(UINT index, BYTE* dst)const;
+
+private:
+	std::vector<DirectX::XMFLOAT4X4A> mWorld;
+	std::vector<DirectX::XMFLOAT4X4A> mTexTransform;
+	std::vector<UINT> mMaterialIndex;
+};
@@ -57,6 +57,43 @@ public:
         memcpy(&mMappedData[elementIndex * mElementByteSize], &data, sizeof(T));
     }
 
+    // first부터 count개의 원소를 한 번에 쓴다. 원소 사이에 패딩이 없으면 하나의 연속된 복사가 된다.
+    void CopyRange(int first, const T* data, UINT count)
+    {
+        BYTE* dst = &mMappedData[first * mElementByteSize];
+        if (mElementByteSize == sizeof(T))
+        {
+            d3dUtil::StreamCopy(dst, data, (size_t)count * sizeof(T));
+        }
+        else
+        {
+            for (UINT i = 0; i < count; ++i)
+                d3dUtil::StreamCopy(dst + (size_t)i * mElementByteSize, &data[i], sizeof(T));
+        }
+
+        d3dUtil::StreamFence();
+    }
+
+    // data[i]를 indices[i]번 원소에 쓴다. 인덱스가 오름차순이면 매핑된 메모리에 주소 순서대로 쓰게 된다.
+    void CopyGather(const UINT* indices, UINT count, const T* data)
+    {
+        for (UINT i = 0; i < count; ++i)
+            d3dUtil::StreamCopy(&mMappedData[(size_t)indices[i] * mElementByteSize], &data[i], sizeof(T));
+
+        d3dUtil::StreamFence();
+    }
+
+    // 매핑된 메모리와 원소 간격입니다. 여러 원소를 한꺼번에 직접 쓸 때 사용한다.
+    BYTE* MappedData() const
+    {
+        return mMappedData;
+    }
+
+    UINT ElementByteSize() const
+    {
+        return mElementByteSize;
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
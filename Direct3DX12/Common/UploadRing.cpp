@@ -0,0 +1,59 @@
+#include "UploadRing.h"
+
+UploadRing::UploadRing(ID3D12Device* device, UINT64 byteSize)
+	: mAllocator(byteSize)
+{
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&mUploadBuffer)));
+
+	// Stays mapped for the lifetime of the ring.
+	ThrowIfFailed(mUploadBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
+	mGpuAddress = mUploadBuffer->GetGPUVirtualAddress();
+}
+
+UploadRing::~UploadRing()
+{
+	if (mUploadBuffer != nullptr)
+		mUploadBuffer->Unmap(0, nullptr);
+
+	mMappedData = nullptr;
+}
+
+ID3D12Resource* UploadRing::Resource()const
+{
+	return mUploadBuffer.Get();
+}
+
+UploadSpan<BYTE> UploadRing::Allocate(UINT64 byteSize, UINT64 alignment)
+{
+	UINT64 offset = mAllocator.Allocate(byteSize, alignment);
+	if (offset == RingAllocator::InvalidOffset)
+		ThrowIfFailed(E_OUTOFMEMORY);
+
+	UploadSpan<BYTE> span;
+	span.CpuAddress = mMappedData + offset;
+	span.GpuAddress = mGpuAddress + offset;
+	span.Stride = 1;
+	span.Count = (UINT)byteSize;
+	return span;
+}
+
+void UploadRing::FinishFrame(UINT64 fenceValue)
+{
+	mAllocator.FinishFrame(fenceValue);
+}
+
+void UploadRing::ReleaseCompleted(UINT64 completedFenceValue)
+{
+	mAllocator.ReleaseCompleted(completedFenceValue);
+}
+
+UINT64 UploadRing::UsedSize()const
+{
+	return mAllocator.UsedSize();
+}
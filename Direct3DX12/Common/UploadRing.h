@@ -0,0 +1,95 @@
+#pragma once
+
+#include "d3dUtil.h"
+#include "RingAllocator.h"
+
+// Typed view of a block of upload memory handed out by UploadRing.
+template<typename T>
+struct UploadSpan
+{
+	BYTE* CpuAddress = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS GpuAddress = 0;
+	UINT Stride = 0;
+	UINT Count = 0;
+
+	T* Element(UINT index)const
+	{
+		assert(index < Count);
+		return reinterpret_cast<T*>(CpuAddress + (size_t)index * Stride);
+	}
+
+	D3D12_GPU_VIRTUAL_ADDRESS ElementGpuAddress(UINT index)const
+	{
+		assert(index < Count);
+		return GpuAddress + (UINT64)index * Stride;
+	}
+
+	void CopyData(UINT index, const T& data)const
+	{
+		memcpy(Element(index), &data, sizeof(T));
+	}
+};
+
+// One persistently mapped upload buffer shared by all transient per-frame
+// data.  Sub-allocations come from a RingAllocator and are reclaimed through
+// the fence value that each frame is signaled with, so the buffer only has to
+// be large enough for the frames in flight rather than for every kind of data
+// separately.
+//
+// Allocate from one thread only.  Writing to disjoint spans from several
+// threads is fine.
+class UploadRing
+{
+public:
+	UploadRing(ID3D12Device* device, UINT64 byteSize);
+	UploadRing(const UploadRing& rhs) = delete;
+	UploadRing& operator=(const UploadRing& rhs) = delete;
+	~UploadRing();
+
+	ID3D12Resource* Resource()const;
+
+	// Throws if the ring is full; size the ring for gNumFrameResources frames.
+	UploadSpan<BYTE> Allocate(UINT64 byteSize, UINT64 alignment);
+
+	// Elements padded to 256 bytes, each usable as a root CBV.
+	template<typename T>
+	UploadSpan<T> AllocateConstants(UINT count)
+	{
+		return AllocateElements<T>(count, d3dUtil::CalcConstantBufferByteSize(sizeof(T)),
+			D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+	}
+
+	// Tightly packed elements for structured buffers, vertices and indices.
+	template<typename T>
+	UploadSpan<T> AllocateArray(UINT count)
+	{
+		return AllocateElements<T>(count, sizeof(T), 16);
+	}
+
+	// Call after signaling the fence for the frame's command lists.
+	void FinishFrame(UINT64 fenceValue);
+	void ReleaseCompleted(UINT64 completedFenceValue);
+
+	UINT64 UsedSize()const;
+
+private:
+	template<typename T>
+	UploadSpan<T> AllocateElements(UINT count, UINT stride, UINT64 alignment)
+	{
+		UploadSpan<BYTE> block = Allocate((UINT64)stride * count, alignment);
+
+		UploadSpan<T> span;
+		span.CpuAddress = block.CpuAddress;
+		span.GpuAddress = block.GpuAddress;
+		span.Stride = stride;
+		span.Count = count;
+		return span;
+	}
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
+	BYTE* mMappedData = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS mGpuAddress = 0;
+
+	RingAllocator mAllocator;
+};
@@ -1,6 +1,7 @@
 ﻿#include "d3dUtil.h"
 #include <comdef.h>
 #include <fstream>
+#include <immintrin.h>
 
 using Microsoft::WRL::ComPtr;
 
@@ -122,4 +123,50 @@ std::wstring DxException::ToString() const
     std::wstring msg = err.ErrorMessage();
 
     return FunctionName + L" failed in " + Filename + L"; line " + std::to_wstring(LineNumber) + L"; error: " + msg;
-}
\ No newline at end of file
+}
+void d3dUtil::StreamCopy(void* dest, const void* src, size_t byteSize)
+{
+    BYTE* dst = static_cast<BYTE*>(dest);
+    const BYTE* s = static_cast<const BYTE*>(src);
+
+#if defined(__AVX__)
+    const size_t streamAlignment = 32;
+#else
+    const size_t streamAlignment = 16;
+#endif
+
+    // 대상이 정렬될 때까지는 일반 저장으로 씁니다.
+    size_t head = (streamAlignment - ((size_t)dst & (streamAlignment - 1))) & (streamAlignment - 1);
+    if (head > byteSize)
+        head = byteSize;
+    memcpy(dst, s, head);
+    dst += head;
+    s += head;
+    byteSize -= head;
+
+    // 32바이트 단위로 순서대로 씁니다. AVX가 없으면 16바이트 저장 두 번으로 나눕니다.
+    for (; byteSize >= 32; byteSize -= 32, dst += 32, s += 32)
+    {
+#if defined(__AVX__)
+        _mm256_stream_si256((__m256i*)dst, _mm256_loadu_si256((const __m256i*)s));
+#else
+        _mm_stream_si128((__m128i*)dst, _mm_loadu_si128((const __m128i*)s));
+        _mm_stream_si128((__m128i*)(dst + 16), _mm_loadu_si128((const __m128i*)(s + 16)));
+#endif
+    }
+
+    if (byteSize >= 16)
+    {
+        _mm_stream_si128((__m128i*)dst, _mm_loadu_si128((const __m128i*)s));
+        dst += 16;
+        s += 16;
+        byteSize -= 16;
+    }
+
+    memcpy(dst, s, byteSize);
+}
+
+void d3dUtil::StreamFence()
+{
+    _mm_sfence();
+}
@@ -91,6 +91,12 @@ public:
         const std::string& target);
 
     static Microsoft::WRL::ComPtr<ID3DBlob> LoadBinary(const std::wstring& filename);
+
+    // 쓰기 결합(write-combined) 업로드 메모리에 캐시를 거치지 않는 스트리밍 저장으로 복사한다.
+    // 대상 메모리를 읽지 않으며, 정렬되지 않은 앞뒤 부분만 일반 저장을 쓴다.
+    // 한 묶음의 복사가 끝나면 StreamFence를 호출해서 저장들이 커맨드 제출 전에 보이게 해야 한다.
+    static void StreamCopy(void* dest, const void* src, size_t byteSize);
+    static void StreamFence();
 };
 
 class DxException
@@ -120,6 +126,7 @@ struct SubmeshGeometry
     // Bounding box of the geometry defined by this submesh. 
     // This is used in later chapters of the book.
     DirectX::BoundingBox Bounds;
+    DirectX::BoundingSphere Sphere;
 };
 
 struct MeshGeometry
@@ -9,6 +9,8 @@
 //***************************************************************************************
 
 #include "ClientApp.h"
+#include "UploadBenchmark.h"
+#include <ppl.h>
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
                    PSTR cmdLine, int showCmd)
@@ -36,8 +38,6 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 ClientMain::ClientMain(HINSTANCE hInstance)
     : D3DApp(hInstance)
 {
-	mSceneBounds.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
-	mSceneBounds.Radius = sqrtf(10.0f * 10.0f + 15.0f * 15.0f);
 }
 
 ClientMain::~ClientMain()
@@ -49,6 +49,8 @@ bool ClientMain::Initialize()
     if (!D3DApp::Initialize())
         return false;
 
+    mBaseWndCaption = mMainWndCaption;
+
     // 초기화 명령들을 기록하기 위해 커맨드 리스트를 리셋합니다.
     ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
 	
@@ -74,9 +76,42 @@ bool ClientMain::Initialize()
     BuildSkyRenderItems(); 
     BuildRenderItems();
 
+	// 상수 버퍼 슬롯은 아이템 순서대로 빈틈없이 씁니다.
+	for (UINT i = 0; i < (UINT)mAllRitems.size(); ++i)
+	{
+		RenderItem* ri = mAllRitems[i].get();
+		ri->GeoIndex = mGeometries.Find(ri->Geo->Name).Index;
+		AssignItemIndices(ri, i);
+	}
+
+	// 블렌딩되는 투명 레이어만 먼 것부터 그립니다.
+	mRenderQueue.SetBackToFront((UINT)RenderLayer::Transparent, true);
+
+	mMaterialList.resize(mMaterials.Size());
+	mMaterials.ForEach([&](std::unique_ptr<Material>& mat)
+	{
+		mMaterialList[mat->MatCBIndex] = mat.get();
+	});
+
+	mObjectDirty.Resize((UINT)mAllRitems.size(), gNumFrameResources);
+	mMaterialDirty.Resize((UINT)mMaterialList.size(), gNumFrameResources);
+
+	mTransforms.Resize((UINT)mAllRitems.size());
+	for (auto& e : mAllRitems)
+		MarkRitemDirty(e.get());
+
+	mItemVisible.resize(mAllRitems.size(), 1);
+	mCasterVisible.resize(mAllRitems.size(), 0);
+	BuildSceneBvh();
+	mOcclusionCuller.Resize(256, 128);
+
     BuildFrameResources();
     BuildPSOs();
 
+#if defined(UPLOAD_BENCHMARK)
+	RunUploadBenchmark(md3dDevice.Get());
+#endif
+
 	mSsao->SetPSOs(mPSOs["ssao"].Get(), mPSOs["ssaoBlur"].Get());
 
     // 초기화 명령들을 실행시킵니다.
@@ -103,9 +138,9 @@ void ClientMain::CreateRtvAndDsvDescriptorHeaps()
 	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(
 		&rtvHeapDesc, IID_PPV_ARGS(mRtvHeap.GetAddressOf())));
 
-	// Add +1 DSV for shadow map.
+	// Add +1 DSV for shadow map, +1 for the static shadow cache.
 	D3D12_DESCRIPTOR_HEAP_DESC dsvHeapDesc;
-	dsvHeapDesc.NumDescriptors = 2;
+	dsvHeapDesc.NumDescriptors = 3;
 	dsvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
 	dsvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
 	dsvHeapDesc.NodeMask = 0;
@@ -147,25 +182,59 @@ void ClientMain::Update(const GameTimer& gt)
         CloseHandle(eventHandle);
     }
 
+	// GPU가 끝낸 프레임들의 링 메모리를 회수하고, 이번 프레임의 패스 상수 버퍼를 받습니다.
+	// 링 할당은 스레드에 안전하지 않으므로 작업 스레드로 나누기 전에 합니다.
+	mUploadRing->ReleaseCompleted(mFence->GetCompletedValue());
+	mCurrPassCB = mUploadRing->AllocateConstants<PassConstants>(PassCount);
+
+	// 물체 버퍼를 현재 렌더 아이템 수에 맞춥니다. 이 프레임 리소스의 이전 버퍼는 위에서 기다린 펜스까지만 쓰였습니다.
+	// 새로 생긴 인덱스는 AddRenderItem이 더티로 표시합니다. 버퍼가 바뀌면 새 버퍼는 비어 있으므로
+	// 이 프레임 리소스에 대해서만 모든 아이템을 더티로 표시해 아래 UpdateObjectCBs가 변환 저장소에서 다시 씁니다.
+	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
+	if (currObjectCB->Resize((UINT)mAllRitems.size(), mCurrFrameResource->Fence))
+		mObjectDirty.MarkAllPending(mCurrFrameResourceIndex);
+	currObjectCB->ReleaseRetired(mFence->GetCompletedValue());
+
 	mLightRotationAngle += 0.1f * gt.DeltaTime();
 
+	// 주 광원의 방향이 임계 각도 이상 바뀌었을 때만 빛 방향들을 갱신합니다.
+	// 조명과 그림자가 같은 방향을 쓰고, 그 사이에는 정적 그림자 캐시를 계속 쓸 수 있습니다.
 	XMMATRIX R = XMMatrixRotationY(mLightRotationAngle);
-	for (int i = 0; i < 3; ++i)
+	XMVECTOR mainLightDir = XMVector3TransformNormal(XMLoadFloat3(&mBaseLightDirections[0]), R);
+	if (XMVectorGetX(XMVector3Dot(mainLightDir, XMLoadFloat3(&mRotatedLightDirections[0]))) < cosf(mShadowCacheAngle))
 	{
-		XMVECTOR lightDir = XMLoadFloat3(&mBaseLightDirections[i]);
-		lightDir = XMVector3TransformNormal(lightDir, R);
-		XMStoreFloat3(&mRotatedLightDirections[i], lightDir);
+		for (int i = 0; i < 3; ++i)
+		{
+			XMVECTOR lightDir = XMLoadFloat3(&mBaseLightDirections[i]);
+			lightDir = XMVector3TransformNormal(lightDir, R);
+			XMStoreFloat3(&mRotatedLightDirections[i], lightDir);
+		}
+		InvalidateShadowCache();
 	}
 
     AnimateMaterials(gt);
-    UpdateObjectCBs(gt);
-    UpdateMaterialCBs(gt);
-	UpdateShadowTransform(gt);
-    UpdateMainPassCB(gt);
-    UpdateReflectedPassCB(gt);
-	UpdateShadowPassCB(gt);
-	UpdateSsaoCB(gt);
-
+	UpdateWorldBounds(gt);
+	CullRenderItems(gt);
+
+	// 상수 버퍼 업데이트 단계입니다. 각 작업은 업로드 버퍼의 서로 다른 원소에만 쓰므로 잠금 없이 동시에 실행합니다.
+	// 메인 패스는 그림자 변환을 담으므로 UpdateShadowTransform 뒤에, 반사 패스와 SSAO는 메인 패스 뒤에 실행합니다.
+	concurrency::parallel_invoke(
+		[&] { UpdateObjectCBs(gt); },
+		[&] { UpdateMaterialCBs(gt); },
+		[&]
+		{
+			UpdateShadowTransform(gt);
+			concurrency::parallel_invoke(
+				[&] { CullShadowCasters(gt); },
+				[&] { UpdateShadowPassCB(gt); },
+				[&]
+				{
+					UpdateMainPassCB(gt);
+					concurrency::parallel_invoke(
+						[&] { UpdateReflectedPassCB(gt); },
+						[&] { UpdateSsaoCB(gt); });
+				});
+		});
 }
 
 void ClientMain::Draw(const GameTimer& gt)
@@ -177,40 +246,55 @@ void ClientMain::Draw(const GameTimer& gt)
     ThrowIfFailed(cmdListAlloc->Reset());
 
     // ExecuteCommandList를 통해 커맨드 큐에 제출한 다음에 커맨드 리스트를 리셋할 수 있습니다.
-    ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
+    ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs.Get(mPsoHandles.Opaque).Get()));
+
+	// 파이프라인 상태, 루트 인자, IA 설정은 레코더를 거쳐 중복 호출을 걸러냅니다.
+	mRecorder.Begin(mCommandList.Get(), mPSOs.Get(mPsoHandles.Opaque).Get());
 
 	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
     mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
 
-    mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
+    mRecorder.SetGraphicsRootSignature(mRootSignature.Get());
 
 	auto matBuffer = mCurrFrameResource->MaterialCB->Resource();
-	mCommandList->SetGraphicsRootShaderResourceView(2, matBuffer->GetGPUVirtualAddress());
+	mRecorder.SetGraphicsRootShaderResourceView(2, matBuffer->GetGPUVirtualAddress());
+
+#ifdef PACKED_OBJECT_DATA
+	// 물체 데이터 버퍼는 패스 전체에 한 번만 묶고, 아이템마다 인덱스만 루트 상수로 바꿉니다.
+	auto objectBuffer = mCurrFrameResource->ObjectCB->Resource();
+	mRecorder.SetGraphicsRootShaderResourceView(5, objectBuffer->GetGPUVirtualAddress());
+#endif
 
 	// Bind null SRV for shadow map pass.
-	mCommandList->SetGraphicsRootDescriptorTable(3, mNullSrv);
+	mRecorder.SetGraphicsRootDescriptorTable(3, mNullSrv);
 
 	// Bind all the textures used in this scene.  Observe
 	// that we only have to specify the first descriptor in the table.  
 	// The root signature knows how many descriptors are expected in the table.
-	mCommandList->SetGraphicsRootDescriptorTable(4, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	mRecorder.SetGraphicsRootDescriptorTable(4, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
 
 	DrawSceneToShadowMap();
 
 	DrawNormalsAndDepth();
 
-	mCommandList->SetGraphicsRootSignature(mSsaoRootSignature.Get());
+	mRecorder.SetGraphicsRootSignature(mSsaoRootSignature.Get());
 	mSsao->ComputeSsao(mCommandList.Get(), mCurrFrameResource, 3);
-	
 
-	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
+	// Ssao는 커맨드 리스트에 직접 상태를 기록하므로 레코더가 기억하는 상태를 버립니다.
+	mRecorder.Invalidate();
+
+	mRecorder.SetGraphicsRootSignature(mRootSignature.Get());
 
 
 	// Bind all the materials used in this scene.  For structured buffers, we can bypass the heap and 
 	// set as a root descriptor.
 
 	matBuffer = mCurrFrameResource->MaterialCB->Resource();
-	mCommandList->SetGraphicsRootShaderResourceView(2, matBuffer->GetGPUVirtualAddress());
+	mRecorder.SetGraphicsRootShaderResourceView(2, matBuffer->GetGPUVirtualAddress());
+
+#ifdef PACKED_OBJECT_DATA
+	mRecorder.SetGraphicsRootShaderResourceView(5, objectBuffer->GetGPUVirtualAddress());
+#endif
 
 
 	mCommandList->RSSetViewports(1, &mScreenViewport);
@@ -228,53 +312,83 @@ void ClientMain::Draw(const GameTimer& gt)
 	// 어디에 렌더링을 할지 설정합니다.
 	mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
 
-	auto passCB = mCurrFrameResource->PassCB->Resource();
-	mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
+	mRecorder.SetGraphicsRootConstantBufferView(1, mCurrPassCB.ElementGpuAddress(0));
 
 	//auto matBuffer = mCurrFrameResource->MaterialCB->Resource();
 	//mCommandList->SetGraphicsRootShaderResourceView(2, matBuffer->GetGPUVirtualAddress());
 
 	CD3DX12_GPU_DESCRIPTOR_HANDLE skyTexDescriptor(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
 	skyTexDescriptor.Offset(mSkyTexHeapIndex, mCbvSrvDescriptorSize);
-	mCommandList->SetGraphicsRootDescriptorTable(3, skyTexDescriptor);
-
-	mCommandList->SetGraphicsRootDescriptorTable(4, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	mRecorder.SetGraphicsRootDescriptorTable(3, skyTexDescriptor);
 
-    UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
+	mRecorder.SetGraphicsRootDescriptorTable(4, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
 
     // 불투명한 항목 (바닥, 벽, 상자등을 그린다.)
-	mCommandList->SetPipelineState(mPSOs["opaque"].Get());
-    DrawRenderItems(mCommandList.Get(), mRenderItems[(int)RenderLayer::Opaque]);
+	mRecorder.SetPipelineState(mPSOs.Get(mPsoHandles.Opaque).Get());
+    DrawRenderItems(mRecorder, mVisibleRitems[(int)RenderLayer::Opaque]);
 
-	mCommandList->SetPipelineState(mPSOs["sky"].Get());
-	DrawRenderItems(mCommandList.Get(), mRenderItems[(int)RenderLayer::Sky]);
+	mRecorder.SetPipelineState(mPSOs.Get(mPsoHandles.Sky).Get());
+	DrawRenderItems(mRecorder, mVisibleRitems[(int)RenderLayer::Sky]);
 
-	mCommandList->SetPipelineState(mPSOs["debug"].Get());
-	DrawRenderItems(mCommandList.Get(), mRenderItems[(int)RenderLayer::Debug]);
+	mRecorder.SetPipelineState(mPSOs.Get(mPsoHandles.Debug).Get());
+	DrawRenderItems(mRecorder, mVisibleRitems[(int)RenderLayer::Debug]);
 
-    // 가시적 거울 픽셀들을 스텐실 버퍼 1로 표시해 둔다.
-    mCommandList->OMSetStencilRef(1);
-    mCommandList->SetPipelineState(mPSOs["markStencilMirrors"].Get());
-    DrawRenderItems(mCommandList.Get(), mRenderItems[(int)RenderLayer::Mirrors]);
+    // 보이는 거울이 없으면 스텐실 표시와 반사 패스를 건너뛴다. 있으면 두 패스를 거울의 화면 사각형으로 자른다.
+    if (!mVisibleRitems[(int)RenderLayer::Mirrors].empty())
+    {
+        mCommandList->RSSetScissorRects(1, &mMirrorScissorRect);
+
+        // 가시적 거울 픽셀들을 스텐실 버퍼 1로 표시해 둔다.
+        mCommandList->OMSetStencilRef(1);
+        mRecorder.SetPipelineState(mPSOs.Get(mPsoHandles.MarkStencilMirrors).Get());
+        DrawRenderItems(mRecorder, mVisibleRitems[(int)RenderLayer::Mirrors]);
+
+        // 반사상을 거울 영역에만 그린다. (스텐실 버퍼 항목이 1인 픽셀들만 그려지게 한다) 이전과 다른 패스별 상수 버퍼를 지정해야 함을 주목하자.
+        // 반사 패스 상수 버퍼에는 거울 평면에 대한 반사 행렬과 반사된 광원 설정이 담겨 있어서, 원래 아이템을 그대로 다시 그린다.
+        // 반사하면 삼각형의 감김 순서가 뒤집히므로 이 PSO는 FrontCounterClockwise로 앞면을 판단한다.
+        mRecorder.SetGraphicsRootConstantBufferView(1, mCurrPassCB.ElementGpuAddress(ReflectedPassIndex));
+        mRecorder.SetPipelineState(mPSOs.Get(mPsoHandles.DrawStencilReflections).Get());
+        DrawRenderItems(mRecorder, mVisibleRitems[(int)RenderLayer::Reflected]);
+
+        // Restore main pass constants, stencil ref and scissor rect.
+        mRecorder.SetGraphicsRootConstantBufferView(1, mCurrPassCB.ElementGpuAddress(0));
+        mCommandList->OMSetStencilRef(0);
+        mCommandList->RSSetScissorRects(1, &mScissorRect);
+    }
 
-    // 반사상을 거울 영역에만 그린다. (스텐실 버퍼 항목이 1인 픽셀들만 그려지게 한다) 이전과 다른 패스별 살수 버퍼를 지정해야 함을 주목하자.
-    // 거울 평면에 대해 반사된 광원 설정을 담은 패스별 상수 버퍼를 지정한다.
-    //mCommandList->SetGraphicsRootConstantBufferView(0, passCB->GetGPUVirtualAddress() + 1 * passCBByteSize);
-    mCommandList->SetPipelineState(mPSOs["drawStencilReflections"].Get());
-    DrawRenderItems(mCommandList.Get(), mRenderItems[(int)RenderLayer::Reflected]);
+    // Draw mirror with transparency so reflection blends through.
+    mRecorder.SetPipelineState(mPSOs.Get(mPsoHandles.Transparent).Get());
+    DrawRenderItems(mRecorder, mVisibleRitems[(int)RenderLayer::Transparent], true);
 
-    // Restore main pass constants and stencil ref.
-    mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
-    mCommandList->OMSetStencilRef(0);
 
-    // Draw mirror with transparency so reflection blends through.
-    mCommandList->SetPipelineState(mPSOs["transparent"].Get());
-    DrawRenderItems(mCommandList.Get(), mRenderItems[(int)RenderLayer::Transparent]);
+    mRecorder.SetPipelineState(mPSOs.Get(mPsoHandles.AlphaTested).Get());
+    DrawRenderItems(mRecorder, mVisibleRitems[(int)RenderLayer::AlphaTested]);
+
+
+    mCullStats.CommandsIssued = mRecorder.GetStats().Issued;
+    mCullStats.CommandsElided = mRecorder.GetStats().Elided;
 
+    // 그리기 호출 수나 선택한 아이템이 바뀔 때만 창 제목을 고칩니다. CalculateFrameStats가 이 제목 뒤에 fps를 붙입니다.
+    if (mCaptionDirty || mCullStats.DrawCalls != mShownDrawCalls || mCullStats.DrawItems != mShownDrawItems)
+    {
+        mCaptionDirty = false;
+        mShownDrawCalls = mCullStats.DrawCalls;
+        mShownDrawItems = mCullStats.DrawItems;
+        mMainWndCaption = mBaseWndCaption +
+            L"    draws: " + std::to_wstring(mShownDrawCalls) +
+            L"   items: " + std::to_wstring(mShownDrawItems);
+
+        if (mPickedRitem != nullptr)
+        {
+            mMainWndCaption += L"   picked: item " + std::to_wstring(mPickedRitem->ItemIndex);
 
-    mCommandList->SetPipelineState(mPSOs["alphaTested"].Get());
-    DrawRenderItems(mCommandList.Get(), mRenderItems[(int)RenderLayer::AlphaTested]);
+            // 삼각형 BVH가 없는 아이템은 경계 상자로만 선택됩니다.
+            if (mPickedRitem->PickBvh != nullptr)
+                mMainWndCaption += L" tri " + std::to_wstring(mPickedHit.Triangle);
 
+            mMainWndCaption += L" dist " + std::to_wstring((int)mPickedHit.T);
+        }
+    }
 
     // 리소스의 상태를 출력할 수 있도록 변경합니다.
     mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -299,6 +413,9 @@ void ClientMain::Draw(const GameTimer& gt)
     // 어플리케이션은 GPU 시간축에 있지 않기 때문에,
     // GPU가 모든 커맨드들의 처리가 완료되기 전까지 Signal()을 처리하지 않습니다.
     mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+
+    // 이번 프레임에 링에서 받은 메모리는 이 펜스 지점을 지나야 재사용됩니다.
+    mUploadRing->FinishFrame(mCurrentFence);
 }
 
 void ClientMain::OnMouseDown(WPARAM btnState, int x, int y)
@@ -306,6 +423,9 @@ void ClientMain::OnMouseDown(WPARAM btnState, int x, int y)
     mLastMousePos.x = x;
     mLastMousePos.y = y;
 
+	if ((btnState & MK_RBUTTON) != 0)
+		Pick(x, y);
+
     SetCapture(mhMainWnd);
 }
 
@@ -352,6 +472,12 @@ void ClientMain::OnKeyboardInput(const GameTimer& gt)
 	if (GetAsyncKeyState('D') & 0x8000)
 		mCamera.Strafe(10.0f * dt);
 
+	// N을 누를 때마다 카메라 앞에 구를 하나 만듭니다.
+	bool spawnKeyDown = (GetAsyncKeyState('N') & 0x8000) != 0;
+	if (spawnKeyDown && !mSpawnKeyDown)
+		SpawnSphere();
+	mSpawnKeyDown = spawnKeyDown;
+
 	mCamera.UpdateViewMatrix();
 
 
@@ -365,122 +491,751 @@ void ClientMain::AnimateMaterials(const GameTimer& gt)
 {
 }
 
+void ClientMain::AssignItemIndices(RenderItem* ri, UINT index)
+{
+	ri->ItemIndex = index;
+	ri->ObjCBIndex = index;
+
+	// 같은 지오메트리의 같은 구간을 그리는 아이템은 같은 서브메쉬 번호를 받아 인스턴싱으로 묶일 수 있습니다.
+	auto key = std::make_tuple(ri->GeoIndex, ri->PrimitiveType, ri->IndexCount, ri->StartIndexLocation, ri->BaseVertexLocation);
+	ri->SubmeshIndex = mSubmeshIndices.emplace(key, (UINT)mSubmeshIndices.size()).first->second;
+}
+
+RenderItem* ClientMain::AddRenderItem(std::unique_ptr<RenderItem> ritem, std::initializer_list<RenderLayer> layers)
+{
+	RenderItem* ri = ritem.get();
+	const UINT count = (UINT)mAllRitems.size() + 1;
+	AssignItemIndices(ri, count - 1);
+
+	// 정적 그림자 캐시는 시작할 때 구워 두었으므로 새 아이템은 동적 캐스터로 매 프레임 덧그립니다.
+	ri->StaticCaster = false;
+
+	bool inSceneBounds = true;
+	for (RenderLayer layer : layers)
+	{
+		mRenderItems[(int)layer].push_back(ri);
+		inSceneBounds = inSceneBounds && layer != RenderLayer::Sky && layer != RenderLayer::Debug;
+	}
+	mAllRitems.push_back(std::move(ritem));
+
+	// 아이템별 저장소들은 기존 내용을 유지한 채 늘립니다. 새 인덱스는 모든 프레임 리소스에서 더티로 시작합니다.
+	mObjectDirty.Grow(count);
+	mTransforms.Resize(count);
+	mItemVisible.resize(count, 1);
+	mCasterVisible.resize(count, 0);
+	MarkRitemDirty(ri);
+
+	ri->WorldBounds = BoundsUtil::TransformBox(ri->Bounds, XMLoadFloat4x4(&ri->World));
+	if (inSceneBounds)
+		mSceneBvh.Insert(ri->ItemIndex, ri->WorldBounds);
+
+	return ri;
+}
+
+void ClientMain::SpawnSphere()
+{
+	XMVECTOR pos = mCamera.GetPosition() + 5.0f * mCamera.GetLook();
+
+	auto sphereRitem = std::make_unique<RenderItem>();
+	XMStoreFloat4x4(&sphereRitem->World, XMMatrixTranslationFromVector(pos));
+	sphereRitem->TexTransform = MathHelper::Identity4x4();
+	sphereRitem->Geo = mGeometries.Get(mSpawnGeo).get();
+	sphereRitem->GeoIndex = mSpawnGeo.Index;
+	sphereRitem->Mat = mMaterials.Get(mSpawnMat).get();
+	sphereRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	sphereRitem->IndexCount = mSpawnSubmesh.IndexCount;
+	sphereRitem->StartIndexLocation = mSpawnSubmesh.StartIndexLocation;
+	sphereRitem->BaseVertexLocation = mSpawnSubmesh.BaseVertexLocation;
+	sphereRitem->Bounds = mSpawnSubmesh.Bounds;
+	sphereRitem->PickBvh = mSpawnBvh;
+
+	AddRenderItem(std::move(sphereRitem), { RenderLayer::Opaque, RenderLayer::Reflected });
+}
+
+void ClientMain::MarkRitemDirty(RenderItem* ri)
+{
+	mTransforms.Set(ri->ItemIndex, XMLoadFloat4x4(&ri->World), XMLoadFloat4x4(&ri->TexTransform), ri->Mat->MatCBIndex);
+	mObjectDirty.MarkDirty(ri->ItemIndex);
+}
+
+void ClientMain::UpdateWorldBounds(const GameTimer& gt)
+{
+	// 지난 프레임 이후에 바뀐 렌더 아이템만 월드 경계를 다시 계산합니다.
+	for (UINT index : mObjectDirty.Changed())
+	{
+		RenderItem* e = mAllRitems[index].get();
+		e->WorldBounds = BoundsUtil::TransformBox(e->Bounds, XMLoadFloat4x4(&e->World));
+		if (mSceneBvh.Contains(e->ItemIndex))
+			mSceneBvh.Update(e->ItemIndex, e->WorldBounds);
+
+		// 시작 이후에 움직인 정적 캐스터는 동적 캐스터로 바꿉니다. 이미 정적 그림자
+		// 캐시에 구워져 있으므로 캐시를 모두 다시 그려야 합니다.
+		if (mSceneStarted && e->StaticCaster)
+		{
+			e->StaticCaster = false;
+			InvalidateShadowCache();
+		}
+	}
+	mObjectDirty.ClearChanged();
+
+	mSceneStarted = true;
+
+	// 움직인 아이템의 조상 노드들만 다시 맞춥니다. 트리가 많이 나빠지면 Refit이 다시 빌드합니다.
+	mSceneBvh.Refit();
+
+	// 하늘 구와 화면 공간 디버그 쿼드는 장면 경계에서 제외합니다.
+	std::vector<BoundingBox> boxes;
+	boxes.reserve(mAllRitems.size());
+	for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		if (layer == (int)RenderLayer::Sky || layer == (int)RenderLayer::Debug)
+			continue;
+
+		for (auto ri : mRenderItems[layer])
+			boxes.push_back(ri->WorldBounds);
+	}
+
+	BoundingBox sceneBox = BoundsUtil::MergeBoxes(boxes.data(), boxes.size());
+	BoundingSphere::CreateFromBoundingBox(mSceneBounds, sceneBox);
+}
+
+void ClientMain::CullRenderItems(const GameTimer& gt)
+{
+	XMFLOAT4 planes[6];
+	FrustumCuller::ExtractPlanes(mCamera.GetView() * mCamera.GetProj(), planes);
+
+	mBvhResults.clear();
+	mSceneBvh.QueryFrustum(planes, mBvhResults);
+
+	std::fill(mItemVisible.begin(), mItemVisible.end(), (std::uint8_t)0);
+	for (UINT id : mBvhResults)
+		mItemVisible[id] = 1;
+
+	mCullStats = CullStats();
+	mCullStats.Tested = mSceneBvh.GetStats().NodesVisited;
+	mCullStats.Visible = (UINT)mBvhResults.size();
+
+	CullOccludedItems();
+
+	for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		auto& visible = mVisibleRitems[layer];
+		visible.clear();
+
+		// 하늘과 화면 공간 디버그 쿼드는 항상 그립니다.
+		// 반사 레이어는 CullMirrors에서 반사된 경계로 따로 검사합니다.
+		if (layer == (int)RenderLayer::Sky || layer == (int)RenderLayer::Debug || layer == (int)RenderLayer::Reflected)
+		{
+			visible = mRenderItems[layer];
+		}
+		else
+		{
+			for (auto ri : mRenderItems[layer])
+			{
+				if (mItemVisible[ri->ItemIndex])
+					visible.push_back(ri);
+			}
+		}
+
+		mCullStats.LayerVisible[layer] = (UINT)visible.size();
+	}
+
+	CullMirrors(planes);
+	SortVisibleItems();
+}
+
+void ClientMain::SortVisibleItems()
+{
+	// 모든 레이어의 보이는 아이템을 레이어, PSO, 기하 구조, 재질, 깊이로 만든 64비트 키로 한 번에 기수 정렬합니다.
+	// 불투명 레이어는 상태가 같은 것끼리 모이고 그 안에서 가까운 것부터, 투명 레이어는 먼 것부터 그려집니다.
+	XMMATRIX view = mCamera.GetView();
+	float nearZ = mCamera.GetNearZ();
+	float invDepthRange = 1.0f / (mCamera.GetFarZ() - nearZ);
+
+	mRenderQueue.Clear();
+	for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		for (auto ri : mVisibleRitems[layer])
+		{
+			XMVECTOR centerV = XMVector3TransformCoord(XMLoadFloat3(&ri->WorldBounds.Center), view);
+			float depth = (XMVectorGetZ(centerV) - nearZ) * invDepthRange;
+
+			mRenderQueue.Push(layer, mLayerPso[layer], ri->GeoIndex, ri->Mat->MatCBIndex, depth, ri->ItemIndex);
+		}
+		mVisibleRitems[layer].clear();
+	}
+
+	mRenderQueue.Sort();
+
+	// 정렬된 순서는 레이어별로 묶여 있으므로 그대로 레이어 목록에 다시 나눠 담습니다.
+	for (UINT i = 0; i < mRenderQueue.Size(); ++i)
+		mVisibleRitems[mRenderQueue.Layer(i)].push_back(mAllRitems[mRenderQueue.Item(i)].get());
+
+	const auto& stats = mRenderQueue.GetStats();
+	mCullStats.DrawStateChanges = stats.StateChangesSorted;
+	mCullStats.DrawStateChangesAvoided = stats.StateChangesUnsorted > stats.StateChangesSorted ?
+		stats.StateChangesUnsorted - stats.StateChangesSorted : 0;
+}
+
+void ClientMain::CullOccludedItems()
+{
+	mOcclusionCuller.BeginFrame(mCamera.GetView() * mCamera.GetProj());
+
+	// Occluder로 표시된 아이템 중 보이는 것만 가림막으로 사용합니다. 장면에서는 벽돌 기둥이 여기에 해당합니다.
+	// 알파 테스트 상자는 구멍이 뚫려 있고 투명한 거울은 뒤를 비추므로 표시하지 않습니다.
+	for (auto ri : mOccluders)
+	{
+		if (!mItemVisible[ri->ItemIndex])
+			continue;
+
+		MeshGeometry* geo = ri->Geo;
+		const Vertex* vertices = (const Vertex*)geo->VertexBufferCPU->GetBufferPointer();
+		const BYTE* indices = (const BYTE*)geo->IndexBufferCPU->GetBufferPointer();
+		XMMATRIX world = XMLoadFloat4x4(&ri->World);
+
+		if (geo->IndexFormat == DXGI_FORMAT_R16_UINT)
+		{
+			mOcclusionCuller.AddOccluder(&vertices[0].Pos, sizeof(Vertex),
+				(const std::uint16_t*)indices + ri->StartIndexLocation, ri->IndexCount, ri->BaseVertexLocation, world);
+		}
+		else
+		{
+			mOcclusionCuller.AddOccluder(&vertices[0].Pos, sizeof(Vertex),
+				(const std::uint32_t*)indices + ri->StartIndexLocation, ri->IndexCount, ri->BaseVertexLocation, world);
+		}
+	}
+
+	mOcclusionCuller.Rasterize();
+
+	// 거울 속 아이템은 거울을 통해서 보이므로 실제 장면의 가림막으로 판단하지 않습니다.
+	mOcclusionItems.clear();
+	mOcclusionBoxes.clear();
+	for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		if (layer == (int)RenderLayer::Sky || layer == (int)RenderLayer::Debug || layer == (int)RenderLayer::Reflected)
+			continue;
+
+		for (auto ri : mRenderItems[layer])
+		{
+			if (!mItemVisible[ri->ItemIndex])
+				continue;
+
+			mOcclusionItems.push_back(ri);
+			mOcclusionBoxes.push_back(ri->WorldBounds);
+		}
+	}
+
+	mOcclusionVisible.resize(mOcclusionItems.size());
+	mOcclusionCuller.TestBoxes(mOcclusionBoxes.data(), (UINT)mOcclusionBoxes.size(), mOcclusionVisible.data());
+
+	for (size_t i = 0; i < mOcclusionItems.size(); ++i)
+	{
+		if (!mOcclusionVisible[i] && mItemVisible[mOcclusionItems[i]->ItemIndex])
+		{
+			mItemVisible[mOcclusionItems[i]->ItemIndex] = 0;
+			++mCullStats.Occluded;
+		}
+	}
+}
+
+void ClientMain::CullMirrors(const XMFLOAT4 cameraPlanes[6])
+{
+	XMMATRIX viewProj = mCamera.GetView() * mCamera.GetProj();
+	XMVECTOR eye = mCamera.GetPosition();
+
+	mMirrorPortals.clear();
+
+	float minNdcX = 1.0f, minNdcY = 1.0f;
+	float maxNdcX = -1.0f, maxNdcY = -1.0f;
+
+	auto& mirrors = mVisibleRitems[(int)RenderLayer::Mirrors];
+	size_t keptMirrors = 0;
+	for (auto ri : mirrors)
+	{
+		// 거울은 평평하므로 월드 경계 상자의 가장 얇은 축을 법선으로 보고 상자 가운데 단면의 네 모서리를 거울 사각형으로 씁니다.
+		const float center[3] = { ri->WorldBounds.Center.x, ri->WorldBounds.Center.y, ri->WorldBounds.Center.z };
+		const float extents[3] = { ri->WorldBounds.Extents.x, ri->WorldBounds.Extents.y, ri->WorldBounds.Extents.z };
+		int axis = 2;
+		if (extents[0] <= extents[1] && extents[0] <= extents[2])
+			axis = 0;
+		else if (extents[1] <= extents[2])
+			axis = 1;
+		int u = (axis + 1) % 3;
+		int v = (axis + 2) % 3;
+
+		const float signU[4] = { -1.0f, +1.0f, +1.0f, -1.0f };
+		const float signV[4] = { -1.0f, -1.0f, +1.0f, +1.0f };
+		XMVECTOR corners[4];
+		XMFLOAT4 clip[4];
+		for (int k = 0; k < 4; ++k)
+		{
+			float p[3] = { center[0], center[1], center[2] };
+			p[u] += signU[k] * extents[u];
+			p[v] += signV[k] * extents[v];
+			corners[k] = XMVectorSet(p[0], p[1], p[2], 1.0f);
+			XMStoreFloat4(&clip[k], XMVector4Transform(corners[k], viewProj));
+		}
+
+		// 근평면(z >= 0) 뒤쪽을 잘라낸 뒤에 투영합니다. 카메라 뒤로 넘어간 모서리가 있어도 사각형이 뒤집히지 않습니다.
+		XMFLOAT4 poly[8];
+		int polyCount = 0;
+		for (int k = 0; k < 4; ++k)
+		{
+			const XMFLOAT4& a = clip[k];
+			const XMFLOAT4& b = clip[(k + 1) % 4];
+			if (a.z >= 0.0f)
+				poly[polyCount++] = a;
+			if ((a.z >= 0.0f) != (b.z >= 0.0f))
+			{
+				float t = a.z / (a.z - b.z);
+				poly[polyCount++] = XMFLOAT4(a.x + t * (b.x - a.x), a.y + t * (b.y - a.y), 0.0f, a.w + t * (b.w - a.w));
+			}
+		}
+		if (polyCount < 3)
+			continue;
+
+		float x0 = 1.0f, y0 = 1.0f, x1 = -1.0f, y1 = -1.0f;
+		for (int k = 0; k < polyCount; ++k)
+		{
+			float x = poly[k].x / poly[k].w;
+			float y = poly[k].y / poly[k].w;
+			x0 = std::min<float>(x0, x);
+			y0 = std::min<float>(y0, y);
+			x1 = std::max<float>(x1, x);
+			y1 = std::max<float>(y1, y);
+		}
+		x0 = std::max<float>(x0, -1.0f);
+		y0 = std::max<float>(y0, -1.0f);
+		x1 = std::min<float>(x1, 1.0f);
+		y1 = std::min<float>(y1, 1.0f);
+		if (x0 >= x1 || y0 >= y1)
+			continue;
+
+		minNdcX = std::min<float>(minNdcX, x0);
+		minNdcY = std::min<float>(minNdcY, y0);
+		maxNdcX = std::max<float>(maxNdcX, x1);
+		maxNdcY = std::max<float>(maxNdcY, y1);
+
+		// 눈과 거울의 인접한 두 모서리를 지나는 평면 네 개로 포털 절두체를 만듭니다. 거울 가운데가 안쪽이 되도록 방향을 맞춥니다.
+		// 반사된 아이템이 이 절두체 밖에 있으면 거울 픽셀 위로 투영되지 않으므로 스텐실에 모두 걸러집니다.
+		MirrorPortal portal;
+		XMVECTOR mirrorCenter = XMVectorSet(center[0], center[1], center[2], 1.0f);
+		for (int k = 0; k < 4; ++k)
+		{
+			XMVECTOR plane = XMPlaneFromPoints(eye, corners[k], corners[(k + 1) % 4]);
+			if (XMVectorGetX(XMPlaneDotCoord(plane, mirrorCenter)) < 0.0f)
+				plane = XMVectorNegate(plane);
+			XMStoreFloat4(&portal.Planes[k], plane);
+		}
+
+		// 거울 평면이 근평면입니다. 반사된 아이템은 눈에서 볼 때 거울 너머에 있어야 합니다.
+		XMVECTOR mirrorPlane = XMLoadFloat4(&mMirrorPlane);
+		if (XMVectorGetX(XMPlaneDotCoord(mirrorPlane, eye)) > 0.0f)
+			mirrorPlane = XMVectorNegate(mirrorPlane);
+		XMStoreFloat4(&portal.Planes[4], mirrorPlane);
+
+		mMirrorPortals.push_back(portal);
+
+		mirrors[keptMirrors++] = ri;
+	}
+	mirrors.resize(keptMirrors);
+	mCullStats.MirrorsVisible = (UINT)keptMirrors;
+	mCullStats.LayerVisible[(int)RenderLayer::Mirrors] = (UINT)keptMirrors;
+
+	if (!mMirrorPortals.empty())
+	{
+		mMirrorScissorRect.left = (LONG)floorf((minNdcX * 0.5f + 0.5f) * mClientWidth);
+		mMirrorScissorRect.right = (LONG)ceilf((maxNdcX * 0.5f + 0.5f) * mClientWidth);
+		mMirrorScissorRect.top = (LONG)floorf((0.5f - maxNdcY * 0.5f) * mClientHeight);
+		mMirrorScissorRect.bottom = (LONG)ceilf((0.5f - minNdcY * 0.5f) * mClientHeight);
+	}
+	else
+	{
+		mMirrorScissorRect = {};
+	}
+
+	// 반사 패스는 원래 아이템을 반사 행렬과 함께 다시 그리므로, 월드 경계를 거울 평면에 대해 반사한 상자로 검사합니다.
+	// 카메라 절두체와 포털 절두체를 모두 통과해야 하며, 거울이 여러 개면 포털은 하나만 통과하면 됩니다.
+	auto insidePlanes = [](const XMFLOAT4* planes, int planeCount, const BoundingBox& box)
+	{
+		for (int k = 0; k < planeCount; ++k)
+		{
+			const XMFLOAT4& p = planes[k];
+			float dist = p.x * box.Center.x + p.y * box.Center.y + p.z * box.Center.z + p.w;
+			float radius = fabsf(p.x) * box.Extents.x + fabsf(p.y) * box.Extents.y + fabsf(p.z) * box.Extents.z;
+			if (dist + radius < 0.0f)
+				return false;
+		}
+		return true;
+	};
+
+	XMMATRIX R = XMMatrixReflect(XMLoadFloat4(&mMirrorPlane));
+
+	auto& reflected = mVisibleRitems[(int)RenderLayer::Reflected];
+	size_t keptReflected = 0;
+	for (auto ri : reflected)
+	{
+		BoundingBox box = BoundsUtil::TransformBox(ri->WorldBounds, R);
+		if (!insidePlanes(cameraPlanes, 6, box))
+			continue;
+
+		for (const auto& portal : mMirrorPortals)
+		{
+			if (insidePlanes(portal.Planes, 5, box))
+			{
+				reflected[keptReflected++] = ri;
+				break;
+			}
+		}
+	}
+	mCullStats.ReflectedCulled = (UINT)(reflected.size() - keptReflected);
+	reflected.resize(keptReflected);
+	mCullStats.LayerVisible[(int)RenderLayer::Reflected] = (UINT)keptReflected;
+}
+
+void ClientMain::BuildSceneBvh()
+{
+	// 하늘 구와 화면 공간 디버그 쿼드는 BVH에 넣지 않습니다. 컬링에서 항상 그려집니다.
+	// 한 아이템이 여러 레이어에 들어 있을 수 있으므로 한 번만 추가합니다.
+	std::vector<std::uint8_t> added(mAllRitems.size(), 0);
+	std::vector<UINT> ids;
+	std::vector<BoundingBox> boxes;
+	for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		if (layer == (int)RenderLayer::Sky || layer == (int)RenderLayer::Debug)
+			continue;
+
+		for (auto ri : mRenderItems[layer])
+		{
+			if (added[ri->ItemIndex])
+				continue;
+			added[ri->ItemIndex] = 1;
+
+			ri->WorldBounds = BoundsUtil::TransformBox(ri->Bounds, XMLoadFloat4x4(&ri->World));
+			ids.push_back(ri->ItemIndex);
+			boxes.push_back(ri->WorldBounds);
+		}
+	}
+
+	mSceneBvh.Build(ids.data(), boxes.data(), (UINT)ids.size());
+}
+
+void ClientMain::Pick(int sx, int sy)
+{
+	XMFLOAT4X4 P = mCamera.GetProj4x4f();
+
+	// 픽셀 좌표를 시야 공간의 광선으로 바꿉니다.
+	float vx = (+2.0f * sx / mClientWidth - 1.0f) / P(0, 0);
+	float vy = (-2.0f * sy / mClientHeight + 1.0f) / P(1, 1);
+
+	XMVECTOR rayOrigin = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+	XMVECTOR rayDir = XMVectorSet(vx, vy, 1.0f, 0.0f);
+
+	// 월드 공간으로 옮깁니다.
+	XMMATRIX V = mCamera.GetView();
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(V), V);
+	rayOrigin = XMVector3TransformCoord(rayOrigin, invView);
+	rayDir = XMVector3Normalize(XMVector3TransformNormal(rayDir, invView));
+
+	mBvhRayHits.clear();
+	mSceneBvh.QueryRay(rayOrigin, rayDir, MathHelper::Infinity, mBvhRayHits);
+
+	// 빈 곳을 눌러도 이전 선택이 지워지도록 항상 제목을 갱신합니다.
+	mCaptionDirty = true;
+
+	// 경계 상자에 들어가는 거리 순으로 삼각형을 검사합니다.
+	// 다음 상자가 지금까지 찾은 가장 가까운 교점보다 멀면 멈춥니다.
+	mPickedRitem = nullptr;
+	float bestT = MathHelper::Infinity;
+	for (const auto& boxHit : mBvhRayHits)
+	{
+		if (boxHit.first > bestT)
+			break;
+
+		RenderItem* ri = mAllRitems[boxHit.second].get();
+		if (ri->PickBvh == nullptr)
+		{
+			bestT = boxHit.first;
+			mPickedRitem = ri;
+			mPickedHit = MeshBvh::Hit();
+			mPickedHit.T = bestT;
+			continue;
+		}
+
+		// 광선을 메쉬의 로컬 공간으로 옮깁니다. 방향을 정규화하지 않으므로
+		// 로컬 공간의 t가 월드 공간의 거리와 같습니다.
+		XMMATRIX W = XMLoadFloat4x4(&ri->World);
+		XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(W), W);
+		XMVECTOR localOrigin = XMVector3TransformCoord(rayOrigin, invWorld);
+		XMVECTOR localDir = XMVector3TransformNormal(rayDir, invWorld);
+
+		MeshBvh::Hit hit;
+		if (ri->PickBvh->Intersect(localOrigin, localDir, bestT, hit))
+		{
+			bestT = hit.T;
+			mPickedRitem = ri;
+			mPickedHit = hit;
+		}
+	}
+}
+
 void ClientMain::UpdateObjectCBs(const GameTimer& gt)
 {
-    auto currObjectCB = mCurrFrameResource->ObjectCB.get();
-    for (auto& e : mAllRitems)
-    {
-        // 상수들이 바뀌었 때만 상수 버퍼 데이터를 업데이트 합니다.
-        // 이것은 매 프레임 자원마다 수행해야 합니다.
-        if (e->NumFramesDirty > 0)
-        {
-            XMMATRIX world = XMLoadFloat4x4(&e->World);
-			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+#ifdef PACKED_OBJECT_DATA
+    static_assert(sizeof(ObjectData) == TransformStore::PackedObjectDataByteSize, "TransformStore writes the ObjectData layout");
+    const TransformStore::Layout layout = TransformStore::Layout::PackedObjectData;
+#else
+    static_assert(sizeof(ObjectConstants) == TransformStore::ObjectConstantsByteSize, "TransformStore writes the cbPerObject layout");
+    const TransformStore::Layout layout = TransformStore::Layout::ObjectConstants;
+#endif
 
-            ObjectConstants objConstants;
-            XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
-			objConstants.MaterialIndex = e->Mat->MatCBIndex;
-            currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+    auto currObjectCB = mCurrFrameResource->ObjectCB.get();
 
-            // 다음 프레임 리소스도 마찬가지로 업데이트 되어야 합니다.
-            e->NumFramesDirty--;
-        }
-    }
+    // 이 프레임 리소스가 마지막으로 쓰인 뒤에 바뀐 아이템들만 상수 버퍼를 업데이트 합니다.
+    // 다른 프레임 리소스들은 각자의 목록을 가지고 있어서 차례가 오면 마찬가지로 업데이트 됩니다.
+    // 모두 바뀌었으면 인덱스 목록 없이 처음부터 순서대로 씁니다.
+    // 목록을 일정한 크기의 덩어리로 나눠서 작업 스레드들이 나눠 씁니다. 인덱스가 겹치지 않으므로 잠금이 필요 없습니다.
+    // 일부만 바뀌었으면 목록을 인덱스 순으로 정렬해서 매핑된 메모리에 주소 순서대로 쓰게 합니다.
+    const bool all = mObjectDirty.Pending(mCurrFrameResourceIndex).size() == mTransforms.Size();
+    if (!all)
+        mObjectDirty.SortPending(mCurrFrameResourceIndex);
+    const auto& pending = mObjectDirty.Pending(mCurrFrameResourceIndex);
+    const UINT count = (UINT)pending.size();
+    const UINT chunkCount = (count + ObjectUpdateChunkSize - 1) / ObjectUpdateChunkSize;
+    BYTE* mappedData = currObjectCB->MappedData();
+    UINT stride = currObjectCB->ElementByteSize();
+
+    concurrency::parallel_for(0u, chunkCount, [&](UINT chunk)
+    {
+        UINT first = chunk * ObjectUpdateChunkSize;
+        UINT chunkSize = std::min<UINT>(ObjectUpdateChunkSize, count - first);
+        if (all)
+            mTransforms.StreamRange(first, chunkSize, mappedData, stride, layout);
+        else
+            mTransforms.StreamGather(pending.data() + first, chunkSize, mappedData, stride, layout);
+    });
+    mObjectDirty.ClearPending(mCurrFrameResourceIndex);
 }
 
 void ClientMain::UpdateMaterialCBs(const GameTimer& gt)
 {
     auto currMaterialCB = mCurrFrameResource->MaterialCB.get();
 
-    for (auto& e : mMaterials)
+    // 재질을 바꾼 곳에서 mMaterialDirty.MarkDirty(MatCBIndex)를 호출합니다.
+    // 물체 상수와 마찬가지로 덩어리로 나눠서 작업 스레드들이 서로 다른 원소를 씁니다.
+    // 덩어리마다 재질 데이터를 지역 배열에 모은 뒤 인덱스 순서대로 한 번에 씁니다.
+    mMaterialDirty.SortPending(mCurrFrameResourceIndex);
+    const auto& pending = mMaterialDirty.Pending(mCurrFrameResourceIndex);
+    const UINT count = (UINT)pending.size();
+    const UINT chunkCount = (count + MaterialUpdateChunkSize - 1) / MaterialUpdateChunkSize;
+
+    concurrency::parallel_for(0u, chunkCount, [&](UINT chunk)
     {
-        Material* mat = e.second.get();
-        if (mat->NumFramesDirty > 0)
+        UINT first = chunk * MaterialUpdateChunkSize;
+        UINT last = std::min<UINT>(first + MaterialUpdateChunkSize, count);
+        MaterialData batch[MaterialUpdateChunkSize];
+        for (UINT i = first; i < last; ++i)
         {
+            Material* mat = mMaterialList[pending[i]];
             XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform); 
 
-			MaterialData matData;
-			matData.DiffuseAlbedo = mat->DiffuseAlbedo;
-			matData.FresnelR0 = mat->FresnelR0;
-			matData.Roughness = mat->Roughness;
-			XMStoreFloat4x4(&matData.MatTransform, XMMatrixTranspose(matTransform));
-			matData.DiffuseMapIndex = mat->DiffuseSrvHeapIndex;
-			matData.NormalMapIndex = mat->NormalSrvHeapIndex;
-
+            MaterialData& matData = batch[i - first];
+            matData.DiffuseAlbedo = mat->DiffuseAlbedo;
+            matData.FresnelR0 = mat->FresnelR0;
+            matData.Roughness = mat->Roughness;
+            XMStoreFloat4x4(&matData.MatTransform, XMMatrixTranspose(matTransform));
+            matData.DiffuseMapIndex = mat->DiffuseSrvHeapIndex;
+            matData.NormalMapIndex = mat->NormalSrvHeapIndex;
+        }
 
-            currMaterialCB->CopyData(mat->MatCBIndex, matData);
+        // mMaterialList는 MatCBIndex 순이므로 pending의 값이 곧 원소 인덱스입니다.
+        currMaterialCB->CopyGather(pending.data() + first, last - first, batch);
+    });
+    mMaterialDirty.ClearPending(mCurrFrameResourceIndex);
 
-            mat->NumFramesDirty--; 
-        }
-    }
+    // 재질은 프레임 리소스 밖에서 변경을 따로 볼 곳이 없습니다.
+    mMaterialDirty.ClearChanged();
 }
 
 void ClientMain::UpdateShadowTransform(const GameTimer& gt)
 {
 	// Only the first "main" light casts a shadow.
 	XMVECTOR lightDir = XMLoadFloat3(&mRotatedLightDirections[0]);
-	XMVECTOR lightPos = -2.0f * mSceneBounds.Radius * lightDir;
-	XMVECTOR targetPos = XMLoadFloat3(&mSceneBounds.Center);
-	XMVECTOR lightUp = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-	XMMATRIX lightView = XMMatrixLookAtLH(lightPos, targetPos, lightUp);
 
-	XMStoreFloat3(&mLightPosW, lightPos);
+	// 모든 캐스케이드가 원점에서 빛 방향을 보는 같은 시야 행렬을 씁니다. 카메라가 움직여도
+	// 빛 공간의 텍셀 격자가 그대로이므로 아래에서 중심을 텍셀 단위로 맞출 수 있습니다.
+	XMVECTOR lightUp = fabsf(XMVectorGetY(lightDir)) > 0.99f ?
+		XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	XMMATRIX lightView = XMMatrixLookToLH(XMVectorZero(), lightDir, lightUp);
+	XMStoreFloat4x4(&mLightView, lightView);
 
-	// Transform bounding sphere to light space.
-	XMFLOAT3 sphereCenterLS;
-	XMStoreFloat3(&sphereCenterLS, XMVector3TransformCoord(targetPos, lightView));
+	XMVECTOR sceneCenter = XMLoadFloat3(&mSceneBounds.Center);
+	XMStoreFloat3(&mLightPosW, sceneCenter - 2.0f * mSceneBounds.Radius * lightDir);
 
-	// Ortho frustum in light space encloses scene.
-	float l = sphereCenterLS.x - mSceneBounds.Radius;
-	float b = sphereCenterLS.y - mSceneBounds.Radius;
-	float n = sphereCenterLS.z - mSceneBounds.Radius;
-	float r = sphereCenterLS.x + mSceneBounds.Radius;
-	float t = sphereCenterLS.y + mSceneBounds.Radius;
-	float f = sphereCenterLS.z + mSceneBounds.Radius;
+	XMFLOAT3 sceneCenterLS;
+	XMStoreFloat3(&sceneCenterLS, XMVector3TransformCoord(sceneCenter, lightView));
 
-	mLightNearZ = n;
-	mLightFarZ = f;
-	XMMATRIX lightProj = XMMatrixOrthographicOffCenterLH(l, r, b, t, n, f);
+	// 분할 거리는 로그 분할과 균등 분할을 섞어서 정합니다. (practical split scheme)
+	float nearZ = mCamera.GetNearZ();
+	float farZ = std::min<float>(mCamera.GetFarZ(), mShadowDistance);
 
-	// Transform NDC space [-1,+1]^2 to texture space [0,1]^2
-	XMMATRIX T(
-		0.5f, 0.0f, 0.0f, 0.0f,
-		0.0f, -0.5f, 0.0f, 0.0f,
-		0.0f, 0.0f, 1.0f, 0.0f,
-		0.5f, 0.5f, 0.0f, 1.0f);
+	float splits[MaxShadowCascades + 1];
+	splits[0] = nearZ;
+	for (int i = 1; i <= MaxShadowCascades; ++i)
+	{
+		float p = (float)i / MaxShadowCascades;
+		float logSplit = nearZ * powf(farZ / nearZ, p);
+		float uniformSplit = nearZ + (farZ - nearZ) * p;
+		splits[i] = mCascadeSplitLambda * logSplit + (1.0f - mCascadeSplitLambda) * uniformSplit;
+	}
 
-	XMMATRIX S = lightView * lightProj * T;
-	XMStoreFloat4x4(&mLightView, lightView);
-	XMStoreFloat4x4(&mLightProj, lightProj);
-	XMStoreFloat4x4(&mShadowTransform, S);
+	XMMATRIX view = mCamera.GetView();
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+	float tanHalfFovY = tanf(0.5f * mCamera.GetFovY());
+	float tanHalfFovX = tanHalfFovY * mCamera.GetAspect();
+
+	// 아틀라스에서 캐스케이드 하나가 차지하는 텍셀 수입니다.
+	float cascadeResolution = 0.5f * mShadowMap->Width();
+
+	for (int i = 0; i < MaxShadowCascades; ++i)
+	{
+		// 시야 공간에서 분할 구간의 8개 꼭짓점을 감싸는 구를 구합니다.
+		XMVECTOR corners[8];
+		for (int k = 0; k < 2; ++k)
+		{
+			float z = splits[i + k];
+			float x = z * tanHalfFovX;
+			float y = z * tanHalfFovY;
+			corners[4 * k + 0] = XMVectorSet(-x, -y, z, 1.0f);
+			corners[4 * k + 1] = XMVectorSet(+x, -y, z, 1.0f);
+			corners[4 * k + 2] = XMVectorSet(-x, +y, z, 1.0f);
+			corners[4 * k + 3] = XMVectorSet(+x, +y, z, 1.0f);
+		}
+
+		XMVECTOR center = XMVectorZero();
+		for (int k = 0; k < 8; ++k)
+			center += corners[k];
+		center /= 8.0f;
+
+		float radius = 0.0f;
+		for (int k = 0; k < 8; ++k)
+			radius = std::max<float>(radius, XMVectorGetX(XMVector3Length(corners[k] - center)));
+
+		// 반지름은 카메라의 회전과 무관하지만, 부동소수 오차로 흔들리지 않도록 올림합니다.
+		radius = ceilf(radius * 16.0f) / 16.0f;
+
+		XMFLOAT3 centerLS;
+		XMStoreFloat3(&centerLS, XMVector3TransformCoord(XMVector3TransformCoord(center, invView), lightView));
+
+		// 깊이 범위는 장면 전체를 포함해서 캐스케이드 밖의 물체도 그림자를 드리우게 합니다.
+		float needNear = std::min<float>(centerLS.z - radius, sceneCenterLS.z - mSceneBounds.Radius);
+		float needFar = std::max<float>(centerLS.z + radius, sceneCenterLS.z + mSceneBounds.Radius);
+
+		// 캐스케이드의 직교 볼륨은 카메라에 맞춘 구를 가드 밴드만큼 넓혀서 잡습니다. 구가 볼륨 안에
+		// 남아 있는 동안에는 볼륨을 옮기지 않으므로 카메라가 조금씩 움직여도 정적 그림자가 유지됩니다.
+		ShadowCascadeCache& cache = mCascadeCache[i];
+		float extent = ceilf(radius * (1.0f + mShadowGuardBand) * 16.0f) / 16.0f;
+		if (!cache.Valid || cache.Radius != extent ||
+			fabsf(centerLS.x - cache.CenterX) + radius > extent ||
+			fabsf(centerLS.y - cache.CenterY) + radius > extent ||
+			needNear < cache.NearZ || needFar > cache.FarZ)
+		{
+			// 중심을 텍셀 크기 단위로 맞춰서 볼륨을 옮겨도 그림자 가장자리가 반짝이지 않게 합니다.
+			float texelSize = 2.0f * extent / cascadeResolution;
+			cache.CenterX = floorf(centerLS.x / texelSize) * texelSize;
+			cache.CenterY = floorf(centerLS.y / texelSize) * texelSize;
+			cache.Radius = extent;
+
+			// 깊이도 같은 비율로 여유를 두고 정수 단위로 넓힙니다.
+			cache.NearZ = floorf(needNear - mShadowGuardBand * radius);
+			cache.FarZ = ceilf(needFar + mShadowGuardBand * radius);
+			cache.Valid = false;
+		}
+
+		float n = cache.NearZ;
+		float f = cache.FarZ;
+		XMMATRIX lightProj = XMMatrixOrthographicOffCenterLH(
+			cache.CenterX - extent, cache.CenterX + extent,
+			cache.CenterY - extent, cache.CenterY + extent, n, f);
+
+		// Transform NDC space [-1,+1]^2 to the cascade's quarter of the atlas in texture space.
+		float offsetX = 0.5f * (i % 2);
+		float offsetY = 0.5f * (i / 2);
+		XMMATRIX T(
+			0.25f, 0.0f, 0.0f, 0.0f,
+			0.0f, -0.25f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			0.25f + offsetX, 0.25f + offsetY, 0.0f, 1.0f);
+
+		XMStoreFloat4x4(&mCascadeProj[i], lightProj);
+		XMStoreFloat4x4(&mShadowTransforms[i], lightView * lightProj * T);
+		mCascadeNearZ[i] = n;
+		mCascadeFarZ[i] = f;
+		mCascadeSplits[i] = splits[i + 1];
+	}
 }
 
-void ClientMain::UpdateMainPassCB(const GameTimer& gt)
+void ClientMain::CullShadowCasters(const GameTimer& gt)
 {
-    XMMATRIX view = mCamera.GetView();
-    XMMATRIX proj = mCamera.GetProj();
+	XMMATRIX lightView = XMLoadFloat4x4(&mLightView);
 
-    XMMATRIX viewProj = XMMatrixMultiply(view, proj);
-    XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
-    XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
-    XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
-	XMMATRIX shadowTransform = XMLoadFloat4x4(&mShadowTransform);
+	for (int i = 0; i < MaxShadowCascades; ++i)
+	{
+		// 캐스케이드의 직교 절두체 평면들입니다. 빛과 절두체 사이의 물체도 그림자를 드리우므로
+		// 가까운 평면은 빛 쪽으로 무한히 밀어냅니다. (항상 통과하는 평면)
+		XMFLOAT4 planes[6];
+		FrustumCuller::ExtractPlanes(lightView * XMLoadFloat4x4(&mCascadeProj[i]), planes);
+		planes[4] = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+
+		mBvhResults.clear();
+		mSceneBvh.QueryFrustum(planes, mBvhResults);
+
+		for (UINT id : mBvhResults)
+			mCasterVisible[id] = 1;
+
+		// 불투명 아이템과 알파 테스트 아이템만 그림자를 드리웁니다.
+		// 반사 레이어는 같은 아이템을 반사 패스에서 다시 그리는 목록이므로 따로 보지 않습니다.
+		auto& staticCasters = mStaticShadowCasters[i];
+		auto& dynamicCasters = mDynamicShadowCasters[i];
+		staticCasters.clear();
+		dynamicCasters.clear();
+		for (int layer : { (int)RenderLayer::Opaque, (int)RenderLayer::AlphaTested })
+		{
+			for (auto ri : mRenderItems[layer])
+			{
+				if (mCasterVisible[ri->ItemIndex])
+					(ri->StaticCaster ? staticCasters : dynamicCasters).push_back(ri);
+			}
+		}
+
+		for (UINT id : mBvhResults)
+			mCasterVisible[id] = 0;
+
+		mCullStats.ShadowCasters[i] = (UINT)(staticCasters.size() + dynamicCasters.size());
+	}
+}
 
-    XMStoreFloat4x4(&mMainPassCB.View, XMMatrixTranspose(view));
-    XMStoreFloat4x4(&mMainPassCB.InvView, XMMatrixTranspose(invView));
-    XMStoreFloat4x4(&mMainPassCB.Proj, XMMatrixTranspose(proj));
-    XMStoreFloat4x4(&mMainPassCB.InvProj, XMMatrixTranspose(invProj));
-    XMStoreFloat4x4(&mMainPassCB.ViewProj, XMMatrixTranspose(viewProj));
-    XMStoreFloat4x4(&mMainPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
-	XMStoreFloat4x4(&mMainPassCB.ShadowTransform, XMMatrixTranspose(shadowTransform));
+void ClientMain::InvalidateShadowCache()
+{
+	for (auto& cache : mCascadeCache)
+		cache.Valid = false;
+}
+
+void ClientMain::UpdateMainPassCB(const GameTimer& gt)
+{
+    // 카메라가 움직이지 않았으면 행렬들은 지난 프레임 값 그대로 둡니다.
+    mMainPassBuilder.Build(mMainPassCB, mCamera.GetView(), mCamera.GetProj(), PassConstantsBuilder::Projection::Perspective);
+
+	for (int i = 0; i < MaxShadowCascades; ++i)
+		XMStoreFloat4x4(&mMainPassCB.ShadowTransforms[i], XMMatrixTranspose(XMLoadFloat4x4(&mShadowTransforms[i])));
+	mMainPassCB.CascadeSplits = XMFLOAT4(mCascadeSplits);
 
 
     mMainPassCB.EyePosW = mCamera.GetPosition3f();
     mMainPassCB.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
-    mMainPassCB.RenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
-    mMainPassCB.NearZ = 1.0f;
-    mMainPassCB.FarZ = 1000.0f;
+    mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
+    mMainPassCB.NearZ = mCamera.GetNearZ();
+    mMainPassCB.FarZ = mCamera.GetFarZ();
     mMainPassCB.TotalTime = gt.TotalTime();
     mMainPassCB.DeltaTime = gt.DeltaTime();
 	mMainPassCB.AmbientLight = { 0.25f, 0.25f, 0.35f, 1.0f };
@@ -492,57 +1247,53 @@ void ClientMain::UpdateMainPassCB(const GameTimer& gt)
 	mMainPassCB.mLight[2].Strength = { 0.35f, 0.35f, 0.15f };
 
 
-    auto currPassCB = mCurrFrameResource->PassCB.get();
-    currPassCB->CopyData(0, mMainPassCB);
+    mCurrPassCB.CopyData(0, mMainPassCB);
 }
 
 void ClientMain::UpdateReflectedPassCB(const GameTimer& gt)
 {
-	mReflectedPassCB = mMainPassCB;
+	// Reflected pass stored in index 1
+	// 반사 패스는 반사 행렬과 광원 방향만 메인 패스와 다르므로, 따로 사본을 만들지 않고
+	// 메인 패스를 그대로 쓴 다음 그 필드들만 덮어씁니다. 매핑된 메모리는 읽지 않습니다.
+	mCurrPassCB.CopyData(ReflectedPassIndex, mMainPassCB);
+	PassConstants* reflectedPassCB = mCurrPassCB.Element(ReflectedPassIndex);
 
-	XMVECTOR mirrorPlane = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f); // xy plane
-	XMMATRIX R = XMMatrixReflect(mirrorPlane);
+	XMMATRIX R = XMMatrixReflect(XMLoadFloat4(&mMirrorPlane));
+	XMStoreFloat4x4(&reflectedPassCB->Reflect, XMMatrixTranspose(R));
 
 	// Reflect the lighting.
 	for (int i = 0; i < 3; ++i)
 	{
 		XMVECTOR lightDir = XMLoadFloat3(&mMainPassCB.mLight[i].Direction);
 		XMVECTOR reflectedLightDir = XMVector3TransformNormal(lightDir, R);
-		XMStoreFloat3(&mReflectedPassCB.mLight[i].Direction, reflectedLightDir);
+		XMStoreFloat3(&reflectedPassCB->mLight[i].Direction, reflectedLightDir);
 	}
-
-	// Reflected pass stored in index 1
-	auto currPassCB = mCurrFrameResource->PassCB.get();
-	currPassCB->CopyData(1, mReflectedPassCB);
 }
 
 void ClientMain::UpdateShadowPassCB(const GameTimer& gt)
 {
 	XMMATRIX view = XMLoadFloat4x4(&mLightView);
-	XMMATRIX proj = XMLoadFloat4x4(&mLightProj);
 
-	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
-	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
-	XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
-	XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
-
-	UINT w = mShadowMap->Width();
-	UINT h = mShadowMap->Height();
-
-	XMStoreFloat4x4(&mShadowPassCB.View, XMMatrixTranspose(view));
-	XMStoreFloat4x4(&mShadowPassCB.InvView, XMMatrixTranspose(invView));
-	XMStoreFloat4x4(&mShadowPassCB.Proj, XMMatrixTranspose(proj));
-	XMStoreFloat4x4(&mShadowPassCB.InvProj, XMMatrixTranspose(invProj));
-	XMStoreFloat4x4(&mShadowPassCB.ViewProj, XMMatrixTranspose(viewProj));
-	XMStoreFloat4x4(&mShadowPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
-	mShadowPassCB.EyePosW = mLightPosW;
-	mShadowPassCB.RenderTargetSize = XMFLOAT2((float)w, (float)h);
-	mShadowPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / w, 1.0f / h);
-	mShadowPassCB.NearZ = mLightNearZ;
-	mShadowPassCB.FarZ = mLightFarZ;
-
-	auto currPassCB = mCurrFrameResource->PassCB.get();
-	currPassCB->CopyData(1, mShadowPassCB);
+	// 캐스케이드 하나는 아틀라스의 1/4을 씁니다.
+	UINT w = mShadowMap->Width() / 2;
+	UINT h = mShadowMap->Height() / 2;
+
+	for (int i = 0; i < MaxShadowCascades; ++i)
+	{
+		PassConstants& shadowPassCB = mShadowPassCBs[i];
+
+		// 캐스케이드 투영은 직교 투영입니다. 광원과 캐스케이드 범위가 그대로면 다시 계산하지 않습니다.
+		XMMATRIX proj = XMLoadFloat4x4(&mCascadeProj[i]);
+		mShadowPassBuilders[i].Build(shadowPassCB, view, proj, PassConstantsBuilder::Projection::Orthographic);
+
+		shadowPassCB.EyePosW = mLightPosW;
+		shadowPassCB.RenderTargetSize = XMFLOAT2((float)w, (float)h);
+		shadowPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / w, 1.0f / h);
+		shadowPassCB.NearZ = mCascadeNearZ[i];
+		shadowPassCB.FarZ = mCascadeFarZ[i];
+
+		mCurrPassCB.CopyData(ShadowPassIndex + i, shadowPassCB);
+	}
 }
 
 void ClientMain::UpdateSsaoCB(const GameTimer& gt)
@@ -727,7 +1478,8 @@ void ClientMain::BuildDescriptorHeaps()
 	mShadowMap->BuildDescriptors(
 		CD3DX12_CPU_DESCRIPTOR_HANDLE(srvCpuStart, mShadowMapHeapIndex, mCbvSrvUavDescriptorSize),
 		CD3DX12_GPU_DESCRIPTOR_HANDLE(srvGpuStart, mShadowMapHeapIndex, mCbvSrvUavDescriptorSize),
-		CD3DX12_CPU_DESCRIPTOR_HANDLE(dsvCpuStart, 1, mDsvDescriptorSize));
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(dsvCpuStart, 1, mDsvDescriptorSize),
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(dsvCpuStart, 2, mDsvDescriptorSize));
 
 	mSsao->BuildDescriptors(
 		mDepthStencilBuffer.Get(),
@@ -757,22 +1509,35 @@ void ClientMain::BuildRootSignature()
 	texTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 20, 3, 0); // baseShaderRegister: t2
 
 	// Root parameter can be a table, root descriptor or root constants.
-	CD3DX12_ROOT_PARAMETER slotRootParameter[5];
+#ifdef PACKED_OBJECT_DATA
+	const UINT rootParameterCount = 7;
+#else
+	const UINT rootParameterCount = 5;
+#endif
+	CD3DX12_ROOT_PARAMETER slotRootParameter[rootParameterCount];
 
 
     // 퍼포먼스 TIP : 가장 자주 발생하는 것 부터 가장 적게 발생하는 것 순으로 정렬한다.
     // 루트 CBV를 생성합니다.
+#ifdef PACKED_OBJECT_DATA
+	slotRootParameter[0].InitAsConstants(1, 2); // register (b2) --> cbInstanceBase
+#else
 	slotRootParameter[0].InitAsConstantBufferView(0); // register (b0) --> cbPerObject
+#endif
 	slotRootParameter[1].InitAsConstantBufferView(1); // register (b1) --> CbPass
 	slotRootParameter[2].InitAsShaderResourceView(0, 1);
 	slotRootParameter[3].InitAsDescriptorTable(1, &texTable0, D3D12_SHADER_VISIBILITY_PIXEL);
 	slotRootParameter[4].InitAsDescriptorTable(1, &texTable1, D3D12_SHADER_VISIBILITY_PIXEL);
+#ifdef PACKED_OBJECT_DATA
+	slotRootParameter[5].InitAsShaderResourceView(1, 1); // register (t1, space1) --> gObjectData
+	slotRootParameter[6].InitAsShaderResourceView(2, 1); // register (t2, space1) --> gInstanceObjects
+#endif
 
     auto staticSamplers = GetStaticSamplers(); //(s0 ~ s6)
 
     // 루트 시그네쳐는 루트 파라미터 배열입니다.
 
-    CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(5, slotRootParameter,
+    CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(rootParameterCount, slotRootParameter,
         (UINT)staticSamplers.size(), staticSamplers.data(),
         D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
@@ -877,9 +1642,21 @@ void ClientMain::BuildSsaoRootSignature()
 
 void ClientMain::BuildShadersAndInputLayout()
 {
+	// common.hlsl을 쓰는 셰이더들은 모두 같은 방식으로 물체 데이터를 읽어야 합니다.
+	const D3D_SHADER_MACRO objectDefines[] =
+	{
+#ifdef PACKED_OBJECT_DATA
+		"PACKED_OBJECT_DATA", "1",
+#endif
+		NULL, NULL
+	};
+
 	const D3D_SHADER_MACRO defines[] =
 	{
 		"FOG", "1",
+#ifdef PACKED_OBJECT_DATA
+		"PACKED_OBJECT_DATA", "1",
+#endif
 		NULL, NULL
 	};
 
@@ -887,24 +1664,27 @@ void ClientMain::BuildShadersAndInputLayout()
 	{
 		"FOG", "1",
 		"ALPHA_TEST", "1",
+#ifdef PACKED_OBJECT_DATA
+		"PACKED_OBJECT_DATA", "1",
+#endif
 		NULL, NULL
 	};
 
-    mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\default.hlsl", nullptr, "VS", "vs_5_1");
+    mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\default.hlsl", objectDefines, "VS", "vs_5_1");
     mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\default.hlsl", defines, "PS", "ps_5_1");
 	mShaders["alphaTestedPS"] = d3dUtil::CompileShader(L"Shaders\\default.hlsl", alphaTestDefines, "PS", "ps_5_1");
 
-	mShaders["skyVS"] = d3dUtil::CompileShader(L"Shaders\\sky.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["skyPS"] = d3dUtil::CompileShader(L"Shaders\\sky.hlsl", nullptr, "PS", "ps_5_1");
+	mShaders["skyVS"] = d3dUtil::CompileShader(L"Shaders\\sky.hlsl", objectDefines, "VS", "vs_5_1");
+	mShaders["skyPS"] = d3dUtil::CompileShader(L"Shaders\\sky.hlsl", objectDefines, "PS", "ps_5_1");
 
-	mShaders["shadowVS"] = d3dUtil::CompileShader(L"Shaders\\Shadows.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["shadowOpaquePS"] = d3dUtil::CompileShader(L"Shaders\\Shadows.hlsl", nullptr, "PS", "ps_5_1");
+	mShaders["shadowVS"] = d3dUtil::CompileShader(L"Shaders\\Shadows.hlsl", objectDefines, "VS", "vs_5_1");
+	mShaders["shadowOpaquePS"] = d3dUtil::CompileShader(L"Shaders\\Shadows.hlsl", objectDefines, "PS", "ps_5_1");
 
-	mShaders["debugVS"] = d3dUtil::CompileShader(L"Shaders\\ShadowDebug.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["debugPS"] = d3dUtil::CompileShader(L"Shaders\\ShadowDebug.hlsl", nullptr, "PS", "ps_5_1");
+	mShaders["debugVS"] = d3dUtil::CompileShader(L"Shaders\\ShadowDebug.hlsl", objectDefines, "VS", "vs_5_1");
+	mShaders["debugPS"] = d3dUtil::CompileShader(L"Shaders\\ShadowDebug.hlsl", objectDefines, "PS", "ps_5_1");
 
-	mShaders["drawNormalsVS"] = d3dUtil::CompileShader(L"Shaders\\DrawNormals.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["drawNormalsPS"] = d3dUtil::CompileShader(L"Shaders\\DrawNormals.hlsl", nullptr, "PS", "ps_5_1");
+	mShaders["drawNormalsVS"] = d3dUtil::CompileShader(L"Shaders\\DrawNormals.hlsl", objectDefines, "VS", "vs_5_1");
+	mShaders["drawNormalsPS"] = d3dUtil::CompileShader(L"Shaders\\DrawNormals.hlsl", objectDefines, "PS", "ps_5_1");
 
 	mShaders["ssaoVS"] = d3dUtil::CompileShader(L"Shaders\\Ssao.hlsl", nullptr, "VS", "vs_5_1");
 	mShaders["ssaoPS"] = d3dUtil::CompileShader(L"Shaders\\Ssao.hlsl", nullptr, "PS", "ps_5_1");
@@ -912,8 +1692,8 @@ void ClientMain::BuildShadersAndInputLayout()
 	mShaders["ssaoBlurVS"] = d3dUtil::CompileShader(L"Shaders\\SsaoBlur.hlsl", nullptr, "VS", "vs_5_1");
 	mShaders["ssaoBlurPS"] = d3dUtil::CompileShader(L"Shaders\\SsaoBlur.hlsl", nullptr, "PS", "ps_5_1");
 
-	mShaders["skyVS"] = d3dUtil::CompileShader(L"Shaders\\Sky.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["skyPS"] = d3dUtil::CompileShader(L"Shaders\\Sky.hlsl", nullptr, "PS", "ps_5_1");
+	mShaders["skyVS"] = d3dUtil::CompileShader(L"Shaders\\Sky.hlsl", objectDefines, "VS", "vs_5_1");
+	mShaders["skyPS"] = d3dUtil::CompileShader(L"Shaders\\Sky.hlsl", objectDefines, "PS", "ps_5_1");
 
 
 	mShaders["shadowAlphaTestedPS"] = d3dUtil::CompileShader(L"Shaders\\Shadows.hlsl", alphaTestDefines, "PS", "ps_5_1");
@@ -924,7 +1704,7 @@ void ClientMain::BuildShadersAndInputLayout()
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TANGENT", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 	};
 }
 
@@ -939,6 +1719,11 @@ void ClientMain::BuildShapeGeometry()
 	GeometryGenerator::MeshData quad = geoGen.CreateQuad(-1.0f, +1.0f, 0.4f, 0.4f, 0.0f); // depth shadow render
 	GeometryGenerator::MeshData quad2 = geoGen.CreateQuad(-0.59f, +1.0f, 0.4f, 0.4f, 0.0f); // depth shadow render
 
+	// 노멀 매핑되는 메쉬는 UV로부터 방향성을 포함한 탄젠트 프레임을 다시 만듭니다.
+	// 화면 공간 디버그 쿼드는 노멀 맵을 쓰지 않으므로 제외합니다.
+	for (GeometryGenerator::MeshData* mesh : { &box, &grid, &sphere, &cylinder, &wall })
+		geoGen.GenerateTangents(*mesh);
+
     //
     // 모든 지오메트리를 하나의 큰 버텍스/인덱스 버퍼에 연결해서 저장합니다.
     // 그러므로 각각의 서브메쉬가 버퍼에서 차지하는 영역을 정의합니다.
@@ -997,6 +1782,36 @@ void ClientMain::BuildShapeGeometry()
 	quad2Submesh.StartIndexLocation = quad2IndexOffset;
 	quad2Submesh.BaseVertexLocation = quad2VertexOffset;
 
+	// 각 서브메쉬의 로컬 공간 경계 상자와 경계 구를 계산합니다.
+	auto computeBounds = [](const GeometryGenerator::MeshData& mesh, SubmeshGeometry& submesh)
+	{
+		const XMFLOAT3* positions = &mesh.Vertices[0].Position;
+		submesh.Bounds = BoundsUtil::ComputeBox(positions, mesh.Vertices.size(), sizeof(GeometryGenerator::Vertex));
+		submesh.Sphere = BoundsUtil::ComputeSphere(positions, mesh.Vertices.size(), sizeof(GeometryGenerator::Vertex));
+	};
+
+	computeBounds(box, boxSubmesh);
+	computeBounds(grid, gridSubmesh);
+	computeBounds(sphere, sphereSubmesh);
+	computeBounds(cylinder, cylinderSubmesh);
+	computeBounds(wall, WallSubmesh);
+	computeBounds(quad, quadSubmesh);
+	computeBounds(quad2, quad2Submesh);
+
+	// 피킹에 사용할 삼각형 BVH를 메쉬마다 만듭니다. 화면 공간 디버그 쿼드는 제외합니다.
+	auto buildMeshBvh = [this](const std::string& name, const GeometryGenerator::MeshData& mesh)
+	{
+		auto bvh = std::make_unique<MeshBvh>();
+		bvh->Build(mesh);
+		mMeshBvhs[name] = std::move(bvh);
+	};
+
+	buildMeshBvh("box", box);
+	buildMeshBvh("grid", grid);
+	buildMeshBvh("sphere", sphere);
+	buildMeshBvh("cylinder", cylinder);
+	buildMeshBvh("wall", wall);
+
     auto totalVertexCount =
         box.Vertices.size() +
         grid.Vertices.size() +
@@ -1015,6 +1830,7 @@ void ClientMain::BuildShapeGeometry()
         vertices[k].Normal = box.Vertices[i].Normal;
         vertices[k].TexC = box.Vertices[i].TexC;
         vertices[k].TangentU = box.Vertices[i].TangentU; 
+        vertices[k].TangentW = box.Vertices[i].TangentW;
     }
 
     for (size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
@@ -1023,6 +1839,7 @@ void ClientMain::BuildShapeGeometry()
         vertices[k].Normal = grid.Vertices[i].Normal;
         vertices[k].TexC = grid.Vertices[i].TexC;
 		vertices[k].TangentU = grid.Vertices[i].TangentU;
+		vertices[k].TangentW = grid.Vertices[i].TangentW;
 
     }
 
@@ -1032,6 +1849,7 @@ void ClientMain::BuildShapeGeometry()
         vertices[k].Normal = sphere.Vertices[i].Normal;
         vertices[k].TexC = sphere.Vertices[i].TexC;
 		vertices[k].TangentU = sphere.Vertices[i].TangentU;
+		vertices[k].TangentW = sphere.Vertices[i].TangentW;
     }
 
     for (size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
@@ -1040,6 +1858,7 @@ void ClientMain::BuildShapeGeometry()
         vertices[k].Normal = cylinder.Vertices[i].Normal;
         vertices[k].TexC = cylinder.Vertices[i].TexC;
         vertices[k].TangentU = cylinder.Vertices[i].TangentU;
+        vertices[k].TangentW = cylinder.Vertices[i].TangentW;
     }
 
 	for (size_t i = 0; i < wall.Vertices.size(); ++i, ++k)
@@ -1048,6 +1867,7 @@ void ClientMain::BuildShapeGeometry()
 		vertices[k].Normal = wall.Vertices[i].Normal;
 		vertices[k].TexC = wall.Vertices[i].TexC;
         vertices[k].TangentU = wall.Vertices[i].TangentU;
+        vertices[k].TangentW = wall.Vertices[i].TangentW;
 	}
 
 	for (int i = 0; i < quad.Vertices.size(); ++i, ++k)
@@ -1056,6 +1876,7 @@ void ClientMain::BuildShapeGeometry()
 		vertices[k].Normal = quad.Vertices[i].Normal;
 		vertices[k].TexC = quad.Vertices[i].TexC;
 		vertices[k].TangentU = quad.Vertices[i].TangentU;
+		vertices[k].TangentW = quad.Vertices[i].TangentW;
 	}
 
 	for (int i = 0; i < quad2.Vertices.size(); ++i, ++k)
@@ -1064,6 +1885,7 @@ void ClientMain::BuildShapeGeometry()
 		vertices[k].Normal = quad2.Vertices[i].Normal;
 		vertices[k].TexC = quad2.Vertices[i].TexC;
 		vertices[k].TangentU = quad2.Vertices[i].TangentU;
+		vertices[k].TangentW = quad2.Vertices[i].TangentW;
 	}
 
     std::vector<std::uint16_t> indices;
@@ -1368,6 +2190,26 @@ void ClientMain::BuildPSOs()
 	};
 	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&ssaoBlurPsoDesc, IID_PPV_ARGS(&mPSOs["ssaoBlur"])));
 
+	// 그리기 단계에서 문자열을 해시하지 않도록 여기서 핸들로 바꿔 둡니다.
+	mPsoHandles.Opaque = mPSOs.Find("opaque");
+	mPsoHandles.Sky = mPSOs.Find("sky");
+	mPsoHandles.Debug = mPSOs.Find("debug");
+	mPsoHandles.MarkStencilMirrors = mPSOs.Find("markStencilMirrors");
+	mPsoHandles.DrawStencilReflections = mPSOs.Find("drawStencilReflections");
+	mPsoHandles.Transparent = mPSOs.Find("transparent");
+	mPsoHandles.AlphaTested = mPSOs.Find("alphaTested");
+	mPsoHandles.ShadowOpaque = mPSOs.Find("shadow_opaque");
+	mPsoHandles.DrawNormals = mPSOs.Find("drawNormals");
+
+	// 레이어마다 그 레이어를 그리는 PSO입니다. 그리기 정렬 키에 쓰입니다.
+	mLayerPso[(int)RenderLayer::Opaque] = mPsoHandles.Opaque.Index;
+	mLayerPso[(int)RenderLayer::opaque_wireframe] = mPSOs.Find("opaque_wireframe").Index;
+	mLayerPso[(int)RenderLayer::Transparent] = mPsoHandles.Transparent.Index;
+	mLayerPso[(int)RenderLayer::AlphaTested] = mPsoHandles.AlphaTested.Index;
+	mLayerPso[(int)RenderLayer::Mirrors] = mPsoHandles.MarkStencilMirrors.Index;
+	mLayerPso[(int)RenderLayer::Reflected] = mPsoHandles.DrawStencilReflections.Index;
+	mLayerPso[(int)RenderLayer::Sky] = mPsoHandles.Sky.Index;
+	mLayerPso[(int)RenderLayer::Debug] = mPsoHandles.Debug.Index;
 }
 
 void ClientMain::BuildFrameResources()
@@ -1375,8 +2217,10 @@ void ClientMain::BuildFrameResources()
     for (int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(
-            md3dDevice.Get(), 1, (UINT)mAllRitems.size(), (UINT)mMaterials.size()));
+            md3dDevice.Get(), (UINT)mAllRitems.size(), mMaterials.Size()));
     }
+
+    mUploadRing = std::make_unique<UploadRing>(md3dDevice.Get(), UploadRingByteSize);
 }
 
 void ClientMain::BuildRenderItems()
@@ -1384,35 +2228,18 @@ void ClientMain::BuildRenderItems()
     auto boxRitem = std::make_unique<RenderItem>();
     XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(2.0f, 2.0f, 2.0f) * XMMatrixTranslation(0.0f, 1.0f, 0.0f));
 	XMStoreFloat4x4(&boxRitem->TexTransform, XMMatrixScaling(1.0f, 1.0f, 1.0f));
-    boxRitem->ObjCBIndex = 0;
     boxRitem->Geo = mGeometries["shapeGeo"].get();
     boxRitem->Mat = mMaterials["WireFence"].get();
     boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
     boxRitem->IndexCount = (UINT)boxRitem->Geo->DrawArgs["box"].IndexCount;
     boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
     boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
+    boxRitem->Bounds = boxRitem->Geo->DrawArgs["box"].Bounds;
+    boxRitem->PickBvh = mMeshBvhs["box"].get();
     mRenderItems[(int)RenderLayer::AlphaTested].push_back(boxRitem.get()); 
+    mRenderItems[(int)RenderLayer::Reflected].push_back(boxRitem.get());
 
-	// Reflected skull will have different world matrix, so it needs to be its own render item.
-	auto reflectedboxRitem = std::make_unique<RenderItem>();
-	*reflectedboxRitem = *boxRitem;
-    reflectedboxRitem->ObjCBIndex = 1;
-    mReflectedSkullRitem = reflectedboxRitem.get();
-
-	auto reflectedleftCylRitem = std::make_unique<RenderItem>();
-    XMMATRIX skullScale = XMMatrixScaling(2.0f, 2.0f, 2.0f);
-	XMMATRIX ReflectRotate = XMMatrixRotationY(0.5f * MathHelper::Pi);
-	XMMATRIX ReflectOffset = XMMatrixTranslation(15.0f, boxRitem->World._42, boxRitem->World._43);
-	XMMATRIX ReflectWorld = ReflectRotate * skullScale * ReflectOffset;
-
-	XMVECTOR mirrorPlane = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f); // xy plane
-	XMMATRIX R = XMMatrixReflect(mirrorPlane);
-    
-    XMStoreFloat4x4(&reflectedboxRitem->World, ReflectWorld * R);
-
-    mRenderItems[(int)RenderLayer::Reflected].push_back(reflectedboxRitem.get());
     mAllRitems.push_back(std::move(boxRitem));
-    mAllRitems.push_back(std::move(reflectedboxRitem));
 
 
     auto gridRitem = std::make_unique<RenderItem>();
@@ -1420,44 +2247,39 @@ void ClientMain::BuildRenderItems()
     XMStoreFloat4x4(&gridRitem->World, XMMatrixScaling(1.3f, 1.0f, 1.2f));
     gridRitem->World._41 += 6.f;
 	XMStoreFloat4x4(&gridRitem->TexTransform, XMMatrixScaling(8.0f, 8.0f, 1.0f));
-    gridRitem->ObjCBIndex = 2;
     gridRitem->Geo = mGeometries["shapeGeo"].get();
     gridRitem->Mat = mMaterials["tile"].get();
     gridRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
     gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
     gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
     gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+    gridRitem->Bounds = gridRitem->Geo->DrawArgs["grid"].Bounds;
+    gridRitem->PickBvh = mMeshBvhs["grid"].get();
     mRenderItems[(int)RenderLayer::Opaque].push_back(gridRitem.get());
     mAllRitems.push_back(std::move(gridRitem));
 
-	auto wallRitem = std::make_unique<RenderItem>();
-    wallRitem->World = MathHelper::Identity4x4();
-    XMStoreFloat4x4(&wallRitem->World, XMMatrixTranslation(-0.8f, 0.0f, 0.0f));
-    wallRitem->ObjCBIndex = 3;
-    wallRitem->Geo = mGeometries["shapeGeo"].get();
-    wallRitem->Mat = mMaterials["brick2"].get();
-    wallRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    wallRitem->IndexCount = wallRitem->Geo->DrawArgs["wall"].IndexCount;
-    wallRitem->StartIndexLocation = wallRitem->Geo->DrawArgs["wall"].StartIndexLocation;
-    wallRitem->BaseVertexLocation = wallRitem->Geo->DrawArgs["wall"].BaseVertexLocation;
-
-
 	auto iceRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&iceRitem->World, XMMatrixScaling(0.4f, 0.4f, 0.4f) + XMMatrixTranslation(+3.1f, 0.0f, 0.0f));
+	XMMATRIX iceWorld = XMMatrixScaling(0.7f, 0.7f, 0.7f) * XMMatrixTranslation(+1.55f, 0.0f, 0.0f);
+	XMStoreFloat4x4(&iceRitem->World, iceWorld);
 	XMStoreFloat4x4(&iceRitem->TexTransform, XMMatrixScaling(1.0f, 1.0f, 1.0f));
-	iceRitem->ObjCBIndex = 4;
 	iceRitem->Geo = mGeometries["shapeGeo"].get();
 	iceRitem->Mat = mMaterials["ice"].get();
 	iceRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 	iceRitem->IndexCount = iceRitem->Geo->DrawArgs["wall"].IndexCount;
 	iceRitem->StartIndexLocation = iceRitem->Geo->DrawArgs["wall"].StartIndexLocation;
 	iceRitem->BaseVertexLocation = iceRitem->Geo->DrawArgs["wall"].BaseVertexLocation;
+	iceRitem->Bounds = iceRitem->Geo->DrawArgs["wall"].Bounds;
+	iceRitem->PickBvh = mMeshBvhs["wall"].get();
 	mRenderItems[(int)RenderLayer::Mirrors].push_back(iceRitem.get());
     mRenderItems[(int)RenderLayer::Transparent].push_back(iceRitem.get());
 	mAllRitems.push_back(std::move(iceRitem));
 
+	// 벽 메쉬는 로컬 x = 10 평면 위에 있습니다. 반사 패스는 이 평면의 월드 공간 식으로 반사 행렬을 만듭니다.
+	XMVECTOR mirrorPoint = XMVector3TransformCoord(XMVectorSet(10.0f, 0.0f, 0.0f, 1.0f), iceWorld);
+	XMVECTOR mirrorNormal = XMVector3Normalize(XMVector3TransformNormal(XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f), iceWorld));
+	XMStoreFloat4(&mMirrorPlane, XMPlaneFromPointNormal(mirrorPoint, mirrorNormal));
+
 	XMMATRIX brickTexTransform = XMMatrixScaling(1.0f, 1.0f, 1.0f);
-    UINT objCBIndex = 5;
     for (int i = 0; i < 5; ++i)
     {
         auto leftCylRitem = std::make_unique<RenderItem>();
@@ -1473,106 +2295,76 @@ void ClientMain::BuildRenderItems()
 
         XMStoreFloat4x4(&leftCylRitem->World, rightCylWorld);
         XMStoreFloat4x4(&leftCylRitem->TexTransform, brickTexTransform);
-        leftCylRitem->ObjCBIndex = objCBIndex++;
         leftCylRitem->Geo = mGeometries["shapeGeo"].get();
         leftCylRitem->Mat = mMaterials["bricks"].get();
         leftCylRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
         leftCylRitem->IndexCount = leftCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
         leftCylRitem->StartIndexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
         leftCylRitem->BaseVertexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+        leftCylRitem->Bounds = leftCylRitem->Geo->DrawArgs["cylinder"].Bounds;
+        leftCylRitem->PickBvh = mMeshBvhs["cylinder"].get();
+        leftCylRitem->Occluder = true;
         mRenderItems[(int)RenderLayer::Opaque].push_back(leftCylRitem.get());
+        mRenderItems[(int)RenderLayer::Reflected].push_back(leftCylRitem.get());
 		
-        auto reflectedleftCylRitem = std::make_unique<RenderItem>();
-		XMMATRIX ReflectRotate = XMMatrixRotationY(0.5f * MathHelper::Pi);
-		XMMATRIX ReflectOffset = XMMatrixTranslation(10.0f , leftCylRitem->World._42 , leftCylRitem->World._43);
-		XMMATRIX ReflectWorld = ReflectRotate * ReflectOffset;
-		XMVECTOR mirrorPlane = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f); // xy plane
-		XMMATRIX R = XMMatrixReflect(mirrorPlane);
-
-		*reflectedleftCylRitem = *leftCylRitem;
-        reflectedleftCylRitem->ObjCBIndex = objCBIndex++;
-        reflectedleftCylRitem->Mat = mMaterials["bricks"].get();
-		//XMStoreFloat4x4(&reflectedleftCylRitem->World, ReflectWorld);
-        XMStoreFloat4x4(&reflectedleftCylRitem->World, ReflectWorld * R);
-        mRenderItems[(int)RenderLayer::Reflected].push_back(reflectedleftCylRitem.get());
-
         //=============================================================================================================//
 
         XMStoreFloat4x4(&rightCylRitem->World, leftCylWorld);
 		XMStoreFloat4x4(&rightCylRitem->TexTransform, brickTexTransform);
-        rightCylRitem->ObjCBIndex = objCBIndex++;
         rightCylRitem->Geo = mGeometries["shapeGeo"].get();
         rightCylRitem->Mat = mMaterials["bricks"].get();
         rightCylRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
         rightCylRitem->IndexCount = rightCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
         rightCylRitem->StartIndexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
         rightCylRitem->BaseVertexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+        rightCylRitem->Bounds = rightCylRitem->Geo->DrawArgs["cylinder"].Bounds;
+        rightCylRitem->PickBvh = mMeshBvhs["cylinder"].get();
+        rightCylRitem->Occluder = true;
         mRenderItems[(int)RenderLayer::Opaque].push_back(rightCylRitem.get());
-
-		auto reflectedrightCylRitem = std::make_unique<RenderItem>();
-		*reflectedrightCylRitem = *rightCylRitem;
-		reflectedrightCylRitem->ObjCBIndex = objCBIndex++;
-		reflectedrightCylRitem->Mat = mMaterials["bricks"].get();
-
-		ReflectOffset = XMMatrixTranslation(20.0f, rightCylRitem->World._42, rightCylRitem->World._43 );
-		ReflectWorld = ReflectRotate * ReflectOffset;
-		XMStoreFloat4x4(&reflectedrightCylRitem->World, ReflectWorld * R);
-		mRenderItems[(int)RenderLayer::Reflected].push_back(reflectedrightCylRitem.get());
+        mRenderItems[(int)RenderLayer::Reflected].push_back(rightCylRitem.get());
 
 		//=============================================================================================================//
 
 		XMStoreFloat4x4(&leftSphereRitem->World, leftSphereWorld);
 		XMStoreFloat4x4(&leftSphereRitem->TexTransform, brickTexTransform);
-		leftSphereRitem->ObjCBIndex = objCBIndex++;
 		leftSphereRitem->Geo = mGeometries["shapeGeo"].get();
 		leftSphereRitem->Mat = mMaterials["white1x1"].get();
 		leftSphereRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 		leftSphereRitem->IndexCount = leftSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
 		leftSphereRitem->StartIndexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 		leftSphereRitem->BaseVertexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+		leftSphereRitem->Bounds = leftSphereRitem->Geo->DrawArgs["sphere"].Bounds;
+		leftSphereRitem->PickBvh = mMeshBvhs["sphere"].get();
 		mRenderItems[(int)RenderLayer::Opaque].push_back(leftSphereRitem.get());
-
-		auto reflectedleftSphereRitem = std::make_unique<RenderItem>();
-		*reflectedleftSphereRitem = *leftSphereRitem;
-		reflectedleftSphereRitem->ObjCBIndex = objCBIndex++;
-		reflectedleftSphereRitem->Mat = mMaterials["white1x1"].get();
-
-		ReflectOffset = XMMatrixTranslation(10.0f, leftSphereRitem->World._42, leftSphereRitem->World._43);
-		ReflectWorld = ReflectRotate * ReflectOffset;
-		XMStoreFloat4x4(&reflectedleftSphereRitem->World, ReflectWorld);
-		mRenderItems[(int)RenderLayer::Reflected].push_back(reflectedleftSphereRitem.get());
+		mRenderItems[(int)RenderLayer::Reflected].push_back(leftSphereRitem.get());
 
 		XMStoreFloat4x4(&rightSphereRitem->World, rightSphereWorld);
 		XMStoreFloat4x4(&rightSphereRitem->World, rightSphereWorld);
-		rightSphereRitem->ObjCBIndex = objCBIndex++;
 		rightSphereRitem->Geo = mGeometries["shapeGeo"].get();
 		rightSphereRitem->Mat = mMaterials["white1x1"].get();
 		rightSphereRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 		rightSphereRitem->IndexCount = rightSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
 		rightSphereRitem->StartIndexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 		rightSphereRitem->BaseVertexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+		rightSphereRitem->Bounds = rightSphereRitem->Geo->DrawArgs["sphere"].Bounds;
+		rightSphereRitem->PickBvh = mMeshBvhs["sphere"].get();
 		mRenderItems[(int)RenderLayer::Opaque].push_back(rightSphereRitem.get());
+		mRenderItems[(int)RenderLayer::Reflected].push_back(rightSphereRitem.get());
 
-		auto reflectedrightSphereRitem = std::make_unique<RenderItem>();
-		*reflectedrightSphereRitem = *rightSphereRitem;
-		reflectedrightSphereRitem->ObjCBIndex = objCBIndex++;
-		reflectedrightSphereRitem->Mat = mMaterials["white1x1"].get();
-
-		ReflectOffset = XMMatrixTranslation(20.0f, rightSphereRitem->World._42,  rightSphereRitem->World._43 );
-		ReflectWorld = ReflectRotate * ReflectOffset;
-		XMStoreFloat4x4(&reflectedrightSphereRitem->World, ReflectWorld);
-		mRenderItems[(int)RenderLayer::Reflected].push_back(reflectedrightSphereRitem.get());
+        mOccluders.push_back(leftCylRitem.get());
+        mOccluders.push_back(rightCylRitem.get());
 
         mAllRitems.push_back(std::move(leftCylRitem));
         mAllRitems.push_back(std::move(rightCylRitem));
 		mAllRitems.push_back(std::move(leftSphereRitem));
 		mAllRitems.push_back(std::move(rightSphereRitem));
-		mAllRitems.push_back(std::move(reflectedleftCylRitem));
-		mAllRitems.push_back(std::move(reflectedrightCylRitem));
-		mAllRitems.push_back(std::move(reflectedleftSphereRitem));
-		mAllRitems.push_back(std::move(reflectedrightSphereRitem));
     }
 
+	// N 키로 만드는 구가 쓸 핸들과 서브메쉬를 미리 찾아 둡니다.
+	mSpawnGeo = mGeometries.Find("shapeGeo");
+	mSpawnMat = mMaterials.Find("white1x1");
+	mSpawnSubmesh = mGeometries.Get(mSpawnGeo)->DrawArgs["sphere"];
+	mSpawnBvh = mMeshBvhs["sphere"].get();
 }
 
 void ClientMain::BuildSkyRenderItems()
@@ -1580,13 +2372,13 @@ void ClientMain::BuildSkyRenderItems()
 	auto skyRitem = std::make_unique<RenderItem>();
 	XMStoreFloat4x4(&skyRitem->World, XMMatrixScaling(5000.0f, 5000.0f, 5000.0f));
 	skyRitem->TexTransform = MathHelper::Identity4x4();
-	skyRitem->ObjCBIndex = 45;
 	skyRitem->Mat = mMaterials["sky"].get();
 	skyRitem->Geo = mGeometries["shapeGeo"].get();
 	skyRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 	skyRitem->IndexCount = skyRitem->Geo->DrawArgs["sphere"].IndexCount;
 	skyRitem->StartIndexLocation = skyRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 	skyRitem->BaseVertexLocation = skyRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+	skyRitem->Bounds = skyRitem->Geo->DrawArgs["sphere"].Bounds;
 
     mRenderItems[(int)RenderLayer::Sky].push_back(skyRitem.get());
 	mAllRitems.push_back(std::move(skyRitem));
@@ -1595,54 +2387,92 @@ void ClientMain::BuildSkyRenderItems()
 	auto quadRitem = std::make_unique<RenderItem>();
 	quadRitem->World = MathHelper::Identity4x4();
 	quadRitem->TexTransform = MathHelper::Identity4x4();
-	quadRitem->ObjCBIndex = 46;
 	quadRitem->Mat = mMaterials["bricks"].get();
 	quadRitem->Geo = mGeometries["shapeGeo"].get();
 	quadRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 	quadRitem->IndexCount = quadRitem->Geo->DrawArgs["quad"].IndexCount;
 	quadRitem->StartIndexLocation = quadRitem->Geo->DrawArgs["quad"].StartIndexLocation;
 	quadRitem->BaseVertexLocation = quadRitem->Geo->DrawArgs["quad"].BaseVertexLocation;
+	quadRitem->Bounds = quadRitem->Geo->DrawArgs["quad"].Bounds;
 
 	mRenderItems[(int)RenderLayer::Debug].push_back(quadRitem.get());
 	mAllRitems.push_back(std::move(quadRitem));
 
 	quadRitem = std::make_unique<RenderItem>();
-	quadRitem->ObjCBIndex = 47;
 	quadRitem->Mat = mMaterials["bricks"].get();
 	quadRitem->Geo = mGeometries["shapeGeo"].get();
 	quadRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 	quadRitem->IndexCount = quadRitem->Geo->DrawArgs["quad2"].IndexCount;
 	quadRitem->StartIndexLocation = quadRitem->Geo->DrawArgs["quad2"].StartIndexLocation;
 	quadRitem->BaseVertexLocation = quadRitem->Geo->DrawArgs["quad2"].BaseVertexLocation;
+	quadRitem->Bounds = quadRitem->Geo->DrawArgs["quad2"].Bounds;
 
 	mRenderItems[(int)RenderLayer::Debug].push_back(quadRitem.get());
 	mAllRitems.push_back(std::move(quadRitem));
 }
 
-void ClientMain::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void ClientMain::DrawRenderItems(CommandRecorder& recorder, const std::vector<RenderItem*>& ritems, bool keepOrder)
 {
+#ifdef PACKED_OBJECT_DATA
+    if (ritems.empty())
+        return;
+
+    // 서브메쉬와 재질이 같은 아이템을 한 번의 인스턴스 그리기로 묶습니다. PSO는 호출하는 쪽에서 목록 전체에 하나로 정합니다.
+    mInstanceKeys.resize(ritems.size());
+    for (size_t i = 0; i < ritems.size(); ++i)
+        mInstanceKeys[i] = ((std::uint64_t)ritems[i]->SubmeshIndex << 32) | ritems[i]->Mat->MatCBIndex;
+    mInstanceBatcher.Build(mInstanceKeys.data(), (UINT)mInstanceKeys.size(), keepOrder);
+
+    // 묶음 순서대로 물체 인덱스를 인스턴스 버퍼에 기록합니다. 한 묶음의 인스턴스는 연속해서 놓입니다.
+    const auto& order = mInstanceBatcher.Order();
+    auto instances = mUploadRing->AllocateArray<UINT>((UINT)order.size());
+    for (UINT i = 0; i < (UINT)order.size(); ++i)
+        *instances.Element(i) = ritems[order[i]]->ObjCBIndex;
+
+    recorder.SetGraphicsRootShaderResourceView(6, instances.GpuAddress);
+
+    for (UINT b = 0; b < mInstanceBatcher.BatchCount(); ++b)
+    {
+        const auto& batch = mInstanceBatcher.GetBatch(b);
+        auto ri = ritems[order[batch.First]];
+
+        // 정렬된 큐에서는 같은 지오메트리가 연달아 나오므로 대부분의 IA 설정은 레코더가 걸러냅니다.
+        recorder.IASetVertexBuffer(ri->Geo->VertexBufferView());
+        recorder.IASetIndexBuffer(ri->Geo->IndexBufferView());
+        recorder.IASetPrimitiveTopology(ri->PrimitiveType);
+
+        // 셰이더는 SV_InstanceID에 이 위치를 더해 인스턴스 버퍼에서 물체 인덱스를 읽습니다.
+        recorder.SetGraphicsRoot32BitConstant(0, batch.First, 0);
+
+        recorder.DrawIndexedInstanced(ri->IndexCount, batch.Count, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+    }
+
+    mCullStats.DrawCalls += mInstanceBatcher.BatchCount();
+    mCullStats.DrawItems += (UINT)ritems.size();
+#else
     UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
     auto objectCB = mCurrFrameResource->ObjectCB->Resource();
 
-    // 각 렌더 항목에 대해서...
+    // 상수 버퍼 방식은 물체 데이터를 인스턴스별로 읽을 수 없으므로 각 렌더 항목을 따로 그립니다.
     for (size_t i = 0; i < ritems.size(); ++i)
     {
         auto ri = ritems[i];
 
-        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
-
-        // 서술자를 셰이더 프로그램이 사용할 루트 서명의 한 매개변수에 묶는 방법 
-		CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-		tex.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+        // 정렬된 큐에서는 같은 지오메트리가 연달아 나오므로 대부분의 IA 설정은 레코더가 걸러냅니다.
+        recorder.IASetVertexBuffer(ri->Geo->VertexBufferView());
+        recorder.IASetIndexBuffer(ri->Geo->IndexBufferView());
+        recorder.IASetPrimitiveTopology(ri->PrimitiveType);
 
         D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex * objCBByteSize; 
 
-		cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
+		recorder.SetGraphicsRootConstantBufferView(0, objCBAddress);
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+        recorder.DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
     }
+
+    mCullStats.DrawCalls += (UINT)ritems.size();
+    mCullStats.DrawItems += (UINT)ritems.size();
+#endif
 }
 
 void ClientMain::DrawSceneToShadowMap()
@@ -1655,26 +2485,100 @@ void ClientMain::DrawSceneToShadowMap()
     // 렉트의 바깥에 있는 픽셀들은 후면 버퍼에 래스터화 되지 않는다. 
     mCommandList->RSSetScissorRects(1, &mShadowMap->ScissorRect());
 
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
-		D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_DEPTH_WRITE));
-	UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
-	mCommandList->ClearDepthStencilView(mShadowMap->Dsv(),
-		D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
-    // 랜더 타겟을 세팅하지 않는다. 우리는 오직 뎁스 버퍼만 그린다. 랜더 타겟을 세팅하지 않는 것은 컬러를 쓰지 않는다는 것이다. 
-    // pso에 적어라 또한 명확히해라 랜더 타겟이 0인것을.
-	mCommandList->OMSetRenderTargets(0, nullptr, false, &mShadowMap->Dsv());
+	D3D12_VIEWPORT atlasViewport = mShadowMap->Viewport();
+
+	// 캐스케이드 하나를 아틀라스의 자기 사분면에 그리도록 뷰포트, 가위 사각형, 패스 상수를 설정합니다.
+	auto setCascade = [&](int i, D3D12_RECT& scissorRect)
+	{
+		D3D12_VIEWPORT viewport = atlasViewport;
+		viewport.Width = 0.5f * atlasViewport.Width;
+		viewport.Height = 0.5f * atlasViewport.Height;
+		viewport.TopLeftX = (i % 2) * viewport.Width;
+		viewport.TopLeftY = (i / 2) * viewport.Height;
+
+		scissorRect = { (LONG)viewport.TopLeftX, (LONG)viewport.TopLeftY,
+			(LONG)(viewport.TopLeftX + viewport.Width), (LONG)(viewport.TopLeftY + viewport.Height) };
+
+		mCommandList->RSSetViewports(1, &viewport);
+		mCommandList->RSSetScissorRects(1, &scissorRect);
+
+		// Bind the pass constant buffer for the cascade.
+		mRecorder.SetGraphicsRootConstantBufferView(1, mCurrPassCB.ElementGpuAddress(ShadowPassIndex + i));
+	};
+
+	mRecorder.SetPipelineState(mPSOs.Get(mPsoHandles.ShadowOpaque).Get());
+
+	// 볼륨이 바뀐 캐스케이드만 정적 캐스터를 정적 깊이 맵에 다시 그립니다.
+	bool anyInvalid = false;
+	for (int i = 0; i < MaxShadowCascades; ++i)
+		anyInvalid = anyInvalid || !mCascadeCache[i].Valid;
+
+	if (anyInvalid)
+	{
+		mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->StaticResource(),
+			D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_DEPTH_WRITE));
+
+		// 랜더 타겟을 세팅하지 않는다. 우리는 오직 뎁스 버퍼만 그린다.
+		mCommandList->OMSetRenderTargets(0, nullptr, false, &mShadowMap->StaticDsv());
 
-	// Bind the pass constant buffer for the shadow map pass.
-	auto passCB = mCurrFrameResource->PassCB->Resource();
-	D3D12_GPU_VIRTUAL_ADDRESS passCBAddress = passCB->GetGPUVirtualAddress() + 1 * passCBByteSize;
-	mCommandList->SetGraphicsRootConstantBufferView(1, passCBAddress);
+		for (int i = 0; i < MaxShadowCascades; ++i)
+		{
+			if (mCascadeCache[i].Valid)
+				continue;
 
-	mCommandList->SetPipelineState(mPSOs["shadow_opaque"].Get());
+			D3D12_RECT scissorRect;
+			setCascade(i, scissorRect);
 
-	DrawRenderItems(mCommandList.Get(), mRenderItems[(int)RenderLayer::Opaque]);
-	DrawRenderItems(mCommandList.Get(), mRenderItems[(int)RenderLayer::Reflected]);
-	DrawRenderItems(mCommandList.Get(), mRenderItems[(int)RenderLayer::AlphaTested]);
+			mCommandList->ClearDepthStencilView(mShadowMap->StaticDsv(),
+				D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 1, &scissorRect);
 
+			DrawRenderItems(mRecorder, mStaticShadowCasters[i]);
+
+			mCascadeCache[i].Valid = true;
+			++mCullStats.StaticShadowRedraws;
+		}
+
+		mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->StaticResource(),
+			D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_GENERIC_READ));
+	}
+
+	bool anyDynamic = false;
+	for (int i = 0; i < MaxShadowCascades; ++i)
+		anyDynamic = anyDynamic || !mDynamicShadowCasters[i].empty();
+
+	// 그림자 맵이 이미 정적 캐시와 같고 덧그릴 것도 없으면 그대로 씁니다.
+	bool needCopy = anyInvalid || mShadowMapHasDynamic;
+	mShadowMapHasDynamic = anyDynamic;
+	if (!needCopy && !anyDynamic)
+		return;
+
+	// 정적 깊이를 복사하고 그 위에 동적 캐스터만 덧그립니다. 깊이 리소스는 일부 영역만
+	// 복사할 수 없으므로 아틀라스 전체를 복사합니다.
+	if (needCopy)
+	{
+		mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
+			D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_DEST));
+		mCommandList->CopyResource(mShadowMap->Resource(), mShadowMap->StaticResource());
+		mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_DEPTH_WRITE));
+	}
+	else
+	{
+		mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
+			D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_DEPTH_WRITE));
+	}
+
+	mCommandList->OMSetRenderTargets(0, nullptr, false, &mShadowMap->Dsv());
+
+	for (int i = 0; i < MaxShadowCascades; ++i)
+	{
+		if (mDynamicShadowCasters[i].empty())
+			continue;
+
+		D3D12_RECT scissorRect;
+		setCascade(i, scissorRect);
+		DrawRenderItems(mRecorder, mDynamicShadowCasters[i]);
+	}
 
 	// Change back to GENERIC_READ so we can read the texture in a shader.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
@@ -1706,14 +2610,12 @@ void ClientMain::DrawNormalsAndDepth()
 	mCommandList->OMSetRenderTargets(1, &normalMapRtv, true, &DepthStencilView());
 
 	// Bind the constant buffer for this pass.
-	auto passCB = mCurrFrameResource->PassCB->Resource();
-	mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
+	mRecorder.SetGraphicsRootConstantBufferView(1, mCurrPassCB.ElementGpuAddress(0));
 
-	mCommandList->SetPipelineState(mPSOs["drawNormals"].Get());
+	mRecorder.SetPipelineState(mPSOs.Get(mPsoHandles.DrawNormals).Get());
 
-	DrawRenderItems(mCommandList.Get(), mRenderItems[(int)RenderLayer::Opaque]);
-	DrawRenderItems(mCommandList.Get(), mRenderItems[(int)RenderLayer::Reflected]);
-	DrawRenderItems(mCommandList.Get(), mRenderItems[(int)RenderLayer::AlphaTested]);
+	DrawRenderItems(mRecorder, mVisibleRitems[(int)RenderLayer::Opaque]);
+	DrawRenderItems(mRecorder, mVisibleRitems[(int)RenderLayer::AlphaTested]);
 
 	// Change back to GENERIC_READ so we can read the texture in a shader.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(normalMap,
@@ -3,9 +3,25 @@
 #include "../Common/d3dApp.h"
 #include "../Common/GeometryGenerator.h"
 #include "../Common/Camera.h"
+#include "../Common/BoundsUtil.h"
+#include "../Common/FrustumCuller.h"
+#include "../Common/SceneBvh.h"
+#include "../Common/MeshBvh.h"
+#include "../Common/OcclusionCuller.h"
+#include "../Common/DirtyTracker.h"
+#include "../Common/TransformStore.h"
+#include "../Common/UploadRing.h"
+#include "../Common/HandleRegistry.h"
+#include "../Common/RenderQueue.h"
+#include "../Common/CommandRecorder.h"
+#include "../Common/InstanceBatcher.h"
 #include "FrameResource.h"
+#include "PassConstantsBuilder.h"
 #include "ShadowMap.h"
 #include "Ssao.h"
+#include <initializer_list>
+#include <map>
+#include <tuple>
 
 
 using Microsoft::WRL::ComPtr;
@@ -21,22 +37,27 @@ struct RenderItem
 	RenderItem() = default;
 
 	//    ġ, ȸ,   ƮԴϴ.
+	// World, TexTransform, Mat ٲ ڿ MarkRitemDirty ȣؾ մϴ.
+	// ׷ ȯ Ұ ŵǰ   ҽ  ۿ  谡 ٽ ˴ϴ.
 	XMFLOAT4X4 World = MathHelper::Identity4x4();
 	XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
 
-	// Ʈ Ͱ  Ÿ Ƽ ÷Դϴ.
-	// Ƽ ÷װ ȰȭǾ   ۸ Ʈ  մϴ.
-	//   ڿ Ʈ  ۰ ϱ 
-	// Ʈ Ͱ  NumFramesDirty = gNumFrameResource
-	// ؾմϴ. ̷ ϹǷν   ҽ Ʈ ˴ϴ.
-	int NumFramesDirty = gNumFrameResources;
-
 	//  ۿ شϴ ü   ε Դϴ.
 	UINT ObjCBIndex = -1;
 
+	// mAllRitems εԴϴ. ø   ۺ 迭 ε ˴ϴ.
+	UINT ItemIndex = -1;
+
 	MeshGeometry* Geo = nullptr;
 	Material* Mat = nullptr; 
 
+	// Geo mGeometries  ȣԴϴ. ׸  Ű Դϴ.
+	UINT GeoIndex = 0;
+
+	//  Ʈ  (, DrawIndexedInstanced Ķ) ׸ ۳  ȣԴϴ.
+	//   DrawRenderItems   νϽ ׸ Դϴ.
+	UINT SubmeshIndex = 0;
+
 	//  Դϴ.
 	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
@@ -44,6 +65,22 @@ struct RenderItem
 	UINT IndexCount = 0;
 	UINT StartIndexLocation = 0;
 	int BaseVertexLocation = 0;
+
+	// ޽    ڿ World ȯ    Դϴ.
+	// WorldBounds World ٲ ӿ UpdateWorldBounds ٽ ˴ϴ.
+	BoundingBox Bounds;
+	BoundingBox WorldBounds;
+
+	// ޽   ﰢ BVHԴϴ.   ڷ ŷմϴ.
+	MeshBvh* PickBvh = nullptr;
+
+	//  ĳʹ  ׸ ĳÿ   ϴ.  Ŀ World ٲ
+	// UpdateWorldBounds  ĳͷ ٲ   ׸ ʿ ׷ϴ.
+	bool StaticCaster = true;
+
+	//  CPU  ۿ ȭǾ ڿ ִ  ϴ.
+	//    ū  ޽ ǥմϴ.  ۱ ׸ ȭ  ø ̵溸 Ŀϴ.
+	bool Occluder = false;
 };
 
 enum class RenderLayer : int
@@ -82,6 +119,22 @@ private:
 	void OnKeyboardInput(const GameTimer& gt);
 	void UpdateCamera(const GameTimer& gt);
 	void AnimateMaterials(const GameTimer& gt);
+	void UpdateWorldBounds(const GameTimer& gt);
+	void MarkRitemDirty(RenderItem* ri);
+	void AssignItemIndices(RenderItem* ri, UINT index);
+
+	//  ߿   ߰մϴ. ۺ ҵ    ä þϴ.
+	// GeoIndex ȣϴ ʿ   Ʈ ڵ ä Ӵϴ.
+	RenderItem* AddRenderItem(std::unique_ptr<RenderItem> ritem, std::initializer_list<RenderLayer> layers);
+	void SpawnSphere();
+	void CullRenderItems(const GameTimer& gt);
+	void BuildSceneBvh();
+	void CullOccludedItems();
+	void CullMirrors(const XMFLOAT4 cameraPlanes[6]);
+	void SortVisibleItems();
+	void CullShadowCasters(const GameTimer& gt);
+	void InvalidateShadowCache();
+	void Pick(int sx, int sy);
 	void UpdateObjectCBs(const GameTimer& gt);
 	void UpdateMaterialCBs(const GameTimer& gt);
 	void UpdateShadowTransform(const GameTimer& gt);
@@ -105,7 +158,8 @@ private:
 	void BuildRenderItems();
 	void BuildSkyRenderItems();
 	void BuildMaterials();
-	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+	// keepOrder ̸ ̿ ۳ νϽ  ׸  ŵϴ. ( ̾)
+	void DrawRenderItems(CommandRecorder& recorder, const std::vector<RenderItem*>& ritems, bool keepOrder = false);
 
 	void DrawSceneToShadowMap();
 	void DrawNormalsAndDepth();
@@ -124,6 +178,12 @@ private:
 	FrameResource* mCurrFrameResource = nullptr;
 	int mCurrFrameResourceIndex = 0;
 
+	// Ӹ   ε ͸  ִ  Դϴ.  ҽ 潺  ȸ˴ϴ.
+	std::unique_ptr<UploadRing> mUploadRing;
+
+	// ̹  н  Դϴ. Update    PassCount ޽ϴ.
+	UploadSpan<PassConstants> mCurrPassCB;
+
 	ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
 	ComPtr<ID3D12RootSignature> mSsaoRootSignature = nullptr;
 
@@ -131,11 +191,41 @@ private:
 	UINT mCbvSrvDescriptorSize = 0;
 	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
 
-	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
-	std::unordered_map<std::string, std::unique_ptr<Material>> mMaterials;
-	std::unordered_map<std::string, std::unique_ptr<Texture>> mTextures; 
+	// ̸δ   ã,   ̸ ޾  ڵ 迭 ٷ ϴ.
+	HandleRegistry<std::unique_ptr<MeshGeometry>> mGeometries;
+	std::unordered_map<std::string, std::unique_ptr<MeshBvh>> mMeshBvhs;
+	HandleRegistry<std::unique_ptr<Material>> mMaterials;
+
+	// MatCBIndex   Դϴ.    ȸ ʰ ٲ  ε ãϴ.
+	std::vector<Material*> mMaterialList;
+
+	// ٲ  (ItemIndex) (MatCBIndex) Դϴ.  ҽ  ̹Ƿ
+	//   Ʈ ٲ ׸  մϴ.
+	DirtyTracker mObjectDirty;
+	DirtyTracker mMaterialDirty;
+
+	//   ȯ ItemIndex(= ObjCBIndex)  ؼ   Դϴ.
+	// ü  ۴ ⼭ Ѳ ġǾ ϴ.
+	TransformStore mTransforms;
+	HandleRegistry<std::unique_ptr<Texture>> mTextures;
 	std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
-	std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
+	HandleRegistry<ComPtr<ID3D12PipelineState>> mPSOs;
+
+	// Ӹ  PSO ڵԴϴ. BuildPSOs    ã Ӵϴ.
+	typedef Handle<ComPtr<ID3D12PipelineState>> PsoHandle;
+	struct PsoHandles
+	{
+		PsoHandle Opaque;
+		PsoHandle Sky;
+		PsoHandle Debug;
+		PsoHandle MarkStencilMirrors;
+		PsoHandle DrawStencilReflections;
+		PsoHandle Transparent;
+		PsoHandle AlphaTested;
+		PsoHandle ShadowOpaque;
+		PsoHandle DrawNormals;
+	};
+	PsoHandles mPsoHandles;
 
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
 
@@ -148,6 +238,89 @@ private:
 	// PSO     .
 	std::vector<RenderItem*> mRenderItems[(int)RenderLayer::Count];
 
+	// ī޶ ü ø   ۵Դϴ.   CullRenderItems ŵ˴ϴ.
+	std::vector<RenderItem*> mVisibleRitems[(int)RenderLayer::Count];
+
+	// ̴ ۵ °  ͳ ̵ ϴ ť, ̾  ̾ ׸ PSO  ȣԴϴ.
+	RenderQueue mRenderQueue;
+	UINT mLayerPso[(int)RenderLayer::Count] = {};
+
+	// Draw ϴ   ɷ ߺ ȣ ϴ.
+	CommandRecorder mRecorder;
+
+	// DrawRenderItems ׸ ϸ νϽ    ٽ  ۾ Դϴ.
+	InstanceBatcher mInstanceBatcher;
+
+	// (Ʈ, , ε ,  ε,  )  ޽ ȣԴϴ.
+	std::map<std::tuple<UINT, D3D12_PRIMITIVE_TOPOLOGY, UINT, UINT, int>, UINT> mSubmeshIndices;
+	std::vector<std::uint64_t> mInstanceKeys;
+
+	// ϴð  带   ۵   BVHԴϴ. ItemIndex ĺմϴ.
+	// ü ø 콺 ŷ ˴ϴ.
+	SceneBvh mSceneBvh;
+	std::vector<UINT> mBvhResults;
+	std::vector<std::pair<float, UINT>> mBvhRayHits;
+	std::vector<std::uint8_t> mItemVisible;
+
+	// ĳ̵庰 ׸ ʿ ׸ ۵Դϴ.   CullShadowCasters ĳ̵  ü ø˴ϴ.
+	// ſ    鿡 ׸ڸ 帮 Ƿ  ʽϴ.
+	std::vector<RenderItem*> mStaticShadowCasters[MaxShadowCascades];
+	std::vector<RenderItem*> mDynamicShadowCasters[MaxShadowCascades];
+	std::vector<std::uint8_t> mCasterVisible;
+
+	// Occluder ǥõ   ׸ ػ CPU  Դϴ.
+	OcclusionCuller mOcclusionCuller;
+	std::vector<RenderItem*> mOccluders;
+	std::vector<RenderItem*> mOcclusionItems;
+	std::vector<BoundingBox> mOcclusionBoxes;
+	std::vector<std::uint8_t> mOcclusionVisible;
+
+	// ̴ ſ︶  ſ 𼭸    ſ  ̷  üԴϴ.
+	// ݻ ̾  ݻ 谡  ȿ ־ ׷ϴ.
+	// ̴ ſ  ٽ ǥÿ ݻ н ° ǳʶٰ,   н ſ ȭ 簢 ڸϴ.
+	struct MirrorPortal
+	{
+		XMFLOAT4 Planes[5];
+	};
+	std::vector<MirrorPortal> mMirrorPortals;
+	D3D12_RECT mMirrorScissorRect = {};
+
+	// 콺  ư   ۰   ﰢԴϴ.
+	// â  ǥõǸ,  ٲ mCaptionDirty ˴ϴ.
+	RenderItem* mPickedRitem = nullptr;
+	MeshBvh::Hit mPickedHit;
+	bool mCaptionDirty = false;
+
+	struct CullStats
+	{
+		UINT Tested = 0;
+		UINT Visible = 0;
+		UINT Occluded = 0;
+		UINT MirrorsVisible = 0;
+		UINT ReflectedCulled = 0;
+		UINT ShadowCasters[MaxShadowCascades] = {};
+		UINT StaticShadowRedraws = 0;
+		UINT LayerVisible[(int)RenderLayer::Count] = {};
+
+		// ĵ ׸  PSO,  ,  ȯ Ƚ ķ پ ȽԴϴ.
+		UINT DrawStateChanges = 0;
+		UINT DrawStateChangesAvoided = 0;
+
+		// ڴ     ȣ  ߺ̶  ȣ Դϴ.
+		UINT CommandsIssued = 0;
+		UINT CommandsElided = 0;
+
+		//   ׸ ȣ   ȣ ׸  Դϴ.
+		UINT DrawCalls = 0;
+		UINT DrawItems = 0;
+	};
+	CullStats mCullStats;
+
+	// â     ׸ ȣ   Դϴ.
+	std::wstring mBaseWndCaption;
+	UINT mShownDrawCalls = 0;
+	UINT mShownDrawItems = 0;
+
 	XMFLOAT3 mReflectTranslation = { 0.0f, 1.0f, -5.0f };
 
 	UINT mSkyTexHeapIndex = 0;		//D3D12_DESCRIPTOR_HEAP_DESC ⼭  ε ..
@@ -162,26 +335,90 @@ private:
 	CD3DX12_GPU_DESCRIPTOR_HANDLE mNullSrv;
 
 	PassConstants mMainPassCB;
-	PassConstants mReflectedPassCB;
-	PassConstants mShadowPassCB;// index 1 of pass cbuffer.
+
+	// н ī޶ İ  Է ٲ  ٽ մϴ.
+	PassConstantsBuilder mMainPassBuilder;
+	PassConstantsBuilder mShadowPassBuilders[MaxShadowCascades];
+
+	// ſ ޽    Դϴ. ݻ н ݻ İ ݻ  ø Դϴ.
+	XMFLOAT4 mMirrorPlane = { 1.0f, 0.0f, 0.0f, 0.0f };
+	PassConstants mShadowPassCBs[MaxShadowCascades];// index 2.. of pass cbuffer.
+
+	// н   ԵԴϴ. 0  н, 1 ݻ н,  ڴ ĳ̵庰 ׸ нԴϴ.
+	static const UINT ReflectedPassIndex = 1;
+	static const UINT ShadowPassIndex = 2;
+	static const UINT PassCount = ShadowPassIndex + MaxShadowCascades;
+
+	//   Ʈ ۾ 忡     ۾ ô  Դϴ.
+	//  ȯ 뺸  Ŀ ϰ,  ȣ 忡   ó˴ϴ.
+	static const UINT ObjectUpdateChunkSize = 2048;
+	static const UINT MaterialUpdateChunkSize = 64;
+
+	// ε  ũԴϴ.   gNumFrameResources  ӽ ͸    ־ մϴ.
+	static const UINT64 UploadRingByteSize = 4 * 1024 * 1024;
 
 
 	UINT mPassCbvOffset = 0;
-	RenderItem* mReflectedSkullRitem = nullptr;
 
 	Camera mCamera;
 
 	POINT mLastMousePos;
 
+	// N Ű  ִ     鵵   Ű ¸ մϴ.
+	bool mSpawnKeyDown = false;
+
+	// SpawnSphere  Ʈ, , ޽, ﰢ BVHԴϴ.
+	// BuildRenderItems   ã ιǷ    ̸ ؽ ʽϴ.
+	Handle<std::unique_ptr<MeshGeometry>> mSpawnGeo;
+	Handle<std::unique_ptr<Material>> mSpawnMat;
+	SubmeshGeometry mSpawnSubmesh;
+	MeshBvh* mSpawnBvh = nullptr;
 
+
+	// ϴð  带      踦 δ Դϴ.
+	//   UpdateWorldBounds ŵ˴ϴ.
 	DirectX::BoundingSphere mSceneBounds;
 
-	float mLightNearZ = 0.0f;
-	float mLightFarZ = 0.0f;
+	// ĳ̵ ׸ Դϴ. 2048x2048 ׸  2x2 Ʋ󽺷 
+	// ĳ̵帶 1024x1024 ϴ.  þ   ĳ̵尡 մϴ.
 	XMFLOAT3 mLightPosW;
 	XMFLOAT4X4 mLightView = MathHelper::Identity4x4();
-	XMFLOAT4X4 mLightProj = MathHelper::Identity4x4();
-	XMFLOAT4X4 mShadowTransform = MathHelper::Identity4x4();
+	XMFLOAT4X4 mCascadeProj[MaxShadowCascades];
+	XMFLOAT4X4 mShadowTransforms[MaxShadowCascades];
+	float mCascadeNearZ[MaxShadowCascades] = {};
+	float mCascadeFarZ[MaxShadowCascades] = {};
+
+	//  ĳ̵尡  þ  Դϴ.
+	float mCascadeSplits[MaxShadowCascades] = {};
+
+	// ׸ڰ ׷ ִ þ Ÿ, α (1) յ (0)  Դϴ.
+	float mShadowDistance = 120.0f;
+	float mCascadeSplitLambda = 0.75f;
+
+	//  ׸ ĳԴϴ. ĳ̵    ٲ ʴ   ĳ ̸
+	// ٽ ׸ ʽϴ.  ī޶   mShadowGuardBand ŭ а,
+	//    ȿ ̴ ȿ ״ ˴ϴ.
+	struct ShadowCascadeCache
+	{
+		float CenterX = 0.0f;
+		float CenterY = 0.0f;
+		float Radius = 0.0f;
+		float NearZ = 0.0f;
+		float FarZ = 0.0f;
+		bool Valid = false;
+	};
+	ShadowCascadeCache mCascadeCache[MaxShadowCascades];
+	float mShadowGuardBand = 0.25f;
+
+	// ׸ ʿ   ĳ͸ ׷ȴ Դϴ. ׸    ĳõ
+	// ٽ ׸ ʾ ׸   ĳÿ Ƿ 縦 ǳʶݴϴ.
+	bool mShadowMapHasDynamic = false;
+
+	//    ȸ mShadowCacheAngle()   ŵ˴ϴ.
+	float mShadowCacheAngle = XMConvertToRadians(0.5f);
+
+	// ù UpdateWorldBounds  true ˴ϴ.   World   Դϴ.
+	bool mSceneStarted = false;
 
 	float mLightRotationAngle = 0.0f;
 	XMFLOAT3 mBaseLightDirections[3] = {
@@ -189,6 +426,7 @@ private:
 		XMFLOAT3(-0.57735f, -0.57735f, 0.57735f),
 		XMFLOAT3(0.0f, -0.707f, -0.707f)
 	};
-	XMFLOAT3 mRotatedLightDirections[3];
+	//  ׸ڰ Բ   Դϴ. Ӱ    ٲǷ  ߳ ʽϴ.
+	XMFLOAT3 mRotatedLightDirections[3] = {};
 
 };
\ No newline at end of file
@@ -1,14 +1,17 @@
 #include "FrameResource.h"
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount)
+FrameResource::FrameResource(ID3D12Device* device, UINT objectCount, UINT materialCount)
 {
 	ThrowIfFailed(device->CreateCommandAllocator(
 		D3D12_COMMAND_LIST_TYPE_DIRECT,
 		IID_PPV_ARGS(&CmdListAlloc)));
 
-	PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
 	MaterialCB = std::make_unique<UploadBuffer<MaterialData>>(device, materialCount, false);
-	ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
+#ifdef PACKED_OBJECT_DATA
+	ObjectCB = std::make_unique<GrowableUploadBuffer<ObjectData>>(device, objectCount, false);
+#else
+	ObjectCB = std::make_unique<GrowableUploadBuffer<ObjectConstants>>(device, objectCount, true);
+#endif
 	SsaoCB = std::make_unique<UploadBuffer<SsaoConstants>>(device, 1, true);
 }
 
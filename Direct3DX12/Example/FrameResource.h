@@ -3,6 +3,10 @@
 #include "../Common/d3dUtil.h"
 #include "../Common/MathHelper.h"
 #include "../Common/UploadBuffer.h"
+#include "../Common/GrowableUploadBuffer.h"
+
+// ׸  Ʋ ĳ̵ Դϴ. common.hlsl ƾ մϴ.
+#define MaxShadowCascades 4
 
 struct Vertex
 {
@@ -10,8 +14,28 @@ struct Vertex
 	DirectX::XMFLOAT3 Normal;
 	DirectX::XMFLOAT2 TexC;
 	DirectX::XMFLOAT3 TangentU;
+	float TangentW = 1.0f; // źƮ  ⼺
 };
 
+// PACKED_OBJECT_DATA ϸ ü ͸ 256Ʈ     ƴ  ۷ øϴ.
+// ̴  ũΰ ޵˴ϴ. (BuildShadersAndInputLayout)
+// Ʈ    ũθ մϴ.  ü      ˴ϴ.
+#ifdef PACKED_OBJECT_DATA
+struct ObjectData // common.hlsl --> StructuredBuffer<ObjectData> gObjectData : register(t1, space1)
+{
+	//    ġ    Դϴ.   ׻ (0, 0, 0, 1)Դϴ.
+	DirectX::XMFLOAT4 World[3];
+
+	// ؽó ȯ xy ϰ xy ̵Դϴ. ȸ  ؽó ȯ   ֽϴ.
+	DirectX::XMFLOAT4 TexScaleOffset;
+
+	UINT     MaterialIndex;
+	UINT     ObjPad0;
+	UINT     ObjPad1;
+	UINT     ObjPad2;
+};
+#endif
+
 struct ObjectConstants // common.hlsl --> cbuffer cbPerObject : register(b0)
 {
 	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
@@ -30,7 +54,15 @@ struct PassConstants
 	DirectX::XMFLOAT4X4 InvProj = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 ViewProj = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 InvViewProj = MathHelper::Identity4x4();
-	DirectX::XMFLOAT4X4 ShadowTransform = MathHelper::Identity4x4();
+
+	// ĳ̵庰  -> ׸  Ʋ ؽó  ȯԴϴ.
+	DirectX::XMFLOAT4X4 ShadowTransforms[MaxShadowCascades];
+
+	//  ĳ̵尡  þ  Դϴ.
+	DirectX::XMFLOAT4 CascadeSplits = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	//   ġ ߰ ϴ ȯԴϴ. ݻ н ſ 鿡  ݻ ̰  ܿ  Դϴ.
+	DirectX::XMFLOAT4X4 Reflect = MathHelper::Identity4x4();
 
 
 	DirectX::XMFLOAT3 EyePosW = { 0.0f, 0.0f, 0.0f };
@@ -94,7 +126,7 @@ struct MaterialData
 struct FrameResource
 {
 public:
-	FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount);
+	FrameResource(ID3D12Device* device, UINT objectCount, UINT materialCount);
 	FrameResource(const FrameResource& rhs) = delete;
 	FrameResource& operator=(const FrameResource& rhs) = delete;
 	~FrameResource();
@@ -105,10 +137,15 @@ public:
 
 	// GPU  ɵ óϱ   ۸ Ʈ   ϴ.
 	// ׷Ƿ  Ӹ  ۰ ʿմϴ.
-	std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
+	// н ó   ° ٽ  ʹ   ʰ ε  Ҵմϴ.
 	std::unique_ptr<UploadBuffer<MaterialData>> MaterialCB = nullptr;
 	std::unique_ptr<UploadBuffer<SsaoConstants>> SsaoCB = nullptr;
-	std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
+	//    ߿ ð   Ƿ ü ۴ ũⰡ ٲ ۸ ϴ.
+#ifdef PACKED_OBJECT_DATA
+	std::unique_ptr<GrowableUploadBuffer<ObjectData>> ObjectCB = nullptr;
+#else
+	std::unique_ptr<GrowableUploadBuffer<ObjectConstants>> ObjectCB = nullptr;
+#endif
 
 	// 潺   潺  ɵ ǥմϴ.
 	//    GPU ؼ ڿ ϴ ˻  ְ ݴϴ.
@@ -0,0 +1,480 @@
+#include "Heightfield.h"
+
+using namespace DirectX;
+
+Heightfield::Tile::~Tile()
+{
+	if (View != nullptr)
+		UnmapViewOfFile(View);
+}
+
+UINT Heightfield::MipOffset(UINT tileSize, UINT mip)
+{
+	UINT offset = 0;
+	for (UINT m = 0; m < mip; ++m)
+	{
+		UINT n = (tileSize >> m) + 1;
+		offset += n * n;
+	}
+
+	return offset;
+}
+
+void Heightfield::ConvertRaw(
+	const std::wstring& rawFilename,
+	UINT width, UINT depth,
+	UINT tileSize,
+	float cellSize, float heightScale, float heightOffset,
+	const std::wstring& outFilename)
+{
+	assert(width > 1 && depth > 1);
+	assert(tileSize > 0 && (tileSize & (tileSize - 1)) == 0);
+
+	std::ifstream fin(rawFilename, std::ios::binary);
+	if (!fin)
+		ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND));
+
+	FileHeader header;
+	header.Width = width;
+	header.Depth = depth;
+	header.TileSize = tileSize;
+	header.TilesX = (width - 2) / tileSize + 1;
+	header.TilesZ = (depth - 2) / tileSize + 1;
+	header.CellSize = cellSize;
+	header.HeightScale = heightScale;
+	header.HeightOffset = heightOffset;
+
+	// Mips go down to a single quad per tile.
+	header.MipCount = 1;
+	while ((tileSize >> header.MipCount) > 0)
+		++header.MipCount;
+
+	std::ofstream fout(outFilename, std::ios::binary);
+	if (!fout)
+		ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_CANNOT_MAKE));
+
+	// The index is written again once the tile offsets are known.
+	std::vector<TileEntry> entries(header.TilesX * header.TilesZ);
+	fout.write((const char*)&header, sizeof(FileHeader));
+	fout.write((const char*)entries.data(), entries.size() * sizeof(TileEntry));
+
+	const UINT n = tileSize + 1;
+	std::vector<std::uint16_t> strip(n * width);
+	std::vector<std::uint16_t> tile(MipOffset(tileSize, header.MipCount));
+
+	for (UINT tz = 0; tz < header.TilesZ; ++tz)
+	{
+		// Source rows covered by this row of tiles.  Rows past the end of the
+		// map repeat the last one.
+		for (UINT r = 0; r < n; ++r)
+		{
+			UINT row = MathHelper::Min(tz * tileSize + r, depth - 1);
+			fin.seekg((std::streamoff)row * width * sizeof(std::uint16_t), std::ios_base::beg);
+			fin.read((char*)&strip[r * width], width * sizeof(std::uint16_t));
+		}
+
+		for (UINT tx = 0; tx < header.TilesX; ++tx)
+		{
+			TileEntry& entry = entries[tz * header.TilesX + tx];
+			entry.MinSample = 0xffff;
+			entry.MaxSample = 0;
+
+			for (UINT i = 0; i < n; ++i)
+			{
+				for (UINT j = 0; j < n; ++j)
+				{
+					UINT col = MathHelper::Min(tx * tileSize + j, width - 1);
+					std::uint16_t s = strip[i * width + col];
+
+					tile[i * n + j] = s;
+					entry.MinSample = MathHelper::Min(entry.MinSample, s);
+					entry.MaxSample = MathHelper::Max(entry.MaxSample, s);
+				}
+			}
+
+			// Every mip keeps every other sample of the previous one, so tile
+			// borders stay identical between neighbours at every level.
+			for (UINT m = 1; m < header.MipCount; ++m)
+			{
+				const UINT srcN = (tileSize >> (m - 1)) + 1;
+				const UINT dstN = (tileSize >> m) + 1;
+				const std::uint16_t* src = &tile[MipOffset(tileSize, m - 1)];
+				std::uint16_t* dst = &tile[MipOffset(tileSize, m)];
+
+				for (UINT i = 0; i < dstN; ++i)
+					for (UINT j = 0; j < dstN; ++j)
+						dst[i * dstN + j] = src[(2 * i) * srcN + 2 * j];
+			}
+
+			entry.Offset = (UINT64)fout.tellp();
+			entry.ByteSize = (UINT)(tile.size() * sizeof(std::uint16_t));
+			fout.write((const char*)tile.data(), entry.ByteSize);
+		}
+	}
+
+	fout.seekp(sizeof(FileHeader), std::ios_base::beg);
+	fout.write((const char*)entries.data(), entries.size() * sizeof(TileEntry));
+}
+
+Heightfield::Heightfield(const std::wstring& filename, UINT maxResidentTiles)
+	: mMaxResidentTiles(maxResidentTiles)
+{
+	assert(mMaxResidentTiles > 0);
+
+	mFile = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (mFile == INVALID_HANDLE_VALUE)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+	mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMapping == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+	// Views must start on an allocation granularity boundary.
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	mAllocationGranularity = info.dwAllocationGranularity;
+
+	void* headerView = MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, sizeof(FileHeader));
+	if (headerView == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+	mHeader = *(const FileHeader*)headerView;
+	UnmapViewOfFile(headerView);
+
+	if (mHeader.Magic != Magic || mHeader.Version != Version)
+		ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_BAD_FORMAT));
+
+	// The header and tile index stay mapped for the lifetime of the reader.
+	SIZE_T indexBytes = sizeof(FileHeader) + (SIZE_T)mHeader.TilesX * mHeader.TilesZ * sizeof(TileEntry);
+	mIndexView = MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, indexBytes);
+	if (mIndexView == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+	mTiles = (const TileEntry*)((const BYTE*)mIndexView + sizeof(FileHeader));
+
+	mPrefetchThread = std::thread(&Heightfield::PrefetchMain, this);
+}
+
+Heightfield::~Heightfield()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mPrefetchCv.notify_all();
+
+	if (mPrefetchThread.joinable())
+		mPrefetchThread.join();
+
+	mResident.clear();
+	mLru.clear();
+
+	if (mIndexView != nullptr)
+		UnmapViewOfFile(mIndexView);
+	if (mMapping != nullptr)
+		CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+}
+
+float Heightfield::Sample(float x, float z, UINT mip)
+{
+	SamplePoint point = Locate(x, z, mip);
+	std::shared_ptr<Tile> tile = AcquireTile(point.TileZ * mHeader.TilesX + point.TileX);
+
+	return Blend(*tile, point);
+}
+
+Heightfield::Region Heightfield::PinRegion(float minX, float minZ, float maxX, float maxZ)
+{
+	// The tile a position falls in does not depend on the mip.
+	SamplePoint first = Locate(minX, minZ, 0);
+	SamplePoint last = Locate(maxX, maxZ, 0);
+
+	Region region;
+	region.mOwner = this;
+	region.mMinX = minX;
+	region.mMinZ = minZ;
+	region.mMaxX = maxX;
+	region.mMaxZ = maxZ;
+	region.mTileX0 = first.TileX;
+	region.mTileZ0 = first.TileZ;
+	region.mTilesX = last.TileX - first.TileX + 1;
+	region.mTilesZ = last.TileZ - first.TileZ + 1;
+	region.mTiles.resize(region.mTilesX * region.mTilesZ);
+
+	return region;
+}
+
+float Heightfield::Region::Sample(float x, float z, UINT mip)
+{
+	x = MathHelper::Clamp(x, mMinX, mMaxX);
+	z = MathHelper::Clamp(z, mMinZ, mMaxZ);
+
+	SamplePoint point = mOwner->Locate(x, z, mip);
+	assert(point.TileX - mTileX0 < mTilesX && point.TileZ - mTileZ0 < mTilesZ);
+
+	std::shared_ptr<Tile>& tile = mTiles[(point.TileZ - mTileZ0) * mTilesX + (point.TileX - mTileX0)];
+	if (tile == nullptr)
+		tile = mOwner->AcquireTile(point.TileZ * mOwner->mHeader.TilesX + point.TileX);
+
+	return mOwner->Blend(*tile, point);
+}
+
+void Heightfield::HeightRange(float minX, float minZ, float maxX, float maxZ, float& minY, float& maxY)const
+{
+	SamplePoint first = Locate(minX, minZ, 0);
+	SamplePoint last = Locate(maxX, maxZ, 0);
+
+	std::uint16_t minSample = 0xffff;
+	std::uint16_t maxSample = 0;
+	for (UINT tz = first.TileZ; tz <= last.TileZ; ++tz)
+	{
+		for (UINT tx = first.TileX; tx <= last.TileX; ++tx)
+		{
+			const TileEntry& entry = mTiles[tz * mHeader.TilesX + tx];
+			minSample = MathHelper::Min(minSample, entry.MinSample);
+			maxSample = MathHelper::Max(maxSample, entry.MaxSample);
+		}
+	}
+
+	float h0 = mHeader.HeightOffset + minSample * mHeader.HeightScale;
+	float h1 = mHeader.HeightOffset + maxSample * mHeader.HeightScale;
+	minY = MathHelper::Min(h0, h1);
+	maxY = MathHelper::Max(h0, h1);
+}
+
+Heightfield::SamplePoint Heightfield::Locate(float x, float z, UINT mip)const
+{
+	mip = MathHelper::Min(mip, mHeader.MipCount - 1);
+
+	const UINT ts = mHeader.TileSize >> mip;
+	const float invSpacing = 1.0f / (mHeader.CellSize * (1 << mip));
+
+	// Continuous sample coordinates at this mip.
+	float fx = (x + 0.5f * WorldWidth()) * invSpacing;
+	float fz = (z + 0.5f * WorldDepth()) * invSpacing;
+	fx = MathHelper::Clamp(fx, 0.0f, (float)(mHeader.TilesX * ts));
+	fz = MathHelper::Clamp(fz, 0.0f, (float)(mHeader.TilesZ * ts));
+
+	UINT tx = MathHelper::Min((UINT)fx / ts, mHeader.TilesX - 1);
+	UINT tz = MathHelper::Min((UINT)fz / ts, mHeader.TilesZ - 1);
+
+	float lx = fx - (float)(tx * ts);
+	float lz = fz - (float)(tz * ts);
+
+	UINT j = MathHelper::Min((UINT)lx, ts - 1);
+	UINT i = MathHelper::Min((UINT)lz, ts - 1);
+
+	SamplePoint point;
+	point.TileX = tx;
+	point.TileZ = tz;
+	point.RowPitch = ts + 1;
+	point.Offset = MipOffset(mHeader.TileSize, mip) + i * point.RowPitch + j;
+	point.S = lx - j;
+	point.T = lz - i;
+
+	return point;
+}
+
+float Heightfield::Blend(const Tile& tile, const SamplePoint& point)const
+{
+	const UINT n = point.RowPitch;
+	const std::uint16_t* p = tile.Samples + point.Offset;
+
+	float h0 = MathHelper::Lerp((float)p[0], (float)p[1], point.S);
+	float h1 = MathHelper::Lerp((float)p[n], (float)p[n + 1], point.S);
+
+	return mHeader.HeightOffset + MathHelper::Lerp(h0, h1, point.T) * mHeader.HeightScale;
+}
+
+void Heightfield::UpdateResidency(float x, float z, float radius)
+{
+	const float tileWorld = mHeader.TileSize * mHeader.CellSize;
+
+	float fx = (x + 0.5f * WorldWidth()) / tileWorld;
+	float fz = (z + 0.5f * WorldDepth()) / tileWorld;
+	float fr = radius / tileWorld;
+
+	int tx0 = MathHelper::Max((int)floorf(fx - fr), 0);
+	int tz0 = MathHelper::Max((int)floorf(fz - fr), 0);
+	int tx1 = MathHelper::Min((int)floorf(fx + fr), (int)mHeader.TilesX - 1);
+	int tz1 = MathHelper::Min((int)floorf(fz + fr), (int)mHeader.TilesZ - 1);
+
+	std::vector<std::pair<float, UINT>> wanted;
+	for (int tz = tz0; tz <= tz1; ++tz)
+	{
+		for (int tx = tx0; tx <= tx1; ++tx)
+		{
+			float dx = tx + 0.5f - fx;
+			float dz = tz + 0.5f - fz;
+			wanted.push_back(std::make_pair(dx * dx + dz * dz, (UINT)(tz * mHeader.TilesX + tx)));
+		}
+	}
+
+	std::sort(wanted.begin(), wanted.end());
+
+	// Never ask for more than half the cache, otherwise prefetched tiles would
+	// evict each other before they are used.
+	size_t limit = MathHelper::Max<size_t>(mMaxResidentTiles / 2, 1);
+	if (wanted.size() > limit)
+		wanted.resize(limit);
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		mPrefetchQueue.clear();
+		for (auto it = wanted.rbegin(); it != wanted.rend(); ++it)
+		{
+			auto resident = mResident.find(it->second);
+			if (resident != mResident.end())
+			{
+				// Keep tiles around the camera at the warm end of the LRU.
+				mLru.splice(mLru.begin(), mLru, resident->second.LruPos);
+			}
+			else
+			{
+				mPrefetchQueue.push_front(it->second);
+			}
+		}
+	}
+
+	mPrefetchCv.notify_one();
+}
+
+float Heightfield::WorldWidth()const
+{
+	return (mHeader.Width - 1) * mHeader.CellSize;
+}
+
+float Heightfield::WorldDepth()const
+{
+	return (mHeader.Depth - 1) * mHeader.CellSize;
+}
+
+const Heightfield::FileHeader& Heightfield::Header()const
+{
+	return mHeader;
+}
+
+Heightfield::Stats Heightfield::GetStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	Stats stats = mStats;
+	stats.Resident = (UINT)mResident.size();
+	return stats;
+}
+
+std::shared_ptr<Heightfield::Tile> Heightfield::AcquireTile(UINT tileIndex)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		auto it = mResident.find(tileIndex);
+		if (it != mResident.end())
+		{
+			mLru.splice(mLru.begin(), mLru, it->second.LruPos);
+			return it->second.Data;
+		}
+
+		++mStats.SyncLoads;
+	}
+
+	// Map outside the lock so other threads keep sampling resident tiles.
+	std::shared_ptr<Tile> tile = MapTile(tileIndex);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// Another thread may have mapped the same tile in the meantime.
+	auto it = mResident.find(tileIndex);
+	if (it != mResident.end())
+		return it->second.Data;
+
+	InsertTile(tileIndex, tile);
+	return tile;
+}
+
+std::shared_ptr<Heightfield::Tile> Heightfield::MapTile(UINT tileIndex)const
+{
+	const TileEntry& entry = mTiles[tileIndex];
+
+	UINT64 alignedOffset = entry.Offset - entry.Offset % mAllocationGranularity;
+	SIZE_T delta = (SIZE_T)(entry.Offset - alignedOffset);
+
+	void* view = MapViewOfFile(mMapping, FILE_MAP_READ,
+		(DWORD)(alignedOffset >> 32), (DWORD)(alignedOffset & 0xffffffff),
+		delta + entry.ByteSize);
+	if (view == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+	auto tile = std::make_shared<Tile>();
+	tile->View = view;
+	tile->Samples = (const std::uint16_t*)((const BYTE*)view + delta);
+
+	return tile;
+}
+
+void Heightfield::InsertTile(UINT tileIndex, std::shared_ptr<Tile> tile)
+{
+	// Caller holds mMutex.
+	ResidentTile& resident = mResident[tileIndex];
+	resident.Data = std::move(tile);
+	resident.LruPos = mLru.insert(mLru.begin(), tileIndex);
+	++mStats.TilesMapped;
+
+	while (mResident.size() > mMaxResidentTiles)
+	{
+		UINT victim = mLru.back();
+		mLru.pop_back();
+		mResident.erase(victim);
+		++mStats.TilesEvicted;
+	}
+}
+
+void Heightfield::PrefetchMain()
+{
+	for (;;)
+	{
+		UINT tileIndex = 0;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mPrefetchCv.wait(lock, [this] { return mQuit || !mPrefetchQueue.empty(); });
+
+			if (mQuit)
+				return;
+
+			tileIndex = mPrefetchQueue.front();
+			mPrefetchQueue.pop_front();
+
+			if (mResident.count(tileIndex) != 0)
+				continue;
+		}
+
+		std::shared_ptr<Tile> tile;
+		try
+		{
+			tile = MapTile(tileIndex);
+		}
+		catch (DxException&)
+		{
+			// Leave it to the sampling thread, which reports the error.
+			continue;
+		}
+
+		// Touch every page so the page faults are taken here rather than on the
+		// thread that samples the tile.
+		const BYTE* bytes = (const BYTE*)tile->Samples;
+		volatile BYTE sink = 0;
+		for (UINT b = 0; b < mTiles[tileIndex].ByteSize; b += 4096)
+			sink = sink + bytes[b];
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mResident.count(tileIndex) == 0)
+		{
+			InsertTile(tileIndex, tile);
+			++mStats.TilesPrefetched;
+		}
+	}
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "../Common/d3dUtil.h"
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+
+// Tiled, memory-mapped heightfield.
+//
+// File layout:
+//
+//   FileHeader
+//   TileEntry[TilesX * TilesZ]    row major, tile (0, 0) at the -x/-z corner
+//   tile data
+//
+// A tile stores (TileSize + 1)^2 16-bit samples for mip 0 followed by its
+// coarser mips, each taking every other sample of the previous one.  Tiles
+// repeat their neighbour's border row and column so any bilinear lookup is
+// served by a single tile.
+//
+// The reader maps the header and index once and maps individual tiles on
+// demand.  At most MaxResidentTiles tile views are kept, so memory use does not
+// depend on the size of the map.  UpdateResidency() queues the tiles around the
+// camera for a worker thread that maps them and touches their pages ahead of
+// use.
+//
+// Sample() takes the reader's lock on every call.  Code that samples one area
+// many times, such as a chunk build, should pin it with PinRegion() and sample
+// the region instead, which takes the lock once per tile.
+class Heightfield
+{
+	struct Tile;
+
+public:
+	static const UINT Magic = 0x31444648; // "HFD1"
+	static const UINT Version = 1;
+
+	struct FileHeader
+	{
+		UINT Magic = Heightfield::Magic;
+		UINT Version = Heightfield::Version;
+
+		// Samples in the source heightmap.
+		UINT Width = 0;
+		UINT Depth = 0;
+
+		// Quads per tile edge, a power of two.
+		UINT TileSize = 0;
+		UINT TilesX = 0;
+		UINT TilesZ = 0;
+		UINT MipCount = 0;
+
+		// World distance between samples, and height = HeightOffset + sample * HeightScale.
+		float CellSize = 1.0f;
+		float HeightScale = 1.0f;
+		float HeightOffset = 0.0f;
+
+		UINT Reserved = 0;
+	};
+
+	struct TileEntry
+	{
+		UINT64 Offset = 0;
+		UINT ByteSize = 0;
+
+		// Raw sample range, usable for conservative bounds without mapping the tile.
+		std::uint16_t MinSample = 0;
+		std::uint16_t MaxSample = 0;
+	};
+
+	struct Stats
+	{
+		UINT TilesMapped = 0;
+		UINT TilesEvicted = 0;
+		UINT TilesPrefetched = 0;
+		UINT SyncLoads = 0;
+		UINT Resident = 0;
+	};
+
+	// The tiles under a rectangle of the map.  Each tile is acquired on its first
+	// use and then stays mapped for the lifetime of the region, so samples after
+	// the first one per tile need no lock.  A region belongs to one thread.
+	class Region
+	{
+	public:
+		// Bilinear height at world (x, z), clamped to the region.
+		float Sample(float x, float z, UINT mip = 0);
+
+	private:
+		friend class Heightfield;
+
+		Heightfield* mOwner = nullptr;
+
+		float mMinX = 0.0f;
+		float mMinZ = 0.0f;
+		float mMaxX = 0.0f;
+		float mMaxZ = 0.0f;
+
+		UINT mTileX0 = 0;
+		UINT mTileZ0 = 0;
+		UINT mTilesX = 0;
+		UINT mTilesZ = 0;
+		std::vector<std::shared_ptr<Tile>> mTiles;
+	};
+
+public:
+	// Converts a 16-bit little endian RAW heightmap into the tiled format.  Only
+	// one row of tiles is held in memory at a time.
+	static void ConvertRaw(
+		const std::wstring& rawFilename,
+		UINT width, UINT depth,
+		UINT tileSize,
+		float cellSize, float heightScale, float heightOffset,
+		const std::wstring& outFilename);
+
+	Heightfield(const std::wstring& filename, UINT maxResidentTiles = 64);
+	Heightfield(const Heightfield& rhs) = delete;
+	Heightfield& operator=(const Heightfield& rhs) = delete;
+	~Heightfield();
+
+	// Bilinear height at world (x, z).  The map is centered at the origin.
+	// Safe to call from several threads.
+	float Sample(float x, float z, UINT mip = 0);
+
+	// Region covering world [minX, maxX] x [minZ, maxZ].  Nothing is mapped until
+	// the region is sampled.
+	Region PinRegion(float minX, float minZ, float maxX, float maxZ);
+
+	// Conservative height range of world [minX, maxX] x [minZ, maxZ], read from
+	// the tile index without mapping any tile.
+	void HeightRange(float minX, float minZ, float maxX, float maxZ, float& minY, float& maxY)const;
+
+	// Queues the tiles within radius of (x, z) for prefetch, nearest first, and
+	// drops queued requests that are no longer wanted.
+	void UpdateResidency(float x, float z, float radius);
+
+	float WorldWidth()const;
+	float WorldDepth()const;
+	const FileHeader& Header()const;
+	Stats GetStats();
+
+private:
+	// One mapped tile.  Held by shared_ptr so an evicted tile stays mapped until
+	// the last reader is done with it.
+	struct Tile
+	{
+		void* View = nullptr;
+		const std::uint16_t* Samples = nullptr;
+
+		~Tile();
+	};
+
+	struct ResidentTile
+	{
+		std::shared_ptr<Tile> Data;
+		std::list<UINT>::iterator LruPos;
+	};
+
+	// Where a world position falls at a given mip: the tile, the first of the
+	// four samples around it within the tile data, and the blend weights.
+	struct SamplePoint
+	{
+		UINT TileX = 0;
+		UINT TileZ = 0;
+		UINT Offset = 0;
+		UINT RowPitch = 0;
+		float S = 0.0f;
+		float T = 0.0f;
+	};
+
+	SamplePoint Locate(float x, float z, UINT mip)const;
+	float Blend(const Tile& tile, const SamplePoint& point)const;
+
+	std::shared_ptr<Tile> AcquireTile(UINT tileIndex);
+	std::shared_ptr<Tile> MapTile(UINT tileIndex)const;
+	void InsertTile(UINT tileIndex, std::shared_ptr<Tile> tile);
+	void PrefetchMain();
+
+	static UINT MipOffset(UINT tileSize, UINT mip);
+
+private:
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = nullptr;
+
+	void* mIndexView = nullptr;
+	FileHeader mHeader;
+	const TileEntry* mTiles = nullptr;
+
+	UINT mAllocationGranularity = 0;
+	UINT mMaxResidentTiles = 0;
+
+	std::mutex mMutex;
+	std::list<UINT> mLru;
+	std::unordered_map<UINT, ResidentTile> mResident;
+	Stats mStats;
+
+	std::deque<UINT> mPrefetchQueue;
+	std::condition_variable mPrefetchCv;
+	std::thread mPrefetchThread;
+	bool mQuit = false;
+};
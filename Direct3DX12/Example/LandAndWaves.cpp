@@ -13,6 +13,8 @@
 #include "../Common/UploadBuffer.h"
 #include "../Common/GeometryGenerator.h"
 #include "Waves.h"
+#include "Terrain.h"
+#include "Heightfield.h"
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -53,7 +55,7 @@ struct PassConstants
 struct FrameResource
 {
 public:
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT waveVertCount);
+    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT waveVertCount, UINT terrainVertCount);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
@@ -71,6 +73,9 @@ public:
     // 그러므로 매 프레임마다 버텍스 버퍼가 필요합니다.
     std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
 
+    // 이번 프레임에 새로 보이게 된 지형 청크의 버텍스입니다. Draw에서 GPU 풀로 복사됩니다.
+    std::unique_ptr<UploadBuffer<Vertex>> TerrainUpload = nullptr;
+
     // 펜스 값은 현재 펜스 지점까지의 명령들을 표시합니다.
     // 이 값은 아직 GPU에 의해서 자원들이 사용하는지 검사할 수 있게 해줍니다.
     UINT64 Fence = 0;
@@ -136,6 +141,8 @@ private:
     void UpdateObjectCBs(const GameTimer& gt);
     void UpdateMainPassCB(const GameTimer& gt);
     void UpdateWaves(const GameTimer& gt);
+    void UpdateTerrain(const GameTimer& gt);
+    void UploadTerrainChunks(ID3D12GraphicsCommandList* cmdList);
 
     void BuildRootSignature();
     void BuildShadersAndInputLayout();
@@ -145,8 +152,10 @@ private:
     void BuildFrameResources();
     void BuildRenderItems();
     void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+    void DrawTerrain(ID3D12GraphicsCommandList* cmdList);
 
     float GetHillsHeight(float x, float z) const;
+    XMFLOAT4 GetHillsColor(float y) const;
 
 private:
     std::vector<std::unique_ptr<FrameResource>> mFrameResources;
@@ -162,6 +171,43 @@ private:
     std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
 
     RenderItem* mWavesRitem = nullptr;
+    RenderItem* mLandRitem = nullptr;
+
+    // 한 프레임에 그릴 수 있는 최대 지형 청크 수입니다.
+    // Terrain::Select는 이 수를 넘지 않도록 세분화를 멈춥니다.
+    static const UINT MaxTerrainChunks = 512;
+
+    // GPU 풀에 상주하는 청크 수입니다. 그리는 청크 수보다 많아야
+    // 이번 프레임에 그리는 슬롯을 내보내는 일이 없습니다.
+    static const UINT TerrainPoolSlots = 768;
+    static_assert(TerrainPoolSlots > MaxTerrainChunks, "the pool must hold every chunk drawn in a frame");
+
+    struct TerrainSlot
+    {
+        UINT NodeIndex = -1;
+        UINT64 LastUsedFrame = 0;
+        std::list<UINT>::iterator LruPos;
+    };
+
+    std::unique_ptr<Terrain> mTerrain;
+    std::unique_ptr<Heightfield> mHeightfield;
+
+    // 업로드된 청크의 버텍스는 기본 힙의 풀에 남아 있으므로 새로 보이게 된 청크만 복사합니다.
+    ComPtr<ID3D12Resource> mTerrainPool = nullptr;
+    D3D12_RESOURCE_STATES mTerrainPoolState = D3D12_RESOURCE_STATE_COMMON;
+    std::vector<TerrainSlot> mTerrainSlots;
+    std::unordered_map<UINT, UINT> mTerrainSlotOfNode;
+
+    // 가장 최근에 사용한 슬롯이 앞에 옵니다.
+    std::list<UINT> mTerrainSlotLru;
+    UINT64 mTerrainFrame = 0;
+
+    // 이번 프레임에 그릴 슬롯들과, 업로드 버퍼에서 풀로 복사할 (업로드 위치, 슬롯) 쌍들입니다.
+    std::vector<UINT> mTerrainDrawSlots;
+    std::vector<std::pair<UINT, UINT>> mTerrainUploads;
+
+    // 청크 하나의 버텍스를 모아 두었다가 업로드 버퍼에 한 번에 쓰기 위한 배열입니다.
+    std::vector<Vertex> mTerrainVertices;
 
     // 렌더 아이템 목록.
     std::vector<std::unique_ptr<RenderItem>> mAllRitems;
@@ -171,6 +217,9 @@ private:
 
     std::unique_ptr<Waves> mWaves;
 
+    // 웨이브 버텍스들을 모아 두었다가 버텍스 버퍼에 한 번에 쓰기 위한 배열입니다.
+    std::vector<Vertex> mWaveVertices;
+
     PassConstants mMainPassCB;
 
     bool mIsWireframe = false;
@@ -209,7 +258,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
     }
 }
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT waveVertCount)
+FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT waveVertCount, UINT terrainVertCount)
 {
     ThrowIfFailed(device->CreateCommandAllocator(
         D3D12_COMMAND_LIST_TYPE_DIRECT,
@@ -219,6 +268,7 @@ FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCo
     ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
 
     WavesVB = std::make_unique<UploadBuffer<Vertex>>(device, waveVertCount, false);
+    TerrainUpload = std::make_unique<UploadBuffer<Vertex>>(device, terrainVertCount, false);
 }
 
 FrameResource::~FrameResource()
@@ -268,7 +318,7 @@ void LandAndWavesApp::OnResize()
     D3DApp::OnResize();
 
     // 윈도우 크기가 변경됬기 때문에 화면 비율을 업데이트하고 프로젝션 메트릭스를 다시 계산합니다.
-    XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f * MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
+    XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f * MathHelper::Pi, AspectRatio(), 1.0f, 4000.0f);
     XMStoreFloat4x4(&mProj, P);
 }
 
@@ -294,6 +344,7 @@ void LandAndWavesApp::Update(const GameTimer& gt)
     UpdateObjectCBs(gt);
     UpdateMainPassCB(gt);
     UpdateWaves(gt);
+    UpdateTerrain(gt);
 }
 
 void LandAndWavesApp::Draw(const GameTimer& gt)
@@ -314,6 +365,8 @@ void LandAndWavesApp::Draw(const GameTimer& gt)
         ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
     }
 
+    UploadTerrainChunks(mCommandList.Get());
+
     mCommandList->RSSetViewports(1, &mScreenViewport);
     mCommandList->RSSetScissorRects(1, &mScissorRect);
 
@@ -336,6 +389,7 @@ void LandAndWavesApp::Draw(const GameTimer& gt)
     mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
 
     DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+    DrawTerrain(mCommandList.Get());
 
     // 리소스의 상태를 출력할 수 있도록 변경합니다.
     mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -400,7 +454,7 @@ void LandAndWavesApp::OnMouseMove(WPARAM btnState, int x, int y)
         mRadius += dx - dy;
 
         // 반지름을 제한합니다.
-        mRadius = MathHelper::Clamp(mRadius, 5.0f, 150.0f);
+        mRadius = MathHelper::Clamp(mRadius, 5.0f, 1000.0f);
     }
 
     mLastMousePos.x = x;
@@ -473,7 +527,7 @@ void LandAndWavesApp::UpdateMainPassCB(const GameTimer& gt)
     mMainPassCB.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
     mMainPassCB.RenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
     mMainPassCB.NearZ = 1.0f;
-    mMainPassCB.FarZ = 1000.0f;
+    mMainPassCB.FarZ = 4000.0f;
     mMainPassCB.TotalTime = gt.TotalTime();
     mMainPassCB.DeltaTime = gt.DeltaTime();
 
@@ -501,21 +555,120 @@ void LandAndWavesApp::UpdateWaves(const GameTimer& gt)
     mWaves->Update(gt.DeltaTime());
 
     // 새로운 값으로 웨이브 버텍스 버퍼를 업데이트 합니다.
+    // 버텍스들을 먼저 배열에 만든 다음 업로드 버퍼에는 처음부터 순서대로 한 번에 씁니다.
     auto currWavesVB = mCurrFrameResource->WavesVB.get();
+    mWaveVertices.resize(mWaves->VertexCount());
     for (int i = 0; i < mWaves->VertexCount(); ++i)
     {
-        Vertex v;
+        Vertex& v = mWaveVertices[i];
 
         v.Pos = mWaves->Position(i);
         v.Color = XMFLOAT4(Colors::Blue);
-
-        currWavesVB->CopyData(i, v);
     }
+    currWavesVB->CopyRange(0, mWaveVertices.data(), (UINT)mWaveVertices.size());
 
     // 웨이브 렌더 아이템의 다이나믹 버텍스 버퍼를 현재 웨이브 버텍스 버퍼로 설정한다.
     mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
 }
 
+void LandAndWavesApp::UpdateTerrain(const GameTimer& gt)
+{
+    // 월드 공간의 시야 절두체를 구합니다.
+    XMMATRIX view = XMLoadFloat4x4(&mView);
+    XMMATRIX proj = XMLoadFloat4x4(&mProj);
+    XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+
+    BoundingFrustum frustumV;
+    BoundingFrustum::CreateFromMatrix(frustumV, proj);
+
+    BoundingFrustum frustumW;
+    frustumV.Transform(frustumW, invView);
+
+    // 카메라 주변의 높이맵 타일을 미리 읽어둡니다.
+    if (mHeightfield != nullptr)
+        mHeightfield->UpdateResidency(mEyePos.x, mEyePos.z, 0.25f * mTerrain->GetDesc().Size);
+
+    // 세로 시야각은 프로젝션 행렬에서 구합니다. _22 = 1 / tan(fovY / 2) 입니다.
+    float fovY = 2.0f * atanf(1.0f / mProj._22);
+
+    const auto& chunks = mTerrain->Select(frustumW, mEyePos, (float)mClientHeight, fovY);
+
+    // Select는 MaxDrawChunks를 넘지 않으므로 모든 청크가 풀과 업로드 버퍼에 들어갑니다.
+    assert(chunks.size() <= MaxTerrainChunks);
+
+    ++mTerrainFrame;
+    mTerrainDrawSlots.clear();
+    mTerrainUploads.clear();
+
+    auto currTerrainUpload = mCurrFrameResource->TerrainUpload.get();
+    const UINT vertsPerChunk = mTerrain->VerticesPerChunk();
+
+    for (const Terrain::DrawChunk& chunk : chunks)
+    {
+        auto it = mTerrainSlotOfNode.find(chunk.NodeIndex);
+        if (it != mTerrainSlotOfNode.end())
+        {
+            // 이미 풀에 있는 청크는 복사하지 않습니다.
+            TerrainSlot& slot = mTerrainSlots[it->second];
+            mTerrainSlotLru.splice(mTerrainSlotLru.begin(), mTerrainSlotLru, slot.LruPos);
+            slot.LastUsedFrame = mTerrainFrame;
+            mTerrainDrawSlots.push_back(it->second);
+            continue;
+        }
+
+        // 가장 오래전에 사용한 슬롯을 재사용합니다.
+        // 앞선 프레임이 그 슬롯을 읽는 중이어도 복사는 같은 큐에서 배리어 뒤에 실행되므로 안전합니다.
+        UINT slotIndex = mTerrainSlotLru.back();
+        TerrainSlot& slot = mTerrainSlots[slotIndex];
+        assert(slot.LastUsedFrame != mTerrainFrame);
+
+        if (slot.NodeIndex != (UINT)-1)
+            mTerrainSlotOfNode.erase(slot.NodeIndex);
+
+        slot.NodeIndex = chunk.NodeIndex;
+        slot.LastUsedFrame = mTerrainFrame;
+        mTerrainSlotLru.splice(mTerrainSlotLru.begin(), mTerrainSlotLru, slot.LruPos);
+        mTerrainSlotOfNode[chunk.NodeIndex] = slotIndex;
+
+        const auto& src = chunk.Mesh->Vertices;
+        for (UINT i = 0; i < vertsPerChunk; ++i)
+        {
+            mTerrainVertices[i].Pos = src[i].Position;
+            mTerrainVertices[i].Color = GetHillsColor(src[i].Position.y);
+        }
+
+        UINT uploadIndex = (UINT)mTerrainUploads.size();
+        currTerrainUpload->CopyRange(uploadIndex * vertsPerChunk, mTerrainVertices.data(), vertsPerChunk);
+
+        mTerrainUploads.push_back(std::make_pair(uploadIndex, slotIndex));
+        mTerrainDrawSlots.push_back(slotIndex);
+    }
+}
+
+void LandAndWavesApp::UploadTerrainChunks(ID3D12GraphicsCommandList* cmdList)
+{
+    if (mTerrainUploads.empty())
+        return;
+
+    const UINT64 chunkByteSize = (UINT64)mTerrain->VerticesPerChunk() * sizeof(Vertex);
+    auto uploadBuffer = mCurrFrameResource->TerrainUpload->Resource();
+
+    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mTerrainPool.Get(),
+                                                                     mTerrainPoolState,
+                                                                     D3D12_RESOURCE_STATE_COPY_DEST));
+
+    for (const auto& upload : mTerrainUploads)
+    {
+        cmdList->CopyBufferRegion(mTerrainPool.Get(), upload.second * chunkByteSize,
+                                  uploadBuffer, upload.first * chunkByteSize, chunkByteSize);
+    }
+
+    mTerrainPoolState = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER;
+    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mTerrainPool.Get(),
+                                                                     D3D12_RESOURCE_STATE_COPY_DEST,
+                                                                     mTerrainPoolState));
+}
+
 void LandAndWavesApp::BuildRootSignature()
 {
     // 루트 파라미터는 테이블, 루트 디스크립터, 루트 상수가 될 수 있습니다.
@@ -563,71 +716,79 @@ void LandAndWavesApp::BuildShadersAndInputLayout()
 
 void LandAndWavesApp::BuildLandGeometry()
 {
-    GeometryGenerator geoGen;
-    GeometryGenerator::MeshData grid = geoGen.CreateGrid(160.0f, 160.0f, 50, 50);
+    Terrain::Desc desc;
+    desc.Size = 2048.0f;
+    desc.MaxDepth = 5;
+    desc.ChunkResolution = 32;
+    desc.MaxDrawChunks = MaxTerrainChunks;
 
-    //
-    // 필요한 버텍스 엘리먼트를 추출하고 각 버텍스 마다 높이 함수를 적용합니다.
-    // 추가적으로 사실감을 높히기 위해 버텍스의 높이에 따라 색상을 부여합니다.
-    //
+    // 타일 높이맵 파일이 있으면 그것을 사용하고, 없으면 언덕 함수를 사용합니다.
+    // 높이맵은 메모리 매핑되어 필요한 타일만 읽혀집니다.
+    Terrain::HeightSource heightSource;
+    heightSource.Height = [this](float x, float z) { return GetHillsHeight(x, z); };
 
-    std::vector<Vertex> vertices(grid.Vertices.size());
-    for (size_t i = 0; i < grid.Vertices.size(); ++i)
+    const std::wstring heightfieldFilename = L"../Textures/terrain.hfd";
+    if (GetFileAttributesW(heightfieldFilename.c_str()) != INVALID_FILE_ATTRIBUTES)
     {
-        auto& p = grid.Vertices[i].Position;
-        vertices[i].Pos = p;
-        vertices[i].Pos.y = GetHillsHeight(p.x, p.z);
+        mHeightfield = std::make_unique<Heightfield>(heightfieldFilename, 64);
+        desc.Size = MathHelper::Min(mHeightfield->WorldWidth(), mHeightfield->WorldDepth());
+        heightSource.Height = [this](float x, float z) { return mHeightfield->Sample(x, z); };
 
-        // 색상은 높이에 따라서 설정됩니다.
-        if (vertices[i].Pos.y < -10.0f)
-        {
-            // 모래색
-            vertices[i].Color = XMFLOAT4(1.0f, 0.96f, 0.62f, 1.0f);
-        }
-        else if (vertices[i].Pos.y < 5.0f)
-        {
-            // 밝은 녹황색.
-            vertices[i].Color = XMFLOAT4(0.48f, 0.77f, 0.46f, 1.0f);
-        }
-        else if (vertices[i].Pos.y < 12.0f)
-        {
-            // 짙은 녹황색.
-            vertices[i].Color = XMFLOAT4(0.1f, 0.48f, 0.19f, 1.0f);
-        }
-        else if (vertices[i].Pos.y < 20.0f)
+        // 청크를 만들 때는 필요한 타일을 한 번만 고정하고 잠금 없이 샘플링합니다.
+        heightSource.Region = [this](float minX, float minZ, float maxX, float maxZ) -> Terrain::HeightFunc
         {
-            // 짙은 갈색.
-            vertices[i].Color = XMFLOAT4(0.45f, 0.39f, 0.34f, 1.0f);
-        }
-        else
+            auto region = std::make_shared<Heightfield::Region>(mHeightfield->PinRegion(minX, minZ, maxX, maxZ));
+            return [region](float x, float z) { return region->Sample(x, z); };
+        };
+
+        // 노드 경계는 타일 인덱스의 최소/최대 샘플로 만들어지므로 타일을 매핑하지 않습니다.
+        heightSource.Range = [this](float minX, float minZ, float maxX, float maxZ, float& minY, float& maxY)
         {
-            // 흰 눈.
-            vertices[i].Color = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-        }
+            mHeightfield->HeightRange(minX, minZ, maxX, maxZ, minY, maxY);
+        };
     }
 
-    const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+    mTerrain = std::make_unique<Terrain>(desc, heightSource);
 
-    std::vector<std::uint16_t> indices = grid.GetIndices16();
+    //
+    // 모든 청크는 같은 인덱스 버퍼를 공유합니다.
+    // 버텍스는 GPU 풀의 슬롯에 상주하며, 새로 보이게 된 청크만 업로드 버퍼를 거쳐 복사됩니다.
+    //
+
+    const UINT vertsPerChunk = mTerrain->VerticesPerChunk();
+    const UINT poolByteSize = TerrainPoolSlots * vertsPerChunk * sizeof(Vertex);
+
+    ThrowIfFailed(md3dDevice->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(poolByteSize),
+        D3D12_RESOURCE_STATE_COMMON,
+        nullptr,
+        IID_PPV_ARGS(mTerrainPool.GetAddressOf())));
+
+    mTerrainSlots.resize(TerrainPoolSlots);
+    for (UINT i = 0; i < TerrainPoolSlots; ++i)
+        mTerrainSlots[i].LruPos = mTerrainSlotLru.insert(mTerrainSlotLru.end(), i);
+
+    mTerrainVertices.resize(vertsPerChunk);
+
+    const std::vector<std::uint16_t>& indices = mTerrain->ChunkIndices();
     const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
 
     auto geo = std::make_unique<MeshGeometry>();
     geo->Name = "landGeo";
 
-    ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-    CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+    geo->VertexBufferCPU = nullptr;
+    geo->VertexBufferGPU = mTerrainPool;
 
     ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
     CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-    geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-                                                        mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
     geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
                                                        mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
 
     geo->VertexByteStride = sizeof(Vertex);
-    geo->VertexBufferByteSize = vbByteSize;
+    geo->VertexBufferByteSize = poolByteSize;
     geo->IndexFormat = DXGI_FORMAT_R16_UINT;
     geo->IndexBufferByteSize = ibByteSize;
 
@@ -636,7 +797,7 @@ void LandAndWavesApp::BuildLandGeometry()
     submesh.StartIndexLocation = 0;
     submesh.BaseVertexLocation = 0;
 
-    geo->DrawArgs["grid"] = submesh;
+    geo->DrawArgs["chunk"] = submesh;
 
     mGeometries["landGeo"] = std::move(geo);
 }
@@ -743,7 +904,8 @@ void LandAndWavesApp::BuildFrameResources()
     for (int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(
-            md3dDevice.Get(), 1, (UINT)mAllRitems.size(), mWaves->VertexCount()));
+            md3dDevice.Get(), 1, (UINT)mAllRitems.size(), mWaves->VertexCount(),
+            MaxTerrainChunks * mTerrain->VerticesPerChunk()));
     }
 }
 
@@ -762,16 +924,17 @@ void LandAndWavesApp::BuildRenderItems()
 
     mRitemLayer[(int)RenderLayer::Opaque].push_back(wavesRitem.get());
 
+    // 지형은 청크 단위로 DrawTerrain에서 그려지므로 레이어에 추가하지 않습니다.
     auto gridRitem = std::make_unique<RenderItem>();
     gridRitem->World = MathHelper::Identity4x4();
     gridRitem->ObjCBIndex = 1;
     gridRitem->Geo = mGeometries["landGeo"].get();
     gridRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-    gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-    gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+    gridRitem->IndexCount = gridRitem->Geo->DrawArgs["chunk"].IndexCount;
+    gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["chunk"].StartIndexLocation;
+    gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["chunk"].BaseVertexLocation;
 
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
+    mLandRitem = gridRitem.get();
 
     mAllRitems.push_back(std::move(wavesRitem));
     mAllRitems.push_back(std::move(gridRitem));
@@ -801,7 +964,60 @@ void LandAndWavesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const
     }
 }
 
+void LandAndWavesApp::DrawTerrain(ID3D12GraphicsCommandList* cmdList)
+{
+    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+
+    auto ri = mLandRitem;
+
+    cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+    cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
+    cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+
+    D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = mCurrFrameResource->ObjectCB->Resource()->GetGPUVirtualAddress();
+    objCBAddress += ri->ObjCBIndex * objCBByteSize;
+
+    cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
+
+    // 슬롯 s의 버텍스는 풀의 s * VerticesPerChunk 위치부터 저장되어 있습니다.
+    const UINT vertsPerChunk = mTerrain->VerticesPerChunk();
+    for (UINT slot : mTerrainDrawSlots)
+    {
+        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, slot * vertsPerChunk, 0);
+    }
+}
+
 float LandAndWavesApp::GetHillsHeight(float x, float z) const
 {
     return 0.3f * (z * sinf(0.1f * x) + x * cosf(0.1f * z));
 }
+
+XMFLOAT4 LandAndWavesApp::GetHillsColor(float y) const
+{
+    // 색상은 높이에 따라서 설정됩니다.
+    if (y < -10.0f)
+    {
+        // 모래색
+        return XMFLOAT4(1.0f, 0.96f, 0.62f, 1.0f);
+    }
+    else if (y < 5.0f)
+    {
+        // 밝은 녹황색.
+        return XMFLOAT4(0.48f, 0.77f, 0.46f, 1.0f);
+    }
+    else if (y < 12.0f)
+    {
+        // 짙은 녹황색.
+        return XMFLOAT4(0.1f, 0.48f, 0.19f, 1.0f);
+    }
+    else if (y < 20.0f)
+    {
+        // 짙은 갈색.
+        return XMFLOAT4(0.45f, 0.39f, 0.34f, 1.0f);
+    }
+    else
+    {
+        // 흰 눈.
+        return XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+    }
+}
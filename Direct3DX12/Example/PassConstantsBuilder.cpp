@@ -0,0 +1,52 @@
+﻿#include "PassConstantsBuilder.h"
+
+using namespace DirectX;
+
+bool PassConstantsBuilder::Build(PassConstants& pass, FXMMATRIX view, CXMMATRIX proj, Projection projection)
+{
+	XMFLOAT4X4 newView;
+	XMFLOAT4X4 newProj;
+	XMStoreFloat4x4(&newView, view);
+	XMStoreFloat4x4(&newProj, proj);
+
+	bool viewChanged = !mValid || memcmp(&newView, &mView, sizeof(XMFLOAT4X4)) != 0;
+	bool projChanged = !mValid || memcmp(&newProj, &mProj, sizeof(XMFLOAT4X4)) != 0;
+	if (!viewChanged && !projChanged)
+		return false;
+
+	mValid = true;
+
+	if (viewChanged)
+	{
+		XMMATRIX invView = MathHelper::InverseRigid(view);
+
+		mView = newView;
+		XMStoreFloat4x4(&mInvView, invView);
+		XMStoreFloat4x4(&pass.View, XMMatrixTranspose(view));
+		XMStoreFloat4x4(&pass.InvView, XMMatrixTranspose(invView));
+	}
+
+	if (projChanged)
+	{
+		XMMATRIX invProj = projection == Projection::Perspective ?
+			MathHelper::InversePerspective(proj) : MathHelper::InverseOrthographic(proj);
+
+		mProj = newProj;
+		XMStoreFloat4x4(&mInvProj, invProj);
+		XMStoreFloat4x4(&pass.Proj, XMMatrixTranspose(proj));
+		XMStoreFloat4x4(&pass.InvProj, XMMatrixTranspose(invProj));
+	}
+
+	// (V * P)^-1 = P^-1 * V^-1 이므로 뷰-투영 역행렬은 곱셈 한 번으로 구합니다.
+	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+	XMMATRIX invViewProj = XMMatrixMultiply(XMLoadFloat4x4(&mInvProj), XMLoadFloat4x4(&mInvView));
+	XMStoreFloat4x4(&pass.ViewProj, XMMatrixTranspose(viewProj));
+	XMStoreFloat4x4(&pass.InvViewProj, XMMatrixTranspose(invViewProj));
+
+	return true;
+}
+
+void PassConstantsBuilder::Invalidate()
+{
+	mValid = false;
+}
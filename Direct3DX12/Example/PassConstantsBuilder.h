@@ -0,0 +1,41 @@
+﻿#pragma once
+
+#include "FrameResource.h"
+
+// 패스 상수의 카메라 행렬들(View, Proj, ViewProj와 각각의 역행렬)을 채우는 클래스입니다.
+// 입력 행렬을 기억해 두었다가 바뀐 것만 다시 계산해서 CPU 쪽 패스 상수에 씁니다. 카메라나 광원이 멈춰 있으면
+// 역행렬 계산도, 행렬 쓰기도 하지 않습니다. 그러므로 항상 같은 PassConstants에 대해 호출해야 합니다.
+// 업로드 힙으로는 줄어들지 않습니다. 패스 상수는 매 프레임 업로드 링의 새 슬롯에 통째로 복사됩니다.
+//
+// 뷰 행렬은 강체 변환, 투영 행렬은 DirectXMath의 왼손 원근/직교 투영이라고 가정하고
+// 일반 역행렬 대신 닫힌 식(MathHelper::InverseRigid, InversePerspective, InverseOrthographic)을 씁니다.
+class PassConstantsBuilder
+{
+public:
+	enum class Projection
+	{
+		Perspective,
+		Orthographic,
+	};
+
+public:
+	PassConstantsBuilder() = default;
+	PassConstantsBuilder(const PassConstantsBuilder& rhs) = delete;
+	PassConstantsBuilder& operator=(const PassConstantsBuilder& rhs) = delete;
+	~PassConstantsBuilder() = default;
+
+	// 바뀐 행렬들을 pass에 쓰고, 하나라도 바뀌었으면 true를 돌려줍니다.
+	bool Build(PassConstants& pass, DirectX::FXMMATRIX view, DirectX::CXMMATRIX proj, Projection projection);
+
+	// 다음 Build에서 모든 행렬을 다시 계산하게 합니다.
+	void Invalidate();
+
+private:
+	bool mValid = false;
+
+	// 마지막으로 받은 입력 행렬과 그 역행렬입니다. (전치하지 않은 값)
+	DirectX::XMFLOAT4X4 mView;
+	DirectX::XMFLOAT4X4 mProj;
+	DirectX::XMFLOAT4X4 mInvView;
+	DirectX::XMFLOAT4X4 mInvProj;
+};
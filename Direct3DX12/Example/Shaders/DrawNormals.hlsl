@@ -23,7 +23,7 @@ struct VertexIn
 	float3 PosL    : POSITION;
     float3 NormalL : NORMAL;
 	float2 TexC    : TEXCOORD;
-	float3 TangentU : TANGENT;
+	float4 TangentU : TANGENT;
 };
 
 struct VertexOut
@@ -34,8 +34,10 @@ struct VertexOut
 	float2 TexC     : TEXCOORD;
 };
 
-VertexOut VS(VertexIn vin)
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
+	SetInstanceID(instanceID);
+
 	VertexOut vout = (VertexOut)0.0f;
 
 	// Fetch the material data.
@@ -43,7 +45,7 @@ VertexOut VS(VertexIn vin)
 	
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
     vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
-	vout.TangentW = mul(vin.TangentU, (float3x3)gWorld);
+	vout.TangentW = mul(vin.TangentU.xyz, (float3x3)gWorld);
 
     // Transform to homogeneous clip space.
     float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
@@ -12,8 +12,10 @@ struct VertexOut
 	float2 TexC    : TEXCOORD;
 };
 
-VertexOut VS(VertexIn vin)
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
+	SetInstanceID(instanceID);
+
 	VertexOut vout = (VertexOut)0.0f;
 
 	MaterialData matData = gMaterialData[gMaterialIndex];
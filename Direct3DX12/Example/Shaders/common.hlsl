@@ -11,6 +11,9 @@
     #define NUM_SPOT_LIGHTS 0
 #endif
 
+// FrameResource.h MaxShadowCascades ƾ մϴ.
+#define MaxShadowCascades 4
+
 #include "LightingUtil.hlsl"
 
 struct MaterialData
@@ -44,6 +47,66 @@ SamplerState gsamAnisotropicWrap  : register(s4);
 SamplerState gsamAnisotropicClamp : register(s5);
 SamplerComparisonState gsamShadow : register(s6);
 
+#ifdef PACKED_OBJECT_DATA
+
+// ü ͸ ƴ    Դϴ. FrameResource.h ObjectData ƾ մϴ.
+struct ObjectData
+{
+    float4 World[3];
+    float4 TexScaleOffset;
+    uint   MaterialIndex;
+    uint   ObjPad0;
+    uint   ObjPad1;
+    uint   ObjPad2;
+};
+
+StructuredBuffer<ObjectData> gObjectData : register(t1, space1);
+
+// νϽ ׸ ü εԴϴ. DrawRenderItems ׸ ϸ ε  մϴ.
+StructuredBuffer<uint> gInstanceObjects : register(t2, space1);
+
+// ׸  ù νϽ gInstanceObjects  ġԴϴ. Ʈ  ޵˴ϴ.
+cbuffer cbInstanceBase : register(b2)
+{
+    uint gInstanceBase;
+};
+
+//  ̴ SetInstanceID մϴ. ȼ ̴ 0   ù νϽ нϴ.
+//   νϽ  Ƿ ȼ ̴ gMaterialIndex ´ Դϴ.
+static uint gInstanceID = 0;
+
+void SetInstanceID(uint instanceID)
+{
+    gInstanceID = instanceID;
+}
+
+uint CurrentObjectIndex()
+{
+    return gInstanceObjects[gInstanceBase + gInstanceID];
+}
+
+float4x4 LoadObjectWorld()
+{
+    ObjectData data = gObjectData[CurrentObjectIndex()];
+    return transpose(float4x4(data.World[0], data.World[1], data.World[2], float4(0.0f, 0.0f, 0.0f, 1.0f)));
+}
+
+float4x4 LoadObjectTexTransform()
+{
+    float4 so = gObjectData[CurrentObjectIndex()].TexScaleOffset;
+    return float4x4(so.x, 0.0f, 0.0f, 0.0f,
+                    0.0f, so.y, 0.0f, 0.0f,
+                    0.0f, 0.0f, 1.0f, 0.0f,
+                    so.z, so.w, 0.0f, 1.0f);
+}
+
+// ̴   Ŀ  ̸ ϴ.
+#define gWorld LoadObjectWorld()
+#define gTexTransform LoadObjectTexTransform()
+#define gMaterialIndex (gObjectData[CurrentObjectIndex()].MaterialIndex)
+
+#else
+
 // Constant data that varies per frame.
 cbuffer cbPerObject : register(b0)
 {
@@ -55,6 +118,13 @@ cbuffer cbPerObject : register(b0)
 	uint gObjPad2;
 };
 
+//    ۸  ׸Ƿ νϽ ȣ  ʽϴ.
+void SetInstanceID(uint instanceID)
+{
+}
+
+#endif
+
 // Constant data that varies per pass.
 cbuffer cbPass : register(b1)
 {
@@ -64,7 +134,9 @@ cbuffer cbPass : register(b1)
     float4x4 gInvProj;
     float4x4 gViewProj;
     float4x4 gInvViewProj;
-    float4x4 gShadowTransform;
+    float4x4 gShadowTransforms[MaxShadowCascades];
+    float4 gCascadeSplits;
+    float4x4 gReflect;
 
     float3 gEyePosW;
     float cbPerObjectPad1;
@@ -93,15 +165,17 @@ cbuffer cbPass : register(b1)
 };
 
 
-float3 NormalSampleToWorldSpace(float3 normalMapSample, float3 unitNormalW, float3 tangentW)
+float3 NormalSampleToWorldSpace(float3 normalMapSample, float3 unitNormalW, float4 tangentW)
 {
 	// Uncompress each component from [0,1] to [-1,1].
 	float3 normalT = 2.0f*normalMapSample - 1.0f;
 
 	// Build orthonormal basis.
 	float3 N = unitNormalW;
-	float3 T = normalize(tangentW - dot(tangentW, N)*N);
-	float3 B = cross(N, T);
+	float3 T = normalize(tangentW.xyz - dot(tangentW.xyz, N)*N);
+
+	// w is the handedness of the tangent frame, -1 where the UVs are mirrored.
+	float3 B = tangentW.w * cross(N, T);
 
 	float3x3 TBN = float3x3(T, B, N);
 
@@ -111,8 +185,23 @@ float3 NormalSampleToWorldSpace(float3 normalMapSample, float3 unitNormalW, floa
 	return bumpedNormalW;
 }
 
-float CalcShadowFactor(float4 shadowPosH)
+float CalcShadowFactor(float3 posW, float viewDepth)
 {
+    // ȼ þ  ̸ ϴ   ĳ̵带 ϴ.
+    //  ĳ̵庸  ȼ ׸ڰ ϴ.
+    int cascade = MaxShadowCascades;
+    [unroll]
+    for (int c = MaxShadowCascades - 1; c >= 0; --c)
+    {
+        if (viewDepth <= gCascadeSplits[c])
+            cascade = c;
+    }
+
+    if (cascade == MaxShadowCascades)
+        return 1.0f;
+
+    float4 shadowPosH = mul(float4(posW, 1.0f), gShadowTransforms[cascade]);
+
     // Complete projection by doing division by w.
     shadowPosH.xyz /= shadowPosH.w;
 
@@ -126,6 +215,11 @@ float CalcShadowFactor(float4 shadowPosH)
     // Texel size.
     float dx = 1.0f / (float)width;
 
+    // ĳ̵ 2x2 Ʋ󽺿  ֽϴ. PCF ̿ ĳ̵带  ʵ
+    //  ؼ  մϴ.
+    float2 tileMin = float2(cascade % 2, cascade / 2) * 0.5f;
+    shadowPosH.xy = clamp(shadowPosH.xy, tileMin + dx, tileMin + 0.5f - dx);
+
     float percentLit = 0.0f;
     const float2 offsets[9] =
     {
@@ -7,33 +7,37 @@ struct VertexIn
 	float3 PosL		: POSITION;
     float3 NormalL	: NORMAL;
 	float2 TexC		: TEXCOORD;
-	float3 TangentU : TANGENT; 
+	float4 TangentU : TANGENT; 
 };
 
 struct VertexOut
 {
 	float4 PosH		: SV_POSITION;
-	float4 ShadowPosH : POSITION0;
-    float3 PosW		: POSITION1;
+    float3 PosW		: POSITION;
     float3 NormalW	: NORMAL;
-	float3 TangentW : TANGENT; 
+	float4 TangentW : TANGENT; 
 	float2 TexC		: TEXCOORD;
 };
 
-VertexOut VS(VertexIn vin)
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
+	SetInstanceID(instanceID);
+
 	VertexOut vout = (VertexOut)0.0f;
 	
    	MaterialData matData = gMaterialData[gMaterialIndex];
 	
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    // ݻ н gReflect   ġ ſ 鿡  ݻմϴ.   н  Դϴ.
+    float4 posW = mul(mul(float4(vin.PosL, 1.0f), gWorld), gReflect);
     vout.PosW = posW.xyz;
 	
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+    vout.NormalW = mul(mul(vin.NormalL, (float3x3)gWorld), (float3x3)gReflect);
 	
-	vout.TangentW = mul(vin.TangentU, (float3x3)gWorld); 
+	// ݻ    ⵵ Ƿ w Ľ ȣ մϴ.
+	vout.TangentW = float4(mul(mul(vin.TangentU.xyz, (float3x3)gWorld), (float3x3)gReflect),
+		vin.TangentU.w * sign(determinant((float3x3)gReflect))); 
 	
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
@@ -42,9 +46,6 @@ VertexOut VS(VertexIn vin)
 	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
 	vout.TexC = mul(texC, matData.MatTransform).xy;
 
-	// Generate projective tex-coords to project shadow map onto scene.
-    vout.ShadowPosH = mul(posW, gShadowTransform);
-
     return vout;
 }
 
@@ -87,7 +88,8 @@ float4 PS(VertexOut pin) : SV_Target
 
        // Only the first light casts a shadow.
     float3 shadowFactor = float3(1.0f, 1.0f, 1.0f);
-    shadowFactor[0] = CalcShadowFactor(pin.ShadowPosH);
+    float viewDepth = mul(float4(pin.PosW, 1.0f), gView).z;
+    shadowFactor[0] = CalcShadowFactor(pin.PosW, viewDepth);
 
    const float shininess = (1.0f - roughness) *  normalMapSample.a;
    Material mat = { diffuseAlbedo, fresnelR0, shininess };
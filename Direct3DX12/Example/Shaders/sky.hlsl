@@ -13,8 +13,10 @@ struct VertexOut
     float3 PosL : POSITION;
 };
  
-VertexOut VS(VertexIn vin)
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
+	SetInstanceID(instanceID);
+
 	VertexOut vout;
 
 	// Use local vertex position as cubemap lookup vector.
@@ -39,6 +39,16 @@ CD3DX12_CPU_DESCRIPTOR_HANDLE ShadowMap::Dsv()const
 	return mhCpuDsv;
 }
 
+ID3D12Resource* ShadowMap::StaticResource()
+{
+	return mStaticShadowMap.Get();
+}
+
+CD3DX12_CPU_DESCRIPTOR_HANDLE ShadowMap::StaticDsv()const
+{
+	return mhCpuStaticDsv;
+}
+
 D3D12_VIEWPORT ShadowMap::Viewport()const
 {
 	return mViewport;
@@ -51,12 +61,14 @@ D3D12_RECT ShadowMap::ScissorRect()const
 
 void ShadowMap::BuildDescriptors(CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
 	CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
-	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv)
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv,
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuStaticDsv)
 {
 	// Save references to the descriptors. 
 	mhCpuSrv = hCpuSrv;
 	mhGpuSrv = hGpuSrv;
 	mhCpuDsv = hCpuDsv;
+	mhCpuStaticDsv = hCpuStaticDsv;
 
 	//  Create the descriptors
 	BuildDescriptors();
@@ -96,6 +108,7 @@ void ShadowMap::BuildDescriptors()
 	dsvDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
 	dsvDesc.Texture2D.MipSlice = 0;
 	md3dDevice->CreateDepthStencilView(mShadowMap.Get(), &dsvDesc, mhCpuDsv);
+	md3dDevice->CreateDepthStencilView(mStaticShadowMap.Get(), &dsvDesc, mhCpuStaticDsv);
 }
 
 void ShadowMap::BuildResource()
@@ -126,4 +139,13 @@ void ShadowMap::BuildResource()
 		D3D12_RESOURCE_STATE_GENERIC_READ,
 		&optClear,
 		IID_PPV_ARGS(&mShadowMap)));
+
+	// Rests in GENERIC_READ too, which includes COPY_SOURCE.
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		&optClear,
+		IID_PPV_ARGS(&mStaticShadowMap)));
 }
\ No newline at end of file
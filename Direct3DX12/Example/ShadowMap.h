@@ -19,13 +19,19 @@ public:
 	CD3DX12_GPU_DESCRIPTOR_HANDLE Srv()const;
 	CD3DX12_CPU_DESCRIPTOR_HANDLE Dsv()const;
 
+	// Persistent depth of the static casters.  It is copied into Resource()
+	// every frame before the dynamic casters are drawn on top.
+	ID3D12Resource* StaticResource();
+	CD3DX12_CPU_DESCRIPTOR_HANDLE StaticDsv()const;
+
 	D3D12_VIEWPORT Viewport()const;
 	D3D12_RECT ScissorRect()const;
 
 	void BuildDescriptors(
 		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
 		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
-		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv);
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuStaticDsv);
 
 	void OnResize(UINT newWidth, UINT newHeight);
 
@@ -47,7 +53,9 @@ private:
 	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuSrv;
 	CD3DX12_GPU_DESCRIPTOR_HANDLE mhGpuSrv;
 	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuDsv;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuStaticDsv;
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> mShadowMap = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mStaticShadowMap = nullptr;
 };
 
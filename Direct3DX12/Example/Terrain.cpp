@@ -0,0 +1,446 @@
+#include "Terrain.h"
+#include <ppl.h>
+
+using namespace DirectX;
+
+Terrain::Terrain(const Desc& desc, HeightFunc heightFunc)
+	: Terrain(desc, HeightSource{ std::move(heightFunc) })
+{
+}
+
+Terrain::Terrain(const Desc& desc, HeightSource heightSource)
+	: mDesc(desc), mSource(std::move(heightSource))
+{
+	assert(mDesc.ChunkResolution > 0);
+	assert(mSource.Height != nullptr);
+
+	// Chunks are drawn with 16-bit indices.
+	assert(VerticesPerChunk() <= 0xffff);
+
+	BuildChunkIndices();
+	BuildTree();
+}
+
+const std::vector<Terrain::DrawChunk>& Terrain::Select(
+	const BoundingFrustum& frustumW,
+	const XMFLOAT3& eyePosW,
+	float viewportHeight,
+	float fovY)
+{
+	++mFrame;
+	mStats = Stats();
+	mDrawList.clear();
+
+	// Pixels covered by one world unit seen at distance one.
+	float pixelsPerRadian = viewportHeight / (2.0f * tanf(0.5f * fovY));
+
+	mReservedChunks = 1;
+	SelectNode(0, frustumW, XMLoadFloat3(&eyePosW), pixelsPerRadian, MathHelper::Infinity);
+	assert(mDesc.MaxDrawChunks == 0 || mDrawList.size() <= mDesc.MaxDrawChunks);
+
+	TrimCache();
+
+	mStats.ChunksDrawn = (UINT)mDrawList.size();
+	mStats.CacheSize = (UINT)mCache.size();
+
+	return mDrawList;
+}
+
+const std::vector<std::uint16_t>& Terrain::ChunkIndices()const
+{
+	return mChunkIndices;
+}
+
+UINT Terrain::VerticesPerChunk()const
+{
+	UINT n = mDesc.ChunkResolution + 1;
+
+	// Grid vertices plus one skirt vertex per edge vertex.
+	return n * n + 4 * n;
+}
+
+const std::vector<Terrain::Node>& Terrain::Nodes()const
+{
+	return mNodes;
+}
+
+const Terrain::Stats& Terrain::GetStats()const
+{
+	return mStats;
+}
+
+const Terrain::Desc& Terrain::GetDesc()const
+{
+	return mDesc;
+}
+
+void Terrain::BuildTree()
+{
+	mNodes.clear();
+
+	Node root;
+	root.MinX = -0.5f * mDesc.Size;
+	root.MinZ = -0.5f * mDesc.Size;
+	root.Extent = mDesc.Size;
+	root.Level = 0;
+	mNodes.push_back(root);
+
+	// Nodes are created breadth first, so the four children of a node are
+	// contiguous and every level occupies one range of mNodes.
+	std::vector<UINT> levelStart = { 0 };
+	for (UINT i = 0; i < (UINT)mNodes.size(); ++i)
+	{
+		if (mNodes[i].Level == mDesc.MaxDepth)
+			continue;
+
+		if (mNodes[i].Level + 1 == levelStart.size())
+			levelStart.push_back((UINT)mNodes.size());
+
+		mNodes[i].FirstChild = (UINT)mNodes.size();
+
+		float half = 0.5f * mNodes[i].Extent;
+		for (UINT c = 0; c < 4; ++c)
+		{
+			Node child;
+			child.MinX = mNodes[i].MinX + (c & 1) * half;
+			child.MinZ = mNodes[i].MinZ + (c >> 1) * half;
+			child.Extent = half;
+			child.Level = mNodes[i].Level + 1;
+			mNodes.push_back(child);
+		}
+	}
+	levelStart.push_back((UINT)mNodes.size());
+
+	// Bounds are computed bottom up, one level at a time.  Nodes of the same
+	// level are independent so each level runs in parallel.  Errors are left to
+	// SelectNode.
+	for (int level = (int)levelStart.size() - 2; level >= 0; --level)
+	{
+		concurrency::parallel_for(levelStart[level], levelStart[level + 1], [this](UINT i)
+		{
+			ComputeNodeBounds(i);
+		});
+	}
+}
+
+void Terrain::BuildChunkIndices()
+{
+	const UINT r = mDesc.ChunkResolution;
+	const UINT n = r + 1;
+
+	mChunkIndices.clear();
+	mChunkIndices.reserve(r * r * 6 + 4 * r * 6);
+
+	// Same winding as GeometryGenerator::CreateGrid.
+	for (UINT i = 0; i < r; ++i)
+	{
+		for (UINT j = 0; j < r; ++j)
+		{
+			mChunkIndices.push_back((std::uint16_t)(i * n + j));
+			mChunkIndices.push_back((std::uint16_t)(i * n + j + 1));
+			mChunkIndices.push_back((std::uint16_t)((i + 1) * n + j));
+
+			mChunkIndices.push_back((std::uint16_t)((i + 1) * n + j));
+			mChunkIndices.push_back((std::uint16_t)(i * n + j + 1));
+			mChunkIndices.push_back((std::uint16_t)((i + 1) * n + j + 1));
+		}
+	}
+
+	// Skirt vertices follow the grid: edge i = 0, i = r, j = 0, j = r.
+	const UINT skirtBase = n * n;
+	auto gridIndex = [n](UINT i, UINT j) { return i * n + j; };
+
+	for (UINT edge = 0; edge < 4; ++edge)
+	{
+		// Edges i = r and j = 0 face outward with (a, b, skirt a) winding,
+		// the other two need the opposite winding.
+		bool flip = (edge == 0 || edge == 3);
+
+		for (UINT k = 0; k < r; ++k)
+		{
+			UINT a, b;
+			switch (edge)
+			{
+			case 0: a = gridIndex(0, k); b = gridIndex(0, k + 1); break;
+			case 1: a = gridIndex(r, k); b = gridIndex(r, k + 1); break;
+			case 2: a = gridIndex(k, 0); b = gridIndex(k + 1, 0); break;
+			default: a = gridIndex(k, r); b = gridIndex(k + 1, r); break;
+			}
+
+			UINT sa = skirtBase + edge * n + k;
+			UINT sb = sa + 1;
+
+			if (flip)
+			{
+				mChunkIndices.push_back((std::uint16_t)a);
+				mChunkIndices.push_back((std::uint16_t)sa);
+				mChunkIndices.push_back((std::uint16_t)b);
+
+				mChunkIndices.push_back((std::uint16_t)sa);
+				mChunkIndices.push_back((std::uint16_t)sb);
+				mChunkIndices.push_back((std::uint16_t)b);
+			}
+			else
+			{
+				mChunkIndices.push_back((std::uint16_t)a);
+				mChunkIndices.push_back((std::uint16_t)b);
+				mChunkIndices.push_back((std::uint16_t)sa);
+
+				mChunkIndices.push_back((std::uint16_t)sa);
+				mChunkIndices.push_back((std::uint16_t)b);
+				mChunkIndices.push_back((std::uint16_t)sb);
+			}
+		}
+	}
+}
+
+void Terrain::ComputeNodeBounds(UINT nodeIndex)
+{
+	Node& node = mNodes[nodeIndex];
+
+	if (node.FirstChild != (UINT)-1)
+	{
+		// Union of the children, which were computed on the previous pass.
+		BoundingBox bounds = mNodes[node.FirstChild].Bounds;
+		for (UINT c = 1; c < 4; ++c)
+			BoundingBox::CreateMerged(bounds, bounds, mNodes[node.FirstChild + c].Bounds);
+
+		// The children's boxes already include SkirtDepth.  Skirts deeper than
+		// that are added once the node's error is known.
+		node.Bounds = bounds;
+		return;
+	}
+
+	float minY = +MathHelper::Infinity;
+	float maxY = -MathHelper::Infinity;
+	if (mSource.Range != nullptr)
+	{
+		mSource.Range(node.MinX, node.MinZ, node.MinX + node.Extent, node.MinZ + node.Extent, minY, maxY);
+	}
+	else
+	{
+		const UINT r = mDesc.ChunkResolution;
+		const float step = node.Extent / r;
+		HeightFunc height = RegionHeights(node.MinX, node.MinZ, node.MinX + node.Extent, node.MinZ + node.Extent);
+
+		for (UINT i = 0; i <= r; ++i)
+		{
+			for (UINT j = 0; j <= r; ++j)
+			{
+				float y = height(node.MinX + j * step, node.MinZ + i * step);
+				minY = MathHelper::Min(minY, y);
+				maxY = MathHelper::Max(maxY, y);
+			}
+		}
+	}
+
+	// Skirts hang below the surface, so the box has to include them.
+	minY -= mDesc.SkirtDepth;
+
+	XMFLOAT3 vMin(node.MinX, minY, node.MinZ);
+	XMFLOAT3 vMax(node.MinX + node.Extent, maxY, node.MinZ + node.Extent);
+	BoundingBox::CreateFromPoints(node.Bounds, XMLoadFloat3(&vMin), XMLoadFloat3(&vMax));
+}
+
+void Terrain::ComputeNodeError(UINT nodeIndex, float parentError)
+{
+	Node& node = mNodes[nodeIndex];
+	node.ErrorComputed = true;
+	++mStats.ErrorsComputed;
+
+	float error = 0.0f;
+	if (node.FirstChild != (UINT)-1)
+	{
+		const UINT r = mDesc.ChunkResolution;
+		const UINT n = r + 1;
+		const float step = node.Extent / r;
+		HeightFunc height = RegionHeights(node.MinX, node.MinZ, node.MinX + node.Extent, node.MinZ + node.Extent);
+
+		std::vector<float> heights(n * n);
+		for (UINT i = 0; i < n; ++i)
+			for (UINT j = 0; j < n; ++j)
+				heights[i * n + j] = height(node.MinX + j * step, node.MinZ + i * step);
+
+		// Compare the true height at each cell center with what this node's mesh
+		// interpolates there.
+		for (UINT i = 0; i < r; ++i)
+		{
+			for (UINT j = 0; j < r; ++j)
+			{
+				float interpolated = 0.25f * (heights[i * n + j] + heights[i * n + j + 1] +
+					heights[(i + 1) * n + j] + heights[(i + 1) * n + j + 1]);
+
+				float actual = height(node.MinX + (j + 0.5f) * step, node.MinZ + (i + 0.5f) * step);
+
+				error = MathHelper::Max(error, fabsf(actual - interpolated));
+			}
+		}
+	}
+
+	// Leaves are the reference surface and keep zero error.  A node is always
+	// measured after its parent, so clamping to the parent's error keeps the
+	// error monotonic: a child never reports more error than its parent.
+	node.GeometricError = MathHelper::Min(error, parentError);
+
+	// Skirts hang max(SkirtDepth, error) below the surface.  Every box already
+	// includes SkirtDepth, and the parent's box was lowered by at least as much
+	// as this one, so it still contains this node.
+	float extraDepth = MathHelper::Max(node.GeometricError - mDesc.SkirtDepth, 0.0f);
+	node.Bounds.Center.y -= 0.5f * extraDepth;
+	node.Bounds.Extents.y += 0.5f * extraDepth;
+}
+
+Terrain::HeightFunc Terrain::RegionHeights(float minX, float minZ, float maxX, float maxZ)const
+{
+	if (mSource.Region != nullptr)
+		return mSource.Region(minX, minZ, maxX, maxZ);
+
+	return mSource.Height;
+}
+
+void Terrain::SelectNode(UINT nodeIndex, const BoundingFrustum& frustumW,
+	FXMVECTOR eyePosW, float pixelsPerRadian, float parentError)
+{
+	if (!mNodes[nodeIndex].ErrorComputed)
+		ComputeNodeError(nodeIndex, parentError);
+
+	const Node& node = mNodes[nodeIndex];
+	++mStats.NodesVisited;
+
+	if (frustumW.Contains(node.Bounds) == DirectX::DISJOINT)
+	{
+		++mStats.NodesCulled;
+		--mReservedChunks;
+		return;
+	}
+
+	bool refine = false;
+	if (node.FirstChild != (UINT)-1)
+	{
+		// Distance from the eye to the closest point of the node's box.
+		XMVECTOR center = XMLoadFloat3(&node.Bounds.Center);
+		XMVECTOR extents = XMLoadFloat3(&node.Bounds.Extents);
+		XMVECTOR d = XMVectorMax(XMVectorAbs(eyePosW - center) - extents, XMVectorZero());
+		float dist = MathHelper::Max(XMVectorGetX(XMVector3Length(d)), 0.001f);
+
+		float pixelError = node.GeometricError * pixelsPerRadian / dist;
+		refine = pixelError > mDesc.MaxPixelError;
+
+		// Refining trades this node's chunk for up to four.
+		if (refine && mDesc.MaxDrawChunks != 0 && mReservedChunks + 3 > mDesc.MaxDrawChunks)
+		{
+			++mStats.RefinesSkipped;
+			refine = false;
+		}
+	}
+
+	if (refine)
+	{
+		mReservedChunks += 3;
+		for (UINT c = 0; c < 4; ++c)
+			SelectNode(node.FirstChild + c, frustumW, eyePosW, pixelsPerRadian, node.GeometricError);
+		return;
+	}
+
+	DrawChunk chunk;
+	chunk.NodeIndex = nodeIndex;
+	chunk.Level = node.Level;
+	chunk.Mesh = AcquireChunk(nodeIndex);
+	mDrawList.push_back(chunk);
+}
+
+const Terrain::ChunkMesh* Terrain::AcquireChunk(UINT nodeIndex)
+{
+	auto it = mCache.find(nodeIndex);
+	if (it != mCache.end())
+	{
+		++mStats.CacheHits;
+
+		CacheEntry& entry = it->second;
+		mLru.splice(mLru.begin(), mLru, entry.LruPos);
+		entry.LastUsedFrame = mFrame;
+		return &entry.Mesh;
+	}
+
+	++mStats.ChunksBuilt;
+
+	CacheEntry& entry = mCache[nodeIndex];
+	BuildChunkMesh(mNodes[nodeIndex], entry.Mesh);
+	entry.LruPos = mLru.insert(mLru.begin(), nodeIndex);
+	entry.LastUsedFrame = mFrame;
+
+	return &entry.Mesh;
+}
+
+void Terrain::BuildChunkMesh(const Node& node, ChunkMesh& mesh)const
+{
+	const UINT r = mDesc.ChunkResolution;
+	const UINT n = r + 1;
+	const float step = node.Extent / r;
+	const float terrainMin = -0.5f * mDesc.Size;
+	const float skirtDepth = MathHelper::Max(mDesc.SkirtDepth, node.GeometricError);
+
+	// Central differences reach one step past the chunk.
+	HeightFunc height = RegionHeights(node.MinX - step, node.MinZ - step,
+		node.MinX + node.Extent + step, node.MinZ + node.Extent + step);
+
+	mesh.Vertices.resize(VerticesPerChunk());
+
+	// Rows run toward -z like GeometryGenerator::CreateGrid.
+	float maxZ = node.MinZ + node.Extent;
+	for (UINT i = 0; i < n; ++i)
+	{
+		float z = maxZ - i * step;
+		for (UINT j = 0; j < n; ++j)
+		{
+			float x = node.MinX + j * step;
+
+			// Central differences give the surface normal and tangent.
+			float dhdx = (height(x + step, z) - height(x - step, z)) / (2.0f * step);
+			float dhdz = (height(x, z + step) - height(x, z - step)) / (2.0f * step);
+
+			XMVECTOR normal = XMVector3Normalize(XMVectorSet(-dhdx, 1.0f, -dhdz, 0.0f));
+			XMVECTOR tangent = XMVector3Normalize(XMVectorSet(1.0f, dhdx, 0.0f, 0.0f));
+
+			GeometryGenerator::Vertex& v = mesh.Vertices[i * n + j];
+			v.Position = XMFLOAT3(x, height(x, z), z);
+			XMStoreFloat3(&v.Normal, normal);
+			XMStoreFloat3(&v.TangentU, tangent);
+			v.TexC = XMFLOAT2((x - terrainMin) / mDesc.Size, (-terrainMin - z) / mDesc.Size);
+		}
+	}
+
+	// Skirts: a copy of every edge vertex pushed straight down.
+	UINT k = n * n;
+	for (UINT edge = 0; edge < 4; ++edge)
+	{
+		for (UINT e = 0; e < n; ++e, ++k)
+		{
+			UINT src;
+			switch (edge)
+			{
+			case 0: src = e; break;
+			case 1: src = r * n + e; break;
+			case 2: src = e * n; break;
+			default: src = e * n + r; break;
+			}
+
+			mesh.Vertices[k] = mesh.Vertices[src];
+			mesh.Vertices[k].Position.y -= skirtDepth;
+		}
+	}
+}
+
+void Terrain::TrimCache()
+{
+	// Chunks used this frame are referenced by the draw list and must stay.
+	while (mCache.size() > mDesc.CacheCapacity && !mLru.empty())
+	{
+		UINT victim = mLru.back();
+		if (mCache[victim].LastUsedFrame == mFrame)
+			break;
+
+		mLru.pop_back();
+		mCache.erase(victim);
+	}
+}
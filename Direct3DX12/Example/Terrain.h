@@ -0,0 +1,173 @@
+#pragma once
+
+#include "../Common/d3dUtil.h"
+#include "../Common/GeometryGenerator.h"
+#include <functional>
+#include <list>
+
+// Chunked quadtree terrain.
+//
+// The terrain square is split into a quadtree of tiles.  Every node covers a
+// square region and owns a grid mesh with the same vertex count, so a node one
+// level deeper has twice the sample density.  Each frame Select() walks the tree,
+// drops nodes outside the camera frustum and stops refining once the projected
+// geometric error of a node is below MaxPixelError.  Node meshes are generated
+// from the height function on demand and kept in a bounded LRU cache.
+//
+// Only node bounds are computed up front.  A node's geometric error is measured
+// the first time Select() reaches it, so the tree can be built without reading
+// every height of a large map.
+class Terrain
+{
+public:
+	using HeightFunc = std::function<float(float x, float z)>;
+
+	// Where the heights come from.  Only Height is required.
+	struct HeightSource
+	{
+		// Height at world (x, z).
+		HeightFunc Height;
+
+		// Returns a height function that is only valid inside the given square.
+		// Lets a paged source pin its storage once per chunk instead of once per
+		// sample.
+		std::function<HeightFunc(float minX, float minZ, float maxX, float maxZ)> Region;
+
+		// Conservative height range of the given square without sampling it.
+		// Leaf bounds are sampled when this is not set.
+		std::function<void(float minX, float minZ, float maxX, float maxZ, float& minY, float& maxY)> Range;
+	};
+
+	struct Desc
+	{
+		// World space width/depth of the whole terrain, centered at the origin.
+		float Size = 2048.0f;
+
+		// Number of levels below the root.  Leaves are Size / 2^MaxDepth wide.
+		UINT MaxDepth = 5;
+
+		// Quads per chunk edge.  The same at every level.
+		UINT ChunkResolution = 32;
+
+		// A node is refined while its error projects to more than this many pixels.
+		float MaxPixelError = 2.0f;
+
+		// Maximum number of chunk meshes kept resident.
+		UINT CacheCapacity = 256;
+
+		// Maximum number of chunks Select() returns.  Refinement stops early
+		// rather than go over it.  0 means no limit.
+		UINT MaxDrawChunks = 0;
+
+		// Skirts hide the cracks between neighbouring chunks of different LOD.
+		float SkirtDepth = 4.0f;
+	};
+
+	struct Node
+	{
+		DirectX::BoundingBox Bounds;
+
+		// Max vertical deviation of this node's mesh from the finest level.
+		// Valid once ErrorComputed is set.
+		float GeometricError = 0.0f;
+		bool ErrorComputed = false;
+
+		float MinX = 0.0f;
+		float MinZ = 0.0f;
+		float Extent = 0.0f;
+
+		UINT Level = 0;
+
+		// Index of the first of four children, or -1 for leaves.
+		UINT FirstChild = -1;
+	};
+
+	struct ChunkMesh
+	{
+		std::vector<GeometryGenerator::Vertex> Vertices;
+	};
+
+	// One visible chunk at the chosen LOD.
+	struct DrawChunk
+	{
+		UINT NodeIndex = 0;
+		UINT Level = 0;
+		const ChunkMesh* Mesh = nullptr;
+	};
+
+	struct Stats
+	{
+		UINT NodesVisited = 0;
+		UINT NodesCulled = 0;
+		UINT ChunksDrawn = 0;
+		UINT ChunksBuilt = 0;
+		UINT ErrorsComputed = 0;
+		UINT RefinesSkipped = 0;
+		UINT CacheHits = 0;
+		UINT CacheSize = 0;
+	};
+
+public:
+	Terrain(const Desc& desc, HeightFunc heightFunc);
+	Terrain(const Desc& desc, HeightSource heightSource);
+	Terrain(const Terrain& rhs) = delete;
+	Terrain& operator=(const Terrain& rhs) = delete;
+	~Terrain() = default;
+
+	// Picks the cut through the tree for this view and returns the visible chunks.
+	// viewportHeight and fovY are used to turn geometric error into pixels.
+	const std::vector<DrawChunk>& Select(
+		const DirectX::BoundingFrustum& frustumW,
+		const DirectX::XMFLOAT3& eyePosW,
+		float viewportHeight,
+		float fovY);
+
+	// Index list shared by every chunk (grid + skirts).
+	const std::vector<std::uint16_t>& ChunkIndices()const;
+	UINT VerticesPerChunk()const;
+
+	const std::vector<Node>& Nodes()const;
+	const Stats& GetStats()const;
+	const Desc& GetDesc()const;
+
+private:
+	void BuildTree();
+	void BuildChunkIndices();
+	void ComputeNodeBounds(UINT nodeIndex);
+	void ComputeNodeError(UINT nodeIndex, float parentError);
+	HeightFunc RegionHeights(float minX, float minZ, float maxX, float maxZ)const;
+
+	void SelectNode(UINT nodeIndex, const DirectX::BoundingFrustum& frustumW,
+		DirectX::FXMVECTOR eyePosW, float pixelsPerRadian, float parentError);
+
+	const ChunkMesh* AcquireChunk(UINT nodeIndex);
+	void BuildChunkMesh(const Node& node, ChunkMesh& mesh)const;
+	void TrimCache();
+
+private:
+	struct CacheEntry
+	{
+		ChunkMesh Mesh;
+		std::list<UINT>::iterator LruPos;
+		UINT64 LastUsedFrame = 0;
+	};
+
+	Desc mDesc;
+	HeightSource mSource;
+
+	std::vector<Node> mNodes;
+	std::vector<std::uint16_t> mChunkIndices;
+
+	// Most recently used at the front.
+	std::list<UINT> mLru;
+	std::unordered_map<UINT, CacheEntry> mCache;
+
+	std::vector<DrawChunk> mDrawList;
+
+	// Chunks drawn plus one for every subtree still being selected, so the draw
+	// list can never outgrow MaxDrawChunks.
+	UINT mReservedChunks = 0;
+
+	Stats mStats;
+	UINT64 mFrame = 0;
+};
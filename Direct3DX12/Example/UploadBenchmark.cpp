@@ -0,0 +1,92 @@
+﻿#include "UploadBenchmark.h"
+
+#if defined(UPLOAD_BENCHMARK)
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <sstream>
+
+namespace
+{
+	const UINT BenchmarkElementCount = 8192;
+	const UINT BenchmarkRepeatCount = 100;
+
+	// fn을 한 번 미리 실행한 뒤 BenchmarkRepeatCount번 실행해서 한 번의 평균 시간(ms)을 돌려줍니다.
+	template<typename Fn>
+	double MeasureMilliseconds(Fn&& fn)
+	{
+		LARGE_INTEGER frequency, begin, end;
+		QueryPerformanceFrequency(&frequency);
+
+		fn();
+
+		QueryPerformanceCounter(&begin);
+		for (UINT i = 0; i < BenchmarkRepeatCount; ++i)
+			fn();
+		QueryPerformanceCounter(&end);
+
+		return 1000.0 * (end.QuadPart - begin.QuadPart) / frequency.QuadPart / BenchmarkRepeatCount;
+	}
+
+	template<typename T>
+	void BenchmarkBuffer(ID3D12Device* device, bool isConstantBuffer, const wchar_t* name, std::wostringstream& out)
+	{
+		UploadBuffer<T> buffer(device, BenchmarkElementCount, isConstantBuffer);
+		std::vector<T> data(BenchmarkElementCount);
+
+		// 더티 목록처럼 원소의 1/4을 무작위 순서로 고릅니다.
+		std::vector<UINT> indices(BenchmarkElementCount);
+		std::iota(indices.begin(), indices.end(), 0u);
+		std::shuffle(indices.begin(), indices.end(), std::mt19937(7));
+		indices.resize(BenchmarkElementCount / 4);
+
+		std::vector<UINT> sorted(indices.size());
+		std::vector<T> gathered(indices.size());
+
+		// 전체 원소를 처음부터 씁니다.
+		double copyData = MeasureMilliseconds([&]
+		{
+			for (UINT i = 0; i < BenchmarkElementCount; ++i)
+				buffer.CopyData(i, data[i]);
+		});
+		double copyRange = MeasureMilliseconds([&]
+		{
+			buffer.CopyRange(0, data.data(), BenchmarkElementCount);
+		});
+
+		// 흩어진 원소를 씁니다. 새 방식은 정렬과 지역 배열로 모으는 비용까지 포함합니다.
+		double scatteredCopyData = MeasureMilliseconds([&]
+		{
+			for (UINT index : indices)
+				buffer.CopyData(index, data[index]);
+		});
+		double copyGather = MeasureMilliseconds([&]
+		{
+			sorted = indices;
+			std::sort(sorted.begin(), sorted.end());
+			for (size_t i = 0; i < sorted.size(); ++i)
+				gathered[i] = data[sorted[i]];
+			buffer.CopyGather(sorted.data(), (UINT)sorted.size(), gathered.data());
+		});
+
+		out << name << L" (" << buffer.ElementByteSize() << L" byte stride)\n"
+			<< L"  range : CopyData " << copyData << L" ms, CopyRange " << copyRange << L" ms\n"
+			<< L"  gather: CopyData " << scatteredCopyData << L" ms, CopyGather " << copyGather << L" ms\n";
+	}
+}
+
+void RunUploadBenchmark(ID3D12Device* device)
+{
+	std::wostringstream out;
+	out << L"Upload benchmark: " << BenchmarkElementCount << L" elements, "
+		<< BenchmarkElementCount / 4 << L" scattered, average of " << BenchmarkRepeatCount << L" runs\n";
+
+	BenchmarkBuffer<ObjectConstants>(device, true, L"ObjectConstants", out);
+	BenchmarkBuffer<MaterialData>(device, false, L"MaterialData", out);
+	BenchmarkBuffer<Vertex>(device, false, L"Vertex", out);
+
+	OutputDebugStringW(out.str().c_str());
+}
+
+#endif
@@ -0,0 +1,9 @@
+﻿#pragma once
+
+#include "FrameResource.h"
+
+#if defined(UPLOAD_BENCHMARK)
+// UploadBuffer에 원소마다 CopyData로 쓰는 기존 방식과 CopyRange/CopyGather를 비교하는 마이크로 벤치마크입니다.
+// 결과(한 번 쓰는 데 걸린 평균 시간)는 디버그 출력 창에 찍힙니다.
+void RunUploadBenchmark(ID3D12Device* device);
+#endif